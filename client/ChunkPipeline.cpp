@@ -0,0 +1,85 @@
+#include "ChunkPipeline.h"
+#include "EncryptedFileSender.h"
+#include "util/CRC.h"
+#include "util/Trace.h"
+
+ChunkPipeline::ChunkPipeline(const std::string& aes_key, const std::string& initial_counter, bool compress, bool checksum,
+	WorkerPool& pool) :
+	_aes_key(aes_key), _initial_counter(initial_counter), _compress(compress), _checksum(checksum), _pool(pool),
+	_max_in_flight(pool.size() < MAX_CHUNKS_IN_FLIGHT ? pool.size() : MAX_CHUNKS_IN_FLIGHT) {}
+
+ChunkPipeline::~ChunkPipeline() {
+	for (auto& chunk : _chunks) {
+		if (chunk.prepared.valid()) {
+			chunk.prepared.wait();
+		}
+	}
+}
+
+void ChunkPipeline::add(size_t id, uint64_t offset, const unsigned char* plain, size_t length, bool stable) {
+	// deque elements keep their address while others are added & popped.
+	auto& chunk = _chunks.emplace_back();
+	chunk.id = id;
+	chunk.offset = offset;
+	chunk.plain_size = length;
+	if (!stable) {
+		chunk.plain.assign(plain, plain + length);
+		plain = chunk.plain.data();
+	}
+	chunk.prepared = _pool.submit([this, &chunk, plain]() { prepare(chunk, plain); },
+		[prepared = _prepared]() { prepared->notify(); });
+}
+
+bool ChunkPipeline::is_full() const {
+	return _chunks.size() >= _max_in_flight;
+}
+
+bool ChunkPipeline::is_empty() const {
+	return _chunks.empty();
+}
+
+boost::asio::awaitable<void> ChunkPipeline::async_wait_front() {
+	// any chunk's preparation wakes the wait, so the oldest one is checked again after each.
+	auto& prepared = _chunks.front().prepared;
+	if (prepared.valid() && prepared.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+		TRACE_SCOPE("wait_prepared");
+		do {
+			co_await _prepared->async_wait();
+		} while (prepared.wait_for(std::chrono::seconds(0)) != std::future_status::ready);
+	}
+}
+
+ChunkPipeline::Chunk& ChunkPipeline::front() {
+	auto& chunk = _chunks.front();
+	if (chunk.prepared.valid()) {
+		chunk.prepared.get();
+	}
+	return chunk;
+}
+
+void ChunkPipeline::pop() {
+	_chunks.pop_front();
+}
+
+void ChunkPipeline::prepare(Chunk& chunk, const unsigned char* plain) const {
+	// the checksum is of the plain text, so the server verifies the chunk after decrypting & decompressing it.
+	if (_checksum) {
+		CRC chunk_crc;
+		chunk_crc.update(reinterpret_cast<const char*>(plain), chunk.plain_size);
+		chunk.checksum = chunk_crc.digest();
+	}
+
+	const unsigned char* content = plain;
+	size_t content_size = chunk.plain_size;
+	if (_compress) {
+		chunk.compression = ChunkCompressor::compress(plain, chunk.plain_size, chunk.compressed);
+		if (chunk.compression != ChunkCompressor::MethodNone) {
+			content = chunk.compressed.data();
+			content_size = chunk.compressed.size();
+		}
+	}
+
+	// a compressed chunk is never longer than the plain one, so it's key stream doesn't overlap the next chunk's.
+	chunk.cipher.resize(content_size);
+	EncryptedFileSender::encrypt_ctr_at(_aes_key, _initial_counter, chunk.offset, content, chunk.cipher.data(), content_size);
+}
@@ -0,0 +1,119 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <deque>
+#include <future>
+#include <memory>
+#include <boost/asio.hpp>
+#include "util/ChunkCompressor.h"
+#include "util/WorkerPool.h"
+#include "util/AsyncSignal.h"
+
+/// <summary>
+/// Prepares chunks of a file to be sent: checksums, compresses (when enabled & worth it) and encrypts them with AES-CTR
+/// at their offset in the file. Chunks are prepared in parallel on the worker pool, and returned in the order they were added,
+/// so the next chunks are prepared while the current one is sent.
+/// </summary>
+class ChunkPipeline
+{
+public:
+	/// <summary>
+	/// Maximal number of chunks that are prepared ahead of the one being sent.
+	/// </summary>
+	static const size_t MAX_CHUNKS_IN_FLIGHT = 8;
+
+	/// <summary>
+	/// A chunk that is prepared to be sent.
+	/// </summary>
+	struct Chunk {
+		/// <summary>
+		/// The caller's identifier of the chunk (e.g. it's index).
+		/// </summary>
+		size_t id = 0;
+		uint64_t offset = 0;
+		size_t plain_size = 0;
+		/// <summary>
+		/// The CRC of the plain chunk - if checksums are enabled.
+		/// </summary>
+		unsigned int checksum = 0;
+		ChunkCompressor::Method compression = ChunkCompressor::MethodNone;
+		/// <summary>
+		/// The chunk's content to send - compressed (if so) & encrypted.
+		/// </summary>
+		std::vector<unsigned char> cipher;
+
+	private:
+		friend class ChunkPipeline;
+		/// <summary>
+		/// A copy of the plain text, when the caller's data doesn't stay valid.
+		/// </summary>
+		std::vector<unsigned char> plain;
+		std::vector<unsigned char> compressed;
+		std::future<void> prepared;
+	};
+
+	/// <param name="compress">Whether chunks may be compressed before they are encrypted.</param>
+	/// <param name="checksum">Whether the CRC of each plain chunk is calculated.</param>
+	ChunkPipeline(const std::string& aes_key, const std::string& initial_counter, bool compress, bool checksum,
+		WorkerPool& pool = WorkerPool::shared());
+
+	/// <summary>
+	/// Waits for the chunks that are still prepared, since the workers use their buffers.
+	/// </summary>
+	~ChunkPipeline();
+	ChunkPipeline(const ChunkPipeline&) = delete;
+	ChunkPipeline& operator=(const ChunkPipeline&) = delete;
+
+	/// <summary>
+	/// Queues the preparation of a chunk.
+	/// </summary>
+	/// <param name="offset">The chunk's offset in the file - it's position in the key stream.</param>
+	/// <param name="stable">Whether the plain data stays valid until the chunk is popped (e.g. mapped). It is copied otherwise.</param>
+	void add(size_t id, uint64_t offset, const unsigned char* plain, size_t length, bool stable);
+
+	/// <summary>
+	/// Returns whether no more chunks should be added before the next one is popped.
+	/// </summary>
+	bool is_full() const;
+
+	/// <summary>
+	/// Returns whether there are no chunks left.
+	/// </summary>
+	bool is_empty() const;
+
+	/// <summary>
+	/// Waits for the oldest chunk to be prepared, without blocking the io_context - the worker that prepares it wakes
+	/// the waiting coroutine on it's executor.
+	/// </summary>
+	boost::asio::awaitable<void> async_wait_front();
+
+	/// <summary>
+	/// Returns the oldest chunk, once async_wait_front completed. Re-throws the preparation's exception, if any.
+	/// The chunk is valid until it is popped.
+	/// </summary>
+	Chunk& front();
+
+	/// <summary>
+	/// Releases the oldest chunk.
+	/// </summary>
+	void pop();
+
+private:
+	/// <summary>
+	/// Prepares a single chunk - runs on the worker pool.
+	/// </summary>
+	void prepare(Chunk& chunk, const unsigned char* plain) const;
+
+	const std::string& _aes_key;
+	const std::string& _initial_counter;
+	bool _compress;
+	bool _checksum;
+	WorkerPool& _pool;
+	size_t _max_in_flight;
+	std::deque<Chunk> _chunks;
+	/// <summary>
+	/// Notified by the workers once a chunk is prepared. Shared with them, since they notify it after the chunk's
+	/// future is ready - possibly after the pipeline was destroyed.
+	/// </summary>
+	std::shared_ptr<AsyncSignal> _prepared = std::make_shared<AsyncSignal>();
+};
@@ -0,0 +1,111 @@
+#include "ChunkedUpload.h"
+#include "EncryptedFileSender.h"
+#include "util/FileSource.h"
+#include "util/SocketHelper.h"
+#include "ChunkPipeline.h"
+
+#include <cryptopp/sha.h>
+
+static_assert(ChunkedUpload::CHUNK_SIZE % CryptoPP::AES::BLOCKSIZE == 0, "Chunk size must be a multiple of the AES block size!");
+static_assert(UPLOAD_ID_SIZE_BYTES <= CryptoPP::SHA256::DIGESTSIZE, "Upload ID is a truncated SHA-256 digest!");
+
+ChunkedUpload::ChunkedUpload(std::filesystem::path file_path, std::string aes_key, const unsigned char user_id[USER_ID_SIZE_BYTES], bool compress) :
+	_file_path(file_path), _aes_key(aes_key), _initial_counter(EncryptedFileSender::generate_initial_counter()), _compress(compress) {
+
+	_file_size = std::filesystem::file_size(file_path);
+	auto path = std::filesystem::absolute(file_path).u8string();
+	auto modified = std::filesystem::last_write_time(file_path).time_since_epoch().count();
+
+	// the same user uploading the same file (path, size & modification time) gets the same upload ID.
+	CryptoPP::SHA256 hash;
+	CryptoPP::byte digest[CryptoPP::SHA256::DIGESTSIZE];
+	hash.Update(user_id, USER_ID_SIZE_BYTES);
+	hash.Update(reinterpret_cast<const CryptoPP::byte*>(path.data()), path.size());
+	hash.Update(reinterpret_cast<const CryptoPP::byte*>(&_file_size), sizeof(_file_size));
+	hash.Update(reinterpret_cast<const CryptoPP::byte*>(&modified), sizeof(modified));
+	hash.Final(digest);
+	memcpy_s(_upload_id, sizeof(_upload_id), digest, sizeof(_upload_id));
+}
+
+const unsigned char* ChunkedUpload::upload_id() const {
+	return _upload_id;
+}
+
+uint64_t ChunkedUpload::file_size() const {
+	return _file_size;
+}
+
+unsigned int ChunkedUpload::chunk_count() const {
+	auto count = static_cast<unsigned int>((_file_size + CHUNK_SIZE - 1) / CHUNK_SIZE);
+	return count > 0 ? count : 1;
+}
+
+bool ChunkedUpload::is_held(const std::vector<unsigned char>& held, unsigned int index) {
+	return index / 8 < held.size() && (held[index / 8] & (1 << (index % 8))) != 0;
+}
+
+bool ChunkedUpload::is_complete(const std::vector<unsigned char>& held) const {
+	for (unsigned int i = 0; i < chunk_count(); i++) {
+		if (!is_held(held, i)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+boost::asio::awaitable<unsigned int> ChunkedUpload::async_send_missing(boost::asio::ip::tcp::socket& socket, UploadCompressedChunkRequest chunk_request,
+	const std::vector<unsigned char>& held, CRC* plain_crc, uint64_t* sent_bytes) {
+	FileSource source(_file_path);
+	memcpy_s(chunk_request.initial_counter, sizeof(chunk_request.initial_counter), _initial_counter.data(), _initial_counter.length());
+	auto request_buffer = _compress ? SocketHelper::static_buffer(&chunk_request) :
+		SocketHelper::static_buffer(static_cast<const UploadChunkRequest*>(&chunk_request));
+
+	ChunkPipeline pipeline(_aes_key, _initial_counter, _compress, true);
+	unsigned int next_index = 0;
+	unsigned int sent = 0;
+	while (true) {
+		// read ahead & queue the preparation of the next missing chunks, in the file's order.
+		while (next_index < chunk_count() && !pipeline.is_full()) {
+			auto index = next_index++;
+
+			// held chunks are skipped, unless the whole file's CRC is needed.
+			if (is_held(held, index) && plain_crc == nullptr) {
+				continue;
+			}
+
+			const unsigned char* plain;
+			auto offset = static_cast<uint64_t>(index) * CHUNK_SIZE;
+			source.seek(offset);
+			size_t length = source.next(plain, CHUNK_SIZE);
+
+			if (plain_crc != nullptr) {
+				plain_crc->update(reinterpret_cast<const char*>(plain), length);
+			}
+			if (!is_held(held, index)) {
+				// mapped data stays valid while the chunk is prepared, read data is overwritten by the next read.
+				pipeline.add(index, offset, plain, length, source.is_mapped());
+			}
+		}
+
+		if (pipeline.is_empty()) {
+			break;
+		}
+
+		// chunks are sent in order, while the next ones are prepared.
+		co_await pipeline.async_wait_front();
+		auto& chunk = pipeline.front();
+		chunk_request.chunk_index = static_cast<unsigned int>(chunk.id);
+		chunk_request.chunk_checksum = chunk.checksum;
+		chunk_request.content_size = static_cast<unsigned int>(chunk.cipher.size());
+		chunk_request.compression = chunk.compression;
+		chunk_request.plain_size = static_cast<unsigned int>(chunk.plain_size);
+		co_await SocketHelper::async_send_gather(request_buffer, boost::asio::buffer(chunk.cipher), socket);
+
+		if (sent_bytes != nullptr) {
+			*sent_bytes += chunk.cipher.size();
+		}
+		pipeline.pop();
+		sent++;
+	}
+	co_return sent;
+}
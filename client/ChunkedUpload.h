@@ -0,0 +1,77 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <boost/asio.hpp>
+#include "protocol.h"
+#include "util/CRC.h"
+
+/// <summary>
+/// Sends a file in fixed-size chunks, each with it's own checksum, so only missing or corrupted chunks are resent.
+/// The upload ID is derived from the user & the file's state, so an upload interrupted by a dropped connection
+/// (or by the process exiting) is resumed by the next upload of the same file.
+/// Chunks are encrypted with AES-CTR at their offset in the file, so each chunk can be encrypted & resent on it's own.
+/// Chunks are optionally compressed before they are encrypted, and are prepared in parallel (see ChunkPipeline).
+/// </summary>
+class ChunkedUpload
+{
+public:
+	/// <summary>
+	/// Size of a single upload chunk. Must be a multiple of the AES block size.
+	/// </summary>
+	static const unsigned int CHUNK_SIZE = 4 * 1024 * 1024;
+
+	/// <summary>
+	/// Creates a new chunked upload of a file, with a new random initial counter block.
+	/// </summary>
+	/// <param name="user_id">The uploading user's ID, part of the upload ID.</param>
+	/// <param name="compress">Whether chunks may be compressed - they are sent in compressed chunk requests if so.</param>
+	ChunkedUpload(std::filesystem::path file_path, std::string aes_key, const unsigned char user_id[USER_ID_SIZE_BYTES], bool compress = false);
+
+	/// <summary>
+	/// Returns the upload ID, that identifies the upload of the file's current state by the user.
+	/// </summary>
+	const unsigned char* upload_id() const;
+
+	/// <summary>
+	/// Returns the size of the file.
+	/// </summary>
+	uint64_t file_size() const;
+
+	/// <summary>
+	/// Returns the number of chunks of the file. An empty file has a single empty chunk.
+	/// </summary>
+	unsigned int chunk_count() const;
+
+	/// <summary>
+	/// Returns whether a chunk is set in a held chunks bitmap, as sent by the server.
+	/// Bit i (LSB first) of the bitmap is set if chunk i is held.
+	/// </summary>
+	static bool is_held(const std::vector<unsigned char>& held, unsigned int index);
+
+	/// <summary>
+	/// Returns whether all the chunks are set in a held chunks bitmap.
+	/// </summary>
+	bool is_complete(const std::vector<unsigned char>& held) const;
+
+	/// <summary>
+	/// Encrypts & sends the chunks that are not held, each in a request built from the chunk request template.
+	/// The chunks are not answered by the server - the upload status should be requested afterwards.
+	/// </summary>
+	/// <param name="chunk_request">A request with the header & IDs filled. The chunk fields are filled for each chunk.
+	/// Only the UploadChunkRequest part is sent, unless the upload is compressed.</param>
+	/// <param name="held">The held chunks bitmap, as sent by the server.</param>
+	/// <param name="plain_crc">If not null, the whole file is read, and it's plain text is fed into plain_crc.</param>
+	/// <param name="sent_bytes">If not null, the size of each sent chunk's content is added to it.</param>
+	/// <returns>The number of chunks sent.</returns>
+	boost::asio::awaitable<unsigned int> async_send_missing(boost::asio::ip::tcp::socket& socket, UploadCompressedChunkRequest chunk_request,
+		const std::vector<unsigned char>& held, CRC* plain_crc = nullptr, uint64_t* sent_bytes = nullptr);
+
+private:
+	std::filesystem::path _file_path;
+	std::string _aes_key;
+	std::string _initial_counter;
+	unsigned char _upload_id[UPLOAD_ID_SIZE_BYTES];
+	uint64_t _file_size;
+	bool _compress;
+};
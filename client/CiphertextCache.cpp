@@ -0,0 +1,91 @@
+#include "CiphertextCache.h"
+#include "util/SocketHelper.h"
+#include <algorithm>
+
+/// <summary>
+/// Size of a single mapped view, when sending from the temp file. Keeps the address space usage bounded.
+/// </summary>
+#define SEND_VIEW_SIZE (16 * 1024 * 1024)
+
+static_assert(SEND_VIEW_SIZE % TempFile::MAP_ALIGNMENT == 0, "Send view size must be aligned to the mapping granularity!");
+
+CiphertextCache::Key CiphertextCache::Key::of(const std::filesystem::path& path, const std::string& aes_key) {
+	Key key;
+	key.path = std::filesystem::absolute(path);
+	key.modified = std::filesystem::last_write_time(path);
+	key.size = std::filesystem::file_size(path);
+	key.aes_key = aes_key;
+	return key;
+}
+
+bool CiphertextCache::Key::operator==(const Key& other) const {
+	return path == other.path && modified == other.modified && size == other.size && aes_key == other.aes_key;
+}
+
+CiphertextCache::Entry::Entry(const Key& key, uint64_t expected_size, const std::string& initial_counter, size_t memory_threshold) :
+	_key(key), _initial_counter(initial_counter) {
+	if (expected_size <= memory_threshold) {
+		_memory.reserve(static_cast<size_t>(expected_size));
+	}
+	else {
+		_file = std::make_unique<TempFile>();
+	}
+}
+
+void CiphertextCache::Entry::append(const unsigned char* data, size_t size) {
+	if (_file) {
+		_file->write(data, size);
+	}
+	else {
+		_memory.insert(_memory.end(), data, data + size);
+	}
+}
+
+void CiphertextCache::Entry::complete() {
+	_complete = true;
+}
+
+const std::string& CiphertextCache::Entry::initial_counter() const {
+	return _initial_counter;
+}
+
+uint64_t CiphertextCache::Entry::size() const {
+	return _file ? _file->size() : _memory.size();
+}
+
+boost::asio::awaitable<void> CiphertextCache::Entry::async_send(boost::asio::ip::tcp::socket& socket, boost::asio::const_buffer prefix) {
+	if (!_file) {
+		co_await SocketHelper::async_send_gather(prefix, boost::asio::buffer(_memory), socket);
+		co_return;
+	}
+
+	// send view after view, so only a bounded part of the file is mapped at once.
+	for (uint64_t offset = 0; offset < _file->size(); offset += SEND_VIEW_SIZE) {
+		auto length = static_cast<size_t>(std::min<uint64_t>(SEND_VIEW_SIZE, _file->size() - offset));
+		auto view = _file->map(offset, length);
+		co_await SocketHelper::async_send_gather(prefix, boost::asio::buffer(view.data(), view.size()), socket);
+		prefix = boost::asio::const_buffer();
+	}
+}
+
+std::shared_ptr<CiphertextCache::Entry> CiphertextCache::find(const Key& key) {
+	if (_entry && _entry->_complete && _entry->_key == key) {
+		return _entry;
+	}
+	return nullptr;
+}
+
+std::shared_ptr<CiphertextCache::Entry> CiphertextCache::record(const Key& key, uint64_t expected_size, const std::string& initial_counter) {
+	// release the previous cipher text before allocating the new one.
+	_entry.reset();
+	_entry = std::make_shared<Entry>(key, expected_size, initial_counter, _memory_threshold);
+	return _entry;
+}
+
+void CiphertextCache::clear() {
+	_entry.reset();
+}
+
+void CiphertextCache::set_memory_threshold(size_t memory_threshold) {
+	_memory_threshold = memory_threshold;
+}
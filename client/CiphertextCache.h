@@ -0,0 +1,110 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <filesystem>
+#include <boost/asio.hpp>
+#include "util/TempFile.h"
+
+/// <summary>
+/// Keeps the cipher text of the last uploaded file, so upload retries can resend it
+/// without reading and encrypting the file again.
+/// Small files are kept in memory, larger ones in an anonymous memory mapped temp file.
+/// </summary>
+class CiphertextCache
+{
+public:
+	/// <summary>
+	/// Cipher texts up to this size are kept in memory, unless the cache's threshold is set lower.
+	/// </summary>
+	static const size_t MEMORY_THRESHOLD = 16 * 1024 * 1024;
+
+	/// <summary>
+	/// Identifies a cipher text: the source file's state & the key it was encrypted with.
+	/// </summary>
+	struct Key {
+		std::filesystem::path path;
+		std::filesystem::file_time_type modified;
+		uintmax_t size = 0;
+		std::string aes_key;
+
+		/// <summary>
+		/// Returns the key of a file's current state, encrypted with the specified key.
+		/// </summary>
+		static Key of(const std::filesystem::path& path, const std::string& aes_key);
+
+		bool operator==(const Key& other) const;
+	};
+
+	/// <summary>
+	/// A single cached cipher text.
+	/// </summary>
+	class Entry {
+		Key _key;
+		std::string _initial_counter;
+		bool _complete = false;
+		std::vector<unsigned char> _memory;
+		std::unique_ptr<TempFile> _file;
+		friend class CiphertextCache;
+	public:
+		/// <summary>
+		/// Creates an empty entry, stored by the expected size of the cipher text.
+		/// </summary>
+		/// <param name="initial_counter">The AES-CTR initial counter block the cipher text is encrypted with, or empty for AES-CBC.</param>
+		/// <param name="memory_threshold">Cipher texts up to this size are kept in memory, larger ones in a temp file.</param>
+		Entry(const Key& key, uint64_t expected_size, const std::string& initial_counter = "", size_t memory_threshold = MEMORY_THRESHOLD);
+
+		/// <summary>
+		/// Returns the AES-CTR initial counter block of the cipher text, or empty for AES-CBC.
+		/// </summary>
+		const std::string& initial_counter() const;
+
+		/// <summary>
+		/// Appends the next part of the cipher text.
+		/// </summary>
+		void append(const unsigned char* data, size_t size);
+
+		/// <summary>
+		/// Marks the cipher text as fully recorded - only complete entries are returned from the cache.
+		/// </summary>
+		void complete();
+
+		/// <summary>
+		/// Returns the size of the recorded cipher text.
+		/// </summary>
+		uint64_t size() const;
+
+		/// <summary>
+		/// Sends the recorded cipher text through the socket.
+		/// </summary>
+		/// <param name="prefix">Data to send right before the cipher text, in the same write as it's first part.</param>
+		boost::asio::awaitable<void> async_send(boost::asio::ip::tcp::socket& socket, boost::asio::const_buffer prefix = {});
+	};
+
+	/// <summary>
+	/// Returns the complete cipher text stored for the key, or null if there is none.
+	/// </summary>
+	std::shared_ptr<Entry> find(const Key& key);
+
+	/// <summary>
+	/// Starts recording a new cipher text for the key, replacing the currently cached one.
+	/// </summary>
+	/// <param name="initial_counter">The AES-CTR initial counter block the cipher text is encrypted with, or empty for AES-CBC.</param>
+	std::shared_ptr<Entry> record(const Key& key, uint64_t expected_size, const std::string& initial_counter = "");
+
+	/// <summary>
+	/// Drops the cached cipher text.
+	/// </summary>
+	void clear();
+
+	/// <summary>
+	/// Sets the size of the largest cipher text kept in memory - larger ones are recorded to a temp file.
+	/// Bounds the memory of processes that keep many caches, one per connection.
+	/// </summary>
+	void set_memory_threshold(size_t memory_threshold);
+
+private:
+	std::shared_ptr<Entry> _entry;
+	size_t _memory_threshold = MEMORY_THRESHOLD;
+};
+
@@ -1,22 +1,54 @@
 #include <fstream>
+#include <future>
+#include <vector>
 #include "Client.h"
 #include "protocol.h"
 #include <iostream>
 #include "util/CRC.h"
 #include "util/SocketHelper.h"
+#include "util/FileSource.h"
+#include "util/ChunkCompressor.h"
+#include "util/Metrics.h"
+#include "util/Trace.h"
+#include "util/Connector.h"
+#include "util/DnsCache.h"
 
 const std::string Client::INFO_FILE_NAME = "me.info";
 
 
 Client::Client(const std::string& host, int port) :
+	owned_io_ctx(std::make_unique<boost::asio::io_context>()),
+	client_io_ctx(*owned_io_ctx),
 	srv_resolver(client_io_ctx),
 	socket(client_io_ctx),
+	socket_tuner(socket),
 	info_file() {
 
-	// connect socket
-	auto endpoint = srv_resolver.resolve(host, std::to_string(port));
-	boost::asio::connect(socket, endpoint);
+	run_sync(async_connect(host, port));
+	load_info();
+}
+
+Client::Client(boost::asio::io_context& io_ctx) :
+	client_io_ctx(io_ctx),
+	srv_resolver(client_io_ctx),
+	socket(client_io_ctx),
+	socket_tuner(socket),
+	info_file() {
+
+	load_info();
+}
+
+Client::Client(boost::asio::io_context& io_ctx, MeInfo info) :
+	client_io_ctx(io_ctx),
+	srv_resolver(client_io_ctx),
+	socket(client_io_ctx),
+	socket_tuner(socket),
+	info_file(std::move(info)) {
+
+	load_info();
+}
 
+void Client::load_info() {
 	// load data from file, including rsa private key
 	if (info_file.is_loaded()) {
 		this->_registered = true;
@@ -24,6 +56,69 @@ Client::Client(const std::string& host, int port) :
 	}
 }
 
+template <class T>
+T Client::run_sync(awaitable<T> operation) {
+	// restarting & running a shared io_context would run (and return with) the operations of it's other users.
+	if (!owned_io_ctx) {
+		throw std::logic_error("Blocking operations need a client that owns it's io_context - use the async_* ones!");
+	}
+
+	auto result = boost::asio::co_spawn(client_io_ctx, std::move(operation), boost::asio::use_future);
+
+	client_io_ctx.restart();
+	client_io_ctx.run();
+
+	// re-throws the operation's exception, if any.
+	return result.get();
+}
+
+awaitable<void> Client::async_connect(std::string host, int port) {
+	// connect socket - an address needs no resolving, and a name is resolved only when it's not in the cache.
+	std::vector<tcp::endpoint> endpoints;
+	bool cached = false;
+	boost::system::error_code not_address;
+	auto address = boost::asio::ip::make_address(host, not_address);
+	if (!not_address) {
+		endpoints.emplace_back(address, static_cast<unsigned short>(port));
+	}
+	else if (DnsCache::lookup(host, port, endpoints)) {
+		cached = true;
+	}
+	else {
+		endpoints = co_await async_resolve(host, port);
+	}
+
+	auto error = co_await async_connect_endpoints(endpoints);
+	if (error && cached) {
+		// the host may have moved since it was cached.
+		DnsCache::forget(host, port);
+		endpoints = co_await async_resolve(host, port);
+		error = co_await async_connect_endpoints(endpoints);
+	}
+	if (error) {
+		throw boost::system::system_error(error, "Failed to connect to " + host + ":" + std::to_string(port));
+	}
+	SocketHelper::set_no_delay(socket);
+}
+
+awaitable<std::vector<tcp::endpoint>> Client::async_resolve(const std::string& host, int port) {
+	Metrics::Timer timer(Metrics::PhaseResolve);
+	TRACE_SCOPE("resolve");
+	auto results = co_await srv_resolver.async_resolve(host, std::to_string(port), boost::asio::use_awaitable);
+	std::vector<tcp::endpoint> endpoints;
+	for (const auto& result : results) {
+		endpoints.push_back(result.endpoint());
+	}
+	DnsCache::store(host, port, endpoints);
+	co_return endpoints;
+}
+
+awaitable<boost::system::error_code> Client::async_connect_endpoints(std::vector<tcp::endpoint> endpoints) {
+	Metrics::Timer timer(Metrics::PhaseConnect);
+	TRACE_SCOPE("connect");
+	co_return co_await Connector::async_connect(socket, std::move(endpoints));
+}
+
 template <class T>
 inline T Client::get_request(ClientRequestsCode code)
 {
@@ -38,42 +133,114 @@ inline T Client::get_request(ClientRequestsCode code)
 	return to_prepare;
 }
 
-inline ServerResponseHeader Client::get_header(ServerResponseCode code) {
+awaitable<ServerResponseHeader> Client::async_read_header() {
+	// the wait covers the server's work on the request, as well as the round trip.
+	Metrics::Timer timer(Metrics::PhaseWaitResponse);
+	TRACE_SCOPE("wait_response");
 	ServerResponseHeader header;
-	SocketHelper::recieve_static(&header, this->socket);
+	co_await SocketHelper::async_recieve_static(&header, this->socket);
+	server_version = header.version;
+	co_return header;
+}
+
+awaitable<void> Client::async_defer_response(ServerResponseCode code, std::string description, std::filesystem::path file_path) {
+	pending_responses.push_back({ code, description, file_path });
+	co_await async_read_pending_responses(pipelined ? 1 : 0);
+}
+
+awaitable<void> Client::async_read_pending_responses(size_t keep) {
+	while (pending_responses.size() > keep) {
+		auto pending = pending_responses.front();
+		pending_responses.pop_front();
+
+		std::string error;
+		bool connection_failed = false;
+		try {
+			auto header = co_await async_read_header();
+			if (header.code != pending.code) {
+				error = "Unexpected response code from server to " + pending.description + ": " + std::to_string(header.code);
+			}
+			if (header.payload_size > 0) {
+				std::vector<char> payload(header.payload_size);
+				co_await SocketHelper::async_recieve_dynamic(payload.data(), socket, payload.size());
+			}
+		}
+		catch (const std::exception& ex) {
+			error = ex.what();
+			connection_failed = true;
+		}
+
+		if (error.empty()) {
+			continue;
+		}
+		if (pending.file_path.empty()) {
+			throw std::runtime_error(error);
+		}
+		failed_acknowledgements.push_back({ pending.file_path, error });
+		if (connection_failed) {
+			// the responses after it will never arrive - their files are not acknowledged either.
+			for (const auto& rest : pending_responses) {
+				if (!rest.file_path.empty()) {
+					failed_acknowledgements.push_back({ rest.file_path, error });
+				}
+			}
+			pending_responses.clear();
+			throw std::runtime_error(error);
+		}
+	}
+}
+
+awaitable<ServerResponseHeader> Client::async_get_any_header() {
+	co_await async_read_pending_responses(0);
+	co_return co_await async_read_header();
+}
+
+awaitable<ServerResponseHeader> Client::async_get_header(ServerResponseCode code) {
+	auto header = co_await async_get_any_header();
 
 	// using function may catch if needs to be done.
 	if (header.code != code) {
 		throw std::runtime_error("Unexpected response code from server: " + std::to_string(code));
 	}
 
-	return header;
+	co_return header;
 }
 
 bool Client::register_user(std::string user_name) {
+	return run_sync(async_register_user(user_name));
+}
+
+awaitable<bool> Client::async_register_user(std::string user_name) {
 	// make sure data is OK
 	if (_registered)
 		throw std::runtime_error("User already registered!");
 
+	Metrics::Timer timer(Metrics::PhaseRegister);
+	TRACE_SCOPE("register");
+
 	if (user_name.length() > MAX_USER_NAME_LENGTH - 1)
 		throw std::invalid_argument("Specified user name cannot be longer than " + std::to_string(MAX_USER_NAME_LENGTH - 1) + " chars!");
 
 	// Build & Send request
 	auto request = get_request<RegisterRequestType>(ClientRequestsCode::RequestCodeRegister);
 	strcpy_s(request.user_name, sizeof(request.user_name), user_name.c_str());
-	SocketHelper::send_static(&request, this->socket);
+	co_await SocketHelper::async_send_static(&request, this->socket);
 
 	// Fetch response
+	bool registration_failed = false;
 	try {
-		auto header = get_header(ServerResponseCode::ResponseCodeRegisterSuccess);
+		auto header = co_await async_get_header(ServerResponseCode::ResponseCodeRegisterSuccess);
 	}
 	catch (const std::runtime_error&) {
-		// failed to register!
-		return false;
+		registration_failed = true;
 	}
 
+	// failed to register!
+	if (registration_failed)
+		co_return false;
+
 	RegisterSuccess payload;
-	SocketHelper::recieve_static(&payload, this->socket);
+	co_await SocketHelper::async_recieve_static(&payload, this->socket);
 
 	// Temporarily save assigned user id
 	memcpy_s(info_file.header_user_id, sizeof(info_file.header_user_id), payload.client_id, sizeof(payload.client_id));
@@ -87,63 +254,427 @@ bool Client::register_user(std::string user_name) {
 	info_file.save();
 
 	_registered = true;
-	return true;
+	co_return true;
 }
 
 void Client::exchange_keys()
+{
+	run_sync(async_exchange_keys());
+}
+
+awaitable<void> Client::async_exchange_keys()
 {
 	if (!_registered) {
 		throw std::runtime_error("Client must be registered to exchange keys!");
 	}
+	Metrics::Timer timer(Metrics::PhaseKeyExchange);
+	TRACE_SCOPE("exchange_keys");
+
+	// skip the RSA round trip when a previous session can be resumed. The ticket file is shared by the process,
+	// so in-memory users don't use it.
+	if (info_file.is_persistent() && _resumes_session && co_await async_resume_session()) {
+		co_return;
+	}
 
 	// send public key
 	auto request = get_request<KeyExchangeRequestType>(ClientRequestsCode::RequestCodeKeyExchange);
 	auto pubkey = rsa.get_public_key();
 	memcpy_s(request.public_key, sizeof(request.public_key), pubkey.c_str(), pubkey.length());
 	strcpy_s(request.user_name, sizeof(request.user_name), info_file.user_name.c_str());
-	SocketHelper::send_static(&request, socket);
+	co_await SocketHelper::async_send_static(&request, socket);
 
-	auto header = get_header(ServerResponseCode::ResponseCodeExchangeAes);
+	auto header = co_await async_get_header(ServerResponseCode::ResponseCodeExchangeAes);
 
 	KeyExchangeSuccess payload;
-	SocketHelper::recieve_static(&payload, this->socket);
+	co_await SocketHelper::async_recieve_static(&payload, this->socket);
 
 	// get variable size from socket by specified payload
 	auto key_exp_size = header.payload_size - sizeof(KeyExchangeSuccess);
-	auto key_dest = new char[key_exp_size];
-	SocketHelper::recieve_dynamic(key_dest, socket, key_exp_size);
+	std::vector<char> key_dest(key_exp_size);
+	co_await SocketHelper::async_recieve_dynamic(key_dest.data(), socket, key_exp_size);
 
 	// decrypt fetched AES key using private RSA key
-	std::string aes_key = rsa.decrypt(std::string(key_dest, key_exp_size));
+	std::string aes_key = rsa.decrypt(std::string(key_dest.data(), key_exp_size));
 	this->aes_key = aes_key;
+
+	if (server_version >= MIN_VERSION_SESSION_TICKETS && info_file.is_persistent() && _stores_ticket) {
+		co_await async_request_ticket();
+	}
+}
+
+awaitable<bool> Client::async_resume_session()
+{
+	SessionTicket ticket;
+	if (!ticket.load() || !ticket.is_valid_for(info_file.header_user_id)) {
+		co_return false;
+	}
+
+	auto request = get_request<ResumeSessionRequest>(ClientRequestsCode::RequestCodeResumeSession);
+	memcpy_s(request.client_id, sizeof(request.client_id), info_file.header_user_id, sizeof(info_file.header_user_id));
+	memcpy_s(request.ticket_id, sizeof(request.ticket_id), ticket.ticket_id, sizeof(ticket.ticket_id));
+	co_await SocketHelper::async_send_static(&request, socket);
+
+	// either resumed or rejected - both are valid responses.
+	auto header = co_await async_get_any_header();
+
+	if (header.code == ServerResponseCode::ResponseCodeResumeRejected) {
+		// expired or unknown to the server - fall back to a full key exchange.
+		SessionTicket::remove();
+		co_return false;
+	}
+	if (header.code != ServerResponseCode::ResponseCodeSessionResumed) {
+		throw std::runtime_error("Unexpected response code from server: " + std::to_string(header.code));
+	}
+
+	SessionResumed payload;
+	co_await SocketHelper::async_recieve_static(&payload, this->socket);
+
+	this->aes_key = ticket.aes_key;
+	co_return true;
+}
+
+awaitable<void> Client::async_request_ticket()
+{
+	auto request = get_request<IssueTicketRequest>(ClientRequestsCode::RequestCodeIssueTicket);
+	memcpy_s(request.client_id, sizeof(request.client_id), info_file.header_user_id, sizeof(info_file.header_user_id));
+	co_await SocketHelper::async_send_static(&request, socket);
+
+	co_await async_get_header(ServerResponseCode::ResponseCodeTicketIssued);
+	TicketIssued payload;
+	co_await SocketHelper::async_recieve_static(&payload, this->socket);
+
+	SessionTicket ticket;
+	memcpy_s(ticket.ticket_id, sizeof(ticket.ticket_id), payload.ticket_id, sizeof(payload.ticket_id));
+	memcpy_s(ticket.user_id, sizeof(ticket.user_id), info_file.header_user_id, sizeof(info_file.header_user_id));
+	ticket.aes_key = this->aes_key;
+	ticket.expiry = std::time(nullptr) + payload.lifetime_seconds;
+	ticket.save();
 }
 
-unsigned int Client::request_file_upload(std::filesystem::path file_path) {
+awaitable<unsigned int> Client::async_request_file_upload(std::filesystem::path file_path, CRC* plain_crc) {
 	if (!_registered) {
 		throw std::runtime_error("User must be registered & have keys to begin file upload!");
 	}
 
-	EncryptedFileSender file_sender(file_path, aes_key);
+	auto cache_key = CiphertextCache::Key::of(file_path, aes_key);
+	auto cached = cipher_cache.find(cache_key);
+
+	// servers that support it get the file encrypted with AES-CTR, in parallel. A retry is encrypted like the cached cipher text.
+	std::string initial_counter;
+	if (cached) {
+		initial_counter = cached->initial_counter();
+	}
+	else if (server_version >= MIN_VERSION_PARALLEL_ENCRYPTION) {
+		initial_counter = EncryptedFileSender::generate_initial_counter();
+	}
+	EncryptedFileSender file_sender(file_path, aes_key, initial_counter);
+
 	// send the file
 	auto file_name = file_path.filename().string();
-	auto request = get_request<SendFileRequestType>(ClientRequestsCode::RequestCodeUploadFile);
-	strcpy_s(request.file_name, sizeof(request.file_name), file_name.c_str());
-	memcpy_s(request.client_id, sizeof(request.header_user_id), info_file.header_user_id, sizeof(info_file.header_user_id));
-	request.content_size = file_sender.encrypted_size();
+	auto content_size = cached ? cached->size() : file_sender.encrypted_size();
+	auto request = get_request<SendFileCtrRequestType>(file_sender.is_parallel() ?
+		ClientRequestsCode::RequestCodeUploadFileCtr : ClientRequestsCode::RequestCodeUploadFile);
+	std::vector<unsigned char> message;
+	auto request_buffer = SocketHelper::static_buffer(&request);
+	if (server_version >= MIN_VERSION_LARGE_FILES) {
+		UploadFileMessage upload{};
+		upload.content_size = content_size;
+		upload.file_name = file_name;
+		std::copy(initial_counter.begin(), initial_counter.end(), upload.initial_counter.begin());
+		message = encode_message(ClientRequestsCode::RequestCodeUploadFileCtr, upload);
+		request_buffer = boost::asio::buffer(message);
+	}
+	else {
+		if (content_size > MAX_FIXED_UPLOAD_SIZE) {
+			throw std::invalid_argument("File is too large for the server's protocol version: " + file_path.string());
+		}
+		strcpy_s(request.file_name, sizeof(request.file_name), file_name.c_str());
+		memcpy_s(request.client_id, sizeof(request.header_user_id), info_file.header_user_id, sizeof(info_file.header_user_id));
+		request.content_size = static_cast<unsigned int>(content_size);
+		memcpy_s(request.initial_counter, sizeof(request.initial_counter), initial_counter.data(), initial_counter.length());
+
+		if (!file_sender.is_parallel()) {
+			// the CBC request has no counter block.
+			request.payload_size = sizeof(SendFileRequestType) - sizeof(ClientRequestBase);
+			request_buffer = SocketHelper::static_buffer(static_cast<const SendFileRequestType*>(&request));
+		}
+	}
+
+	{
+		// the request goes out in the same write as the first file chunk, and the last partial segment is
+		// flushed only once the whole file was written.
+		SocketHelper::Cork cork(socket);
+		if (cached && plain_crc == nullptr) {
+			co_await cached->async_send(socket, request_buffer);
+		}
+		else if (content_size >= MIN_STREAMED_FILE_SIZE) {
+			// a streamed file's retry encrypts it again - keeping it's cipher text would take as much disk as the file.
+			co_await file_sender.async_send(socket, plain_crc, nullptr, request_buffer);
+		}
+		else {
+			auto recording = cipher_cache.record(cache_key, content_size, initial_counter);
+			co_await file_sender.async_send(socket, plain_crc, recording.get(), request_buffer);
+			recording->complete();
+		}
+	}
+	content_bytes_sent += content_size;
+
+	// fetch response & return sever CRC
+	auto header = co_await async_get_header(ServerResponseCode::ResponseCodeFileUploaded);
+	co_return co_await async_get_upload_checksum(header);
+}
+
+awaitable<std::vector<unsigned char>> Client::async_get_upload_status(const BeginChunkedUploadRequest& request) {
+	co_await SocketHelper::async_send_static(&request, socket);
+
+	auto header = co_await async_get_header(ServerResponseCode::ResponseCodeUploadStatus);
+	UploadStatus payload;
+	co_await SocketHelper::async_recieve_static(&payload, this->socket);
+
+	std::vector<unsigned char> held(header.payload_size - sizeof(UploadStatus));
+	co_await SocketHelper::async_recieve_dynamic(held.data(), socket, held.size());
+	co_return held;
+}
+
+awaitable<unsigned int> Client::async_request_chunked_upload(std::filesystem::path file_path, CRC* plain_crc) {
+	if (!_registered) {
+		throw std::runtime_error("User must be registered & have keys to begin file upload!");
+	}
+
+	// chunks are compressed (when worth it) for servers that can decompress them.
+	bool compress = server_version >= MIN_VERSION_COMPRESSION;
+	ChunkedUpload upload(file_path, aes_key, info_file.header_user_id, compress);
+
+	auto file_name = file_path.filename().string();
+	auto begin_request = get_request<BeginChunkedUploadRequest>(ClientRequestsCode::RequestCodeBeginChunkedUpload);
+	memcpy_s(begin_request.client_id, sizeof(begin_request.client_id), info_file.header_user_id, sizeof(info_file.header_user_id));
+	memcpy_s(begin_request.upload_id, sizeof(begin_request.upload_id), upload.upload_id(), UPLOAD_ID_SIZE_BYTES);
+	begin_request.file_size = upload.file_size();
+	begin_request.chunk_size = ChunkedUpload::CHUNK_SIZE;
+	strcpy_s(begin_request.file_name, sizeof(begin_request.file_name), file_name.c_str());
+
+	auto chunk_request = get_request<UploadCompressedChunkRequest>(compress ?
+		ClientRequestsCode::RequestCodeUploadCompressedChunk : ClientRequestsCode::RequestCodeUploadChunk);
+	if (!compress) {
+		// only the UploadChunkRequest part is sent.
+		chunk_request.payload_size = sizeof(UploadChunkRequest) - sizeof(ClientRequestBase);
+	}
+	memcpy_s(chunk_request.client_id, sizeof(chunk_request.client_id), info_file.header_user_id, sizeof(info_file.header_user_id));
+	memcpy_s(chunk_request.upload_id, sizeof(chunk_request.upload_id), upload.upload_id(), UPLOAD_ID_SIZE_BYTES);
+
+	// the server reports the chunks it already holds, from this upload or from an interrupted one.
+	auto held = co_await async_get_upload_status(begin_request);
+
+	// chunks that failed their checksum are reported missing again, and resent on the next round.
+	int rounds_left = SEND_CHUNKS_ROUND_COUNT;
+	while (!upload.is_complete(held) || plain_crc != nullptr) {
+		if (rounds_left-- == 0) {
+			throw std::runtime_error("Failed to upload all chunks of file: " + file_path.string());
+		}
+
+		// the first round reads the whole file for the CRC, even if no chunk is missing.
+		auto sent = co_await upload.async_send_missing(socket, chunk_request, held, plain_crc, &content_bytes_sent);
+		plain_crc = nullptr;
+		if (sent > 0) {
+			held = co_await async_get_upload_status(begin_request);
+		}
+	}
+
+	auto finish_request = get_request<FinishChunkedUploadRequest>(ClientRequestsCode::RequestCodeFinishChunkedUpload);
+	memcpy_s(finish_request.client_id, sizeof(finish_request.client_id), info_file.header_user_id, sizeof(info_file.header_user_id));
+	memcpy_s(finish_request.upload_id, sizeof(finish_request.upload_id), upload.upload_id(), UPLOAD_ID_SIZE_BYTES);
+	co_await SocketHelper::async_send_static(&finish_request, socket);
+
+	auto header = co_await async_get_header(ServerResponseCode::ResponseCodeFileUploaded);
+	co_return co_await async_get_upload_checksum(header);
+}
+
+awaitable<std::vector<unsigned char>> Client::async_get_chunks_held(const ServerResponseHeader& header) {
+	if (is_compact()) {
+		auto payload = co_await async_receive_message<ChunksHeldMessage>(header);
+		co_return payload.held;
+	}
+
+	ChunksHeld payload;
+	co_await SocketHelper::async_recieve_static(&payload, this->socket);
+
+	std::vector<unsigned char> held(header.payload_size - sizeof(ChunksHeld));
+	co_await SocketHelper::async_recieve_dynamic(held.data(), socket, held.size());
+	co_return held;
+}
+
+awaitable<void> Client::async_send_store_chunk(StoreChunkMessage chunk, boost::asio::const_buffer content) {
+	content_bytes_sent += content.size();
+	if (is_compact()) {
+		co_await async_send_message(ClientRequestsCode::RequestCodeStoreChunk, chunk, content);
+		co_return;
+	}
+
+	auto request = get_request<StoreChunkRequest>(ClientRequestsCode::RequestCodeStoreChunk);
+	memcpy_s(request.client_id, sizeof(request.client_id), info_file.header_user_id, sizeof(info_file.header_user_id));
+	memcpy_s(request.chunk_hash, sizeof(request.chunk_hash), chunk.chunk_hash.data(), chunk.chunk_hash.size());
+	request.offset = chunk.offset;
+	memcpy_s(request.initial_counter, sizeof(request.initial_counter), chunk.initial_counter.data(), chunk.initial_counter.size());
+	request.compression = chunk.compression;
+	request.plain_size = chunk.plain_size;
+	request.content_size = chunk.content_size;
+	co_await SocketHelper::async_send_gather(SocketHelper::static_buffer(&request), content, socket);
+}
+
+awaitable<unsigned int> Client::async_request_dedup_upload(std::filesystem::path file_path, CRC* plain_crc) {
+	if (!_registered) {
+		throw std::runtime_error("User must be registered & have keys to begin file upload!");
+	}
+
+	DedupUpload upload(file_path, aes_key, server_version >= MIN_VERSION_COMPRESSION);
+	upload.scan(plain_crc);
+	auto hashes = upload.hash_list();
+	auto chunk_count = static_cast<unsigned int>(upload.chunks().size());
+	auto file_name = file_path.filename().string();
+
+	// the server reports which of the chunks it already holds, from any file of the user.
+	if (is_compact()) {
+		QueryChunksMessage query{ chunk_count };
+		co_await async_send_message(ClientRequestsCode::RequestCodeQueryChunks, query, boost::asio::buffer(hashes));
+	}
+	else {
+		auto query_request = get_request<QueryChunksRequest>(ClientRequestsCode::RequestCodeQueryChunks);
+		memcpy_s(query_request.client_id, sizeof(query_request.client_id), info_file.header_user_id, sizeof(info_file.header_user_id));
+		query_request.chunk_count = chunk_count;
+		co_await SocketHelper::async_send_gather(SocketHelper::static_buffer(&query_request), boost::asio::buffer(hashes), socket);
+	}
+
+	auto header = co_await async_get_header(ServerResponseCode::ResponseCodeChunksHeld);
+	auto held = co_await async_get_chunks_held(header);
+
+	auto assemble_request = get_request<AssembleFileRequest>(ClientRequestsCode::RequestCodeAssembleFile);
+	memcpy_s(assemble_request.client_id, sizeof(assemble_request.client_id), info_file.header_user_id, sizeof(info_file.header_user_id));
+	assemble_request.file_size = upload.file_size();
+	assemble_request.chunk_count = chunk_count;
+	strcpy_s(assemble_request.file_name, sizeof(assemble_request.file_name), file_name.c_str());
+	AssembleFileMessage assemble_message{ upload.file_size(), chunk_count, file_name };
+
+	// chunks that failed their hash are reported missing by the assemble request, and resent on the next round.
+	int rounds_left = SEND_CHUNKS_ROUND_COUNT;
+	while (true) {
+		if (!upload.is_complete(held)) {
+			if (rounds_left-- == 0) {
+				throw std::runtime_error("Failed to upload all chunks of file: " + file_path.string());
+			}
+			co_await upload.async_send_missing(held, [this](StoreChunkMessage chunk, boost::asio::const_buffer content) {
+				return async_send_store_chunk(chunk, content);
+			});
+		}
+		if (is_compact()) {
+			co_await async_send_message(ClientRequestsCode::RequestCodeAssembleFile, assemble_message, boost::asio::buffer(hashes));
+		}
+		else {
+			co_await SocketHelper::async_send_gather(SocketHelper::static_buffer(&assemble_request), boost::asio::buffer(hashes), socket);
+		}
+
+		// either assembled or missing chunks - both are valid responses.
+		header = co_await async_get_any_header();
+		if (header.code == ServerResponseCode::ResponseCodeFileUploaded) {
+			break;
+		}
+		if (header.code != ServerResponseCode::ResponseCodeChunksHeld) {
+			throw std::runtime_error("Unexpected response code from server: " + std::to_string(header.code));
+		}
+
+		held = co_await async_get_chunks_held(header);
+		if (upload.is_complete(held)) {
+			throw std::runtime_error("Server failed to assemble file: " + file_path.string());
+		}
+	}
+
+	co_return co_await async_get_upload_checksum(header);
+}
 
-	SocketHelper::send_static(&request, socket);
-	file_sender.send(socket);
+awaitable<unsigned int> Client::async_request_small_file_upload(std::filesystem::path file_path, CRC* plain_crc) {
+	if (!_registered) {
+		throw std::runtime_error("User must be registered & have keys to begin file upload!");
+	}
+
+	FileSource source(file_path);
+	if (source.size() > MAX_SMALL_FILE_SIZE) {
+		throw std::invalid_argument("File is too large for a small file upload: " + file_path.string());
+	}
+	const unsigned char* plain = nullptr;
+	auto plain_size = source.next(plain, MAX_SMALL_FILE_SIZE);
+	if (plain_crc != nullptr) {
+		plain_crc->update(reinterpret_cast<const char*>(plain), plain_size);
+	}
+
+	// the whole file is a single chunk - compressed (when worth it) & encrypted like the chunks of larger files.
+	std::vector<unsigned char> compressed;
+	auto compression = ChunkCompressor::compress(plain, plain_size, compressed);
+	if (compression != ChunkCompressor::MethodNone) {
+		plain = compressed.data();
+	}
+	auto content_size = compression != ChunkCompressor::MethodNone ? compressed.size() : plain_size;
+
+	auto initial_counter = EncryptedFileSender::generate_initial_counter();
+	std::vector<unsigned char> cipher(content_size);
+	EncryptedFileSender::encrypt_ctr_at(aes_key, initial_counter, 0, plain, cipher.data(), content_size);
+
+	UploadSmallFileMessage message{};
+	message.plain_size = static_cast<uint32_t>(plain_size);
+	message.compression = compression;
+	std::copy(initial_counter.begin(), initial_counter.end(), message.initial_counter.begin());
+	message.content_size = static_cast<uint32_t>(content_size);
+	message.file_name = file_path.filename().string();
+	co_await async_send_message(ClientRequestsCode::RequestCodeUploadSmallFile, message, boost::asio::buffer(cipher));
+	content_bytes_sent += content_size;
+
+	auto header = co_await async_get_header(ServerResponseCode::ResponseCodeFileUploaded);
+	co_return co_await async_get_upload_checksum(header);
+}
+
+awaitable<unsigned int> Client::async_get_upload_checksum(const ServerResponseHeader& header) {
+	if (is_compact()) {
+		auto payload = co_await async_receive_message<FileUploadedMessage>(header);
+		co_return payload.checksum;
+	}
 
-	// fetch response
-	auto header = get_header(ServerResponseCode::ResponseCodeFileUploaded);
 	FileUploadSuccess payload;
-	SocketHelper::recieve_static(&payload, this->socket);
+	co_await SocketHelper::async_recieve_static(&payload, this->socket);
+	co_return payload.checksum;
+}
+
+bool Client::is_compact() const {
+	return server_version >= MIN_VERSION_COMPACT_FRAMING;
+}
+
+template <class T>
+std::vector<unsigned char> Client::encode_message(ClientRequestsCode code, const T& message) {
+	// the header is a fixed struct, so servers of any version can read it - the message is encoded right after it.
+	auto header = get_request<ClientRequestBase>(code);
+	std::vector<unsigned char> request(sizeof(header));
+	WireFormat::encode(message, request);
+	header.payload_size = static_cast<unsigned int>(request.size() - sizeof(header));
+	memcpy_s(request.data(), request.size(), &header, sizeof(header));
+	return request;
+}
 
-	// return sever CRC
-	return payload.checksum;
+template <class T>
+awaitable<void> Client::async_send_message(ClientRequestsCode code, const T& message, boost::asio::const_buffer content) {
+	auto request = encode_message(code, message);
+	co_await SocketHelper::async_send_gather(boost::asio::buffer(request), content, socket);
+}
+
+template <class T>
+awaitable<T> Client::async_receive_message(const ServerResponseHeader& header) {
+	std::vector<unsigned char> payload(header.payload_size);
+	co_await SocketHelper::async_recieve_dynamic(payload.data(), socket, payload.size());
+	co_return WireFormat::decode<T>(payload.data(), payload.size());
+}
+
+bool Client::send_file(std::filesystem::path file_path, uint32_t* verified_crc)
+{
+	return run_sync(async_send_file(file_path, verified_crc));
 }
 
-bool Client::send_file(std::filesystem::path file_path)
+awaitable<bool> Client::async_send_file(std::filesystem::path file_path, uint32_t* verified_crc)
 {
 	if (!std::filesystem::is_regular_file(file_path)) {
 		throw std::runtime_error("File doesn't exist: " + file_path.string());
@@ -156,16 +687,44 @@ bool Client::send_file(std::filesystem::path file_path)
 		throw std::invalid_argument("Name of file cannot be longer than " + std::to_string(MAX_FILENAME_SIZE - 1) + " chars!");
 	}
 
-	auto file_crc = CRC().calculate(file_path.string());
+	auto file_size = std::filesystem::file_size(file_path);
+	Metrics::Timer timer(Metrics::PhaseUploadFile, file_size);
+	TRACE_SCOPE_BYTES("send_file", file_size);
+
+	// the local CRC is calculated on the first upload, while the file is being sent.
+	CRC local_crc;
+	uint32_t file_crc = 0;
+
+	// the socket is tuned by the bytes actually sent, which held chunks & compression make fewer than the file's.
+	auto bytes_sent_before = content_bytes_sent;
 
 	// recovery process variables
 	int tries_left = SEND_FILE_RETRY_COUNT + 1;
 	auto upload_verified = false;
 
 	while (tries_left > 0 && !upload_verified) {
+		auto first_try = tries_left == SEND_FILE_RETRY_COUNT + 1;
 		tries_left--;
 
-		auto server_checksum = request_file_upload(file_path);
+		unsigned int server_checksum;
+		if (is_compact() && file_size <= MAX_SMALL_FILE_SIZE) {
+			server_checksum = co_await async_request_small_file_upload(file_path, first_try ? &local_crc : nullptr);
+		}
+		else if (server_version >= MIN_VERSION_LARGE_FILES && file_size >= MIN_STREAMED_FILE_SIZE) {
+			server_checksum = co_await async_request_file_upload(file_path, first_try ? &local_crc : nullptr);
+		}
+		else if (server_version >= MIN_VERSION_DEDUPLICATION) {
+			server_checksum = co_await async_request_dedup_upload(file_path, first_try ? &local_crc : nullptr);
+		}
+		else if (server_version >= MIN_VERSION_RESUMABLE_UPLOADS) {
+			server_checksum = co_await async_request_chunked_upload(file_path, first_try ? &local_crc : nullptr);
+		}
+		else {
+			server_checksum = co_await async_request_file_upload(file_path, first_try ? &local_crc : nullptr);
+		}
+		if (first_try) {
+			file_crc = local_crc.digest();
+		}
 
 		// validate checksum - and choose status to return for server.
 		ClientRequestsCode status_code = ClientRequestsCode::RequestCodeInvalidChecksumAbort;
@@ -178,16 +737,64 @@ bool Client::send_file(std::filesystem::path file_path)
 		}
 
 		// Update server with the checksum validation result
-		auto crequest = get_request<ChecksumStatusRequest>(status_code);
-		strcpy_s(crequest.file_name, sizeof(crequest.file_name), file_name.c_str());
-		memcpy_s(crequest.client_id, sizeof(crequest.client_id), info_file.header_user_id, sizeof(info_file.header_user_id));
-		SocketHelper::send_static(&crequest, socket);
+		if (is_compact()) {
+			ChecksumStatusMessage status{ file_name };
+			co_await async_send_message(status_code, status);
+		}
+		else {
+			auto crequest = get_request<ChecksumStatusRequest>(status_code);
+			strcpy_s(crequest.file_name, sizeof(crequest.file_name), file_name.c_str());
+			memcpy_s(crequest.client_id, sizeof(crequest.client_id), info_file.header_user_id, sizeof(info_file.header_user_id));
+			co_await SocketHelper::async_send_static(&crequest, socket);
+		}
+
+		// the server's OK is read before the next response, so the next upload (or retry) goes out right away.
+		co_await async_defer_response(ServerResponseCode::ResponseCodeMessageOk, "checksum status of " + file_name, file_path);
+	}
 
-		// wait for server OK response before continuing.
-		get_header(ServerResponseCode::ResponseCodeMessageOk);
+	// no more retries for this file.
+	cipher_cache.clear();
+	if (upload_verified) {
+		socket_tuner.tune(content_bytes_sent - bytes_sent_before);
+	}
+	if (upload_verified && verified_crc != nullptr) {
+		*verified_crc = file_crc;
 	}
+	co_return upload_verified;
+}
+
+const SocketTuner::Stats& Client::socket_stats() const {
+	return socket_tuner.stats();
+}
+
+void Client::set_stores_ticket(bool stores_ticket) {
+	_stores_ticket = stores_ticket;
+}
+
+void Client::set_resumes_session(bool resumes_session) {
+	_resumes_session = resumes_session;
+}
+
+void Client::set_pipelined(bool pipelined) {
+	this->pipelined = pipelined;
+}
+
+void Client::set_cipher_cache_memory(size_t max_size) {
+	cipher_cache.set_memory_threshold(max_size);
+}
+
+std::vector<Client::FailedAcknowledgement> Client::take_failed_acknowledgements() {
+	std::vector<FailedAcknowledgement> failed;
+	failed.swap(failed_acknowledgements);
+	return failed;
+}
+
+void Client::flush() {
+	run_sync(async_flush());
+}
 
-	return upload_verified;
+awaitable<void> Client::async_flush() {
+	co_await async_read_pending_responses(0);
 }
 
 bool Client::is_registered()
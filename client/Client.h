@@ -2,43 +2,143 @@
 
 
 #include <string>
+#include <memory>
+#include <deque>
+#include <vector>
 #include <filesystem>
 #include <boost/asio.hpp>
 #include "MeInfo.h"
 #include "protocol.h"
 #include "RSAManager.h"
 #include "EncryptedFileSender.h"
+#include "CiphertextCache.h"
+#include "SessionTicket.h"
+#include "ChunkedUpload.h"
+#include "DedupUpload.h"
+#include "util/CRC.h"
+#include "util/SocketTuner.h"
 
 using boost::asio::ip::tcp;
+using boost::asio::awaitable;
 
 /**
  * Implements a client for the encrypted file server protocol.
+ * The protocol flows are implemented as coroutines (async_* methods), so many clients may share a single io_context.
+ * The blocking methods are thin wrappers, that run the matching coroutine to completion on the client's io_context -
+ * only a client that owns it's io_context may use them.
  */
 class Client {
+public:
+	/// <summary>
+	/// A file whose upload was verified, but whose checksum status the server did not acknowledge.
+	/// </summary>
+	struct FailedAcknowledgement {
+		std::filesystem::path file_path;
+		std::string error;
+	};
+
 private:
 	/* Socket, Resolver, IO Context */
-	boost::asio::io_context client_io_ctx;
+	std::unique_ptr<boost::asio::io_context> owned_io_ctx;
+	boost::asio::io_context& client_io_ctx;
 	tcp::resolver srv_resolver;
 	tcp::socket socket;
 	/// <summary>
+	/// Sizes the socket's buffers by the path, as measured while files are uploaded.
+	/// </summary>
+	SocketTuner socket_tuner;
+	/// <summary>
 	/// Whether the current client's user is registered.
 	/// </summary>
 	bool _registered = false;
+	/// <summary>
+	/// The protocol version of the server, as sent in it's last response.
+	/// </summary>
+	unsigned char server_version = 0;
+
+	/// <summary>
+	/// A request that was sent, but whose response was not read yet.
+	/// </summary>
+	struct PendingResponse {
+		ServerResponseCode code;
+		/// <summary>
+		/// Describes the request in the error if the response is not the expected one.
+		/// </summary>
+		std::string description;
+		/// <summary>
+		/// The file the response acknowledges, if any - it's failure is reported against the file.
+		/// </summary>
+		std::filesystem::path file_path;
+	};
+	/// <summary>
+	/// The responses to read before the next one, in the order their requests were sent.
+	/// The server handles a connection's requests in order, so it's responses arrive in the same order.
+	/// </summary>
+	std::deque<PendingResponse> pending_responses;
+	/// <summary>
+	/// Whether a file's checksum status response is left pending, to be read before the next response.
+	/// </summary>
+	bool pipelined = true;
+	/// <summary>
+	/// The acknowledgements of files that failed since they were last taken.
+	/// </summary>
+	std::vector<FailedAcknowledgement> failed_acknowledgements;
+	/// <summary>
+	/// Bytes of file content sent on the connection - less than the files' sizes, when chunks are held or compressed.
+	/// </summary>
+	uint64_t content_bytes_sent = 0;
+	/// <summary>
+	/// Whether the client requests a session ticket after a key exchange, and stores it.
+	/// </summary>
+	bool _stores_ticket = true;
+	/// <summary>
+	/// Whether the client resumes the stored session ticket, rather than exchanging keys.
+	/// </summary>
+	bool _resumes_session = true;
 
 
 	RSAManager rsa;
 	std::string aes_key;
 	MeInfo info_file;
+	/// <summary>
+	/// Holds the cipher text of the file being uploaded, for retries.
+	/// </summary>
+	CiphertextCache cipher_cache;
 public:
 	static const std::string INFO_FILE_NAME;
 
 	/// <summary>
 	/// Starts a new client session to the secure file server.
+	/// The client owns it's io_context, and connects synchronously.
 	/// </summary>
 	/// <param name="host">The server's host name</param>
 	/// <param name="port">The server's port number.</param>
 	Client(const std::string& host, int port);
 
+	/// <summary>
+	/// Creates a new client on a shared io_context, without connecting it.
+	/// Use async_connect to start the session, and only the async_* methods afterwards.
+	/// </summary>
+	/// <param name="io_ctx">The io_context to run the client's operations on.</param>
+	Client(boost::asio::io_context& io_ctx);
+
+	/// <summary>
+	/// Creates a new client on a shared io_context, with the specified user data instead of the info file's.
+	/// A client with non persistent data also keeps it's session to itself - no session ticket is stored or resumed.
+	/// </summary>
+	/// <param name="io_ctx">The io_context to run the client's operations on.</param>
+	/// <param name="info">The user's data, e.g. an empty in-memory one for a user that is yet to register.</param>
+	Client(boost::asio::io_context& io_ctx, MeInfo info);
+
+	/// <summary>
+	/// Resolves & connects to the secure file server.
+	/// The host's addresses are taken from the DNS cache when they're there, and all of them are raced (see Connector).
+	/// Throws boost::system::system_error if none could be connected within the connect timeout.
+	/// </summary>
+	/// <param name="host">The server's host name</param>
+	/// <param name="port">The server's port number.</param>
+	awaitable<void> async_connect(std::string host, int port);
+
 	/// <summary>
 	/// Requests a registration from the server.
 	/// </summary>
@@ -46,18 +146,89 @@ public:
 	/// <returns>Whether registration succeeeded</returns>
 	bool register_user(std::string name);
 
+	/// <summary>
+	/// Requests a registration from the server, asynchronously.
+	/// </summary>
+	/// <param name="name">The user name to provide for the server</param>
+	/// <returns>Whether registration succeeeded</returns>
+	awaitable<bool> async_register_user(std::string name);
+
 
 	/// <summary>
 	/// Executes a key-exchange of the client with the server.
+	/// A stored session ticket is presented first, and the RSA key exchange runs only if it is missing or rejected.
 	/// </summary>
 	void exchange_keys();
 
+	/// <summary>
+	/// Executes a key-exchange of the client with the server, asynchronously.
+	/// A stored session ticket is presented first, and the RSA key exchange runs only if it is missing or rejected.
+	/// </summary>
+	awaitable<void> async_exchange_keys();
+
 	/// <summary>
 	///  Sends a file to the server.
 	/// </summary>
 	/// <param name="file_path">The local file path to send.</param>
+	/// <param name="verified_crc">If not null, set to the file's CRC once the server verified it.</param>
 	/// <returns>Whether file upload executed succesfuuly, or failed otherwise</returns>
-	bool send_file(std::filesystem::path file_path);
+	bool send_file(std::filesystem::path file_path, uint32_t* verified_crc = nullptr);
+
+	/// <summary>
+	///  Sends a file to the server, asynchronously.
+	/// </summary>
+	/// <param name="file_path">The local file path to send.</param>
+	/// <param name="verified_crc">If not null, set to the file's CRC once the server verified it.</param>
+	/// <returns>Whether file upload executed succesfuuly, or failed otherwise</returns>
+	awaitable<bool> async_send_file(std::filesystem::path file_path, uint32_t* verified_crc = nullptr);
+
+	/// <summary>
+	/// Sets whether the client stores a session ticket after a full key exchange (the default).
+	/// The ticket file is shared by the process's connections, so only one of them should store it - the others
+	/// still resume the stored session, unless set_resumes_session(false) is called.
+	/// </summary>
+	void set_stores_ticket(bool stores_ticket);
+
+	/// <summary>
+	/// Sets whether the key exchange resumes the stored session ticket when it can (the default).
+	/// A client that doesn't always makes a full RSA key exchange, so it gets an AES key of it's own.
+	/// </summary>
+	void set_resumes_session(bool resumes_session);
+
+	/// <summary>
+	/// Sets whether a file's checksum status response is read only before the next response (the default), so the next
+	/// upload goes out without waiting for it. Either way, a failed acknowledgement is reported against it's file -
+	/// see take_failed_acknowledgements.
+	/// </summary>
+	void set_pipelined(bool pipelined);
+
+	/// <summary>
+	/// Sets the size of the largest cipher text the client keeps in memory for upload retries - larger ones are kept
+	/// in a temp file. Lower it when a process runs many clients at once.
+	/// </summary>
+	void set_cipher_cache_memory(size_t max_size);
+
+	/// <summary>
+	/// Returns the files whose checksum status was not acknowledged since the last call, and forgets them.
+	/// send_file's result for a file is final only once it's acknowledgement was read - by the next request, or by flush.
+	/// </summary>
+	std::vector<FailedAcknowledgement> take_failed_acknowledgements();
+
+	/// <summary>
+	/// Reads the responses that are still pending. Failed acknowledgements are reported by take_failed_acknowledgements.
+	/// Should be called once no more requests are sent, so their failures are reported.
+	/// </summary>
+	void flush();
+
+	/// <summary>
+	/// Reads the responses that are still pending, asynchronously.
+	/// </summary>
+	awaitable<void> async_flush();
+
+	/// <summary>
+	/// Returns the socket's measured path, and the buffer & write sizes chosen by it.
+	/// </summary>
+	const SocketTuner::Stats& socket_stats() const;
 
 	/// <summary>
 	/// Returns whether the current client is a registered user in the server.
@@ -66,6 +237,19 @@ public:
 	bool is_registered();
 private:
 
+	/// <summary>
+	/// Loads the client's data from the info file, including the rsa private key.
+	/// </summary>
+	void load_info();
+
+	/// <summary>
+	/// Runs an operation of the client to completion on the client's io_context, and returns it's result.
+	/// Exceptions thrown by the operation are re-thrown to the caller.
+	/// Throws std::logic_error for a client on a shared io_context, since running it would run the others' operations.
+	/// </summary>
+	template <class T>
+	T run_sync(awaitable<T> operation);
+
 	/// <summary>
 	/// Returns a request object, with filled header values, to send to the server.
 	/// </summary>
@@ -75,18 +259,134 @@ private:
 	template <class T>
 	inline T get_request(ClientRequestsCode code);
 
+	/// <summary>
+	/// Resolves the host's endpoints, and caches them.
+	/// </summary>
+	awaitable<std::vector<tcp::endpoint>> async_resolve(const std::string& host, int port);
+
+	/// <summary>
+	/// Connects the socket to the first of the endpoints that answers.
+	/// </summary>
+	awaitable<boost::system::error_code> async_connect_endpoints(std::vector<tcp::endpoint> endpoints);
+
+	/// <summary>
+	/// Reads the next response header from the socket.
+	/// </summary>
+	awaitable<ServerResponseHeader> async_read_header();
+
+	/// <summary>
+	/// Leaves the response of the request that was just sent to be read later, before the next response.
+	/// When not pipelined, it is read right away.
+	/// </summary>
+	/// <param name="code">The expected response code.</param>
+	/// <param name="description">Describes the request, in case it's response is not the expected one.</param>
+	/// <param name="file_path">The file the response acknowledges.</param>
+	awaitable<void> async_defer_response(ServerResponseCode code, std::string description, std::filesystem::path file_path);
+
+	/// <summary>
+	/// Reads pending responses (with their payloads), oldest first, until at most the specified number are pending.
+	/// A response that is not the expected one fails it's file's acknowledgement - or throws std::runtime_error, for
+	/// a response that acknowledges no file. If the connection fails, all the pending acknowledgements fail, and the
+	/// error is thrown.
+	/// </summary>
+	awaitable<void> async_read_pending_responses(size_t keep);
+
+	/// <summary>
+	/// Fetches the server's response header from the socket, whatever it's code is.
+	/// Pending responses are read first.
+	/// </summary>
+	awaitable<ServerResponseHeader> async_get_any_header();
+
 	/// <summary>
 	/// Fetches the server's response from the socket, and returns the header.
 	/// Validates that the response header code matches the expected response, throws std::exception otherwise.
 	/// </summary>
 	/// <param name="code"></param>
 	/// <returns>The header's value</returns>
-	inline ServerResponseHeader get_header(ServerResponseCode code);
+	awaitable<ServerResponseHeader> async_get_header(ServerResponseCode code);
+
+	/// <summary>
+	/// Tries to resume a previous session with the stored session ticket.
+	/// </summary>
+	/// <returns>Whether the session was resumed, and the session's AES key restored.</returns>
+	awaitable<bool> async_resume_session();
+
+	/// <summary>
+	/// Requests a session ticket for the current AES key, and stores it for the next sessions.
+	/// </summary>
+	awaitable<void> async_request_ticket();
 
 	/// <summary>
 	/// Executes upload request of a single file, and returns the result CRC if succeeded.
+	/// A retry of the same file resends the cached cipher text instead of encrypting the file again.
+	/// From MIN_VERSION_LARGE_FILES on, the request is a compact message with a 64-bit size; older servers take files of
+	/// up to MAX_FIXED_UPLOAD_SIZE, larger ones throw std::invalid_argument.
 	/// </summary>
+	/// <param name="plain_crc">If not null, the local CRC of the file is calculated into it, while the file is sent.</param>
 	/// <returns></returns>
-	unsigned int request_file_upload(std::filesystem::path file_path);
+	awaitable<unsigned int> async_request_file_upload(std::filesystem::path file_path, CRC* plain_crc = nullptr);
+
+	/// <summary>
+	/// Executes a chunked upload of a single file, and returns the result CRC if succeeded.
+	/// Only the chunks the server does not hold are sent - including chunks of a previous, interrupted upload of the file.
+	/// </summary>
+	/// <param name="plain_crc">If not null, the local CRC of the file is calculated into it, while the file is sent.</param>
+	awaitable<unsigned int> async_request_chunked_upload(std::filesystem::path file_path, CRC* plain_crc = nullptr);
+
+	/// <summary>
+	/// Sends a chunked upload request, and returns the bitmap of the chunks held by the server.
+	/// </summary>
+	awaitable<std::vector<unsigned char>> async_get_upload_status(const BeginChunkedUploadRequest& request);
+
+	/// <summary>
+	/// Executes a deduplicated upload of a single file, and returns the result CRC if succeeded.
+	/// Only the content-defined chunks the server does not hold from any previous upload of the user are sent.
+	/// </summary>
+	/// <param name="plain_crc">If not null, the local CRC of the file is calculated into it, while the file is scanned.</param>
+	awaitable<unsigned int> async_request_dedup_upload(std::filesystem::path file_path, CRC* plain_crc = nullptr);
+
+	/// <summary>
+	/// Receives the payload of a held chunks response, after it's header, and returns the bitmap of the held chunks.
+	/// </summary>
+	awaitable<std::vector<unsigned char>> async_get_chunks_held(const ServerResponseHeader& header);
+
+	/// <summary>
+	/// Sends a single chunk of a deduplicated upload, in the server's request format.
+	/// </summary>
+	awaitable<void> async_send_store_chunk(StoreChunkMessage chunk, boost::asio::const_buffer content);
+
+	/// <summary>
+	/// Uploads a small file whole, in a single compact request, and returns the result CRC if succeeded.
+	/// </summary>
+	/// <param name="plain_crc">If not null, the local CRC of the file is calculated into it.</param>
+	awaitable<unsigned int> async_request_small_file_upload(std::filesystem::path file_path, CRC* plain_crc = nullptr);
+
+	/// <summary>
+	/// Receives the payload of a file uploaded response, after it's header, and returns the server's CRC of the file.
+	/// </summary>
+	awaitable<unsigned int> async_get_upload_checksum(const ServerResponseHeader& header);
+
+	/// <summary>
+	/// Returns whether the server uses compact messages.
+	/// </summary>
+	bool is_compact() const;
+
+	/// <summary>
+	/// Encodes a compact message, after a request header whose payload size is the message's.
+	/// </summary>
+	template <class T>
+	std::vector<unsigned char> encode_message(ClientRequestsCode code, const T& message);
+
+	/// <summary>
+	/// Sends a compact message, after a request header, followed by the content (if any).
+	/// </summary>
+	template <class T>
+	awaitable<void> async_send_message(ClientRequestsCode code, const T& message, boost::asio::const_buffer content = {});
+
+	/// <summary>
+	/// Receives & decodes the payload of a response as a compact message, after the response header.
+	/// </summary>
+	template <class T>
+	awaitable<T> async_receive_message(const ServerResponseHeader& header);
 };
 
@@ -0,0 +1,134 @@
+#include "DedupUpload.h"
+#include "ChunkedUpload.h"
+#include "ChunkPipeline.h"
+#include "EncryptedFileSender.h"
+#include "util/ContentChunker.h"
+#include "util/FileSource.h"
+#include <unordered_set>
+
+#include <cryptopp/sha.h>
+
+static_assert(CHUNK_HASH_SIZE_BYTES == CryptoPP::SHA256::DIGESTSIZE, "Chunks are identified by their SHA-256 digest!");
+
+/// <summary>
+/// Size of the reads while the file is scanned.
+/// </summary>
+static const size_t SCAN_READ_SIZE = 1024 * 1024;
+
+DedupUpload::DedupUpload(std::filesystem::path file_path, std::string aes_key, bool compress) :
+	_file_path(file_path), _aes_key(aes_key), _initial_counter(EncryptedFileSender::generate_initial_counter()), _compress(compress) {}
+
+void DedupUpload::scan(CRC* plain_crc) {
+	FileSource source(_file_path);
+	_file_size = source.size();
+	_chunks.clear();
+
+	ContentChunker chunker;
+	CryptoPP::SHA256 hash;
+	ChunkRef current;
+
+	const unsigned char* data;
+	size_t length;
+	while ((length = source.next(data, SCAN_READ_SIZE)) > 0) {
+		if (plain_crc != nullptr) {
+			plain_crc->update(reinterpret_cast<const char*>(data), length);
+		}
+
+		// a read may hold the end of several chunks, and a chunk may span several reads.
+		size_t done = 0;
+		while (done < length) {
+			bool is_boundary;
+			auto part = chunker.next(data + done, length - done, is_boundary);
+			hash.Update(data + done, part);
+			current.length += part;
+			done += part;
+
+			if (is_boundary) {
+				// Final also restarts the hash for the next chunk.
+				hash.Final(current.hash);
+				_chunks.push_back(current);
+				current.offset += current.length;
+				current.length = 0;
+			}
+		}
+	}
+
+	if (current.length > 0) {
+		hash.Final(current.hash);
+		_chunks.push_back(current);
+	}
+}
+
+const std::vector<DedupUpload::ChunkRef>& DedupUpload::chunks() const {
+	return _chunks;
+}
+
+uint64_t DedupUpload::file_size() const {
+	return _file_size;
+}
+
+std::vector<unsigned char> DedupUpload::hash_list() const {
+	std::vector<unsigned char> hashes;
+	hashes.reserve(_chunks.size() * CHUNK_HASH_SIZE_BYTES);
+	for (const auto& chunk : _chunks) {
+		hashes.insert(hashes.end(), chunk.hash, chunk.hash + CHUNK_HASH_SIZE_BYTES);
+	}
+	return hashes;
+}
+
+bool DedupUpload::is_complete(const std::vector<unsigned char>& held) const {
+	for (unsigned int i = 0; i < _chunks.size(); i++) {
+		if (!ChunkedUpload::is_held(held, i)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+boost::asio::awaitable<unsigned int> DedupUpload::async_send_missing(const std::vector<unsigned char>& held, ChunkSender send_chunk) {
+	FileSource source(_file_path);
+	StoreChunkMessage message{};
+	std::copy(_initial_counter.begin(), _initial_counter.end(), message.initial_counter.begin());
+
+	// the chunk's hash identifies it, so no checksum is needed.
+	ChunkPipeline pipeline(_aes_key, _initial_counter, _compress, false);
+	std::unordered_set<std::string> queued;
+	size_t next_index = 0;
+	unsigned int sent = 0;
+	while (true) {
+		while (next_index < _chunks.size() && !pipeline.is_full()) {
+			auto index = next_index++;
+			const auto& chunk = _chunks[index];
+			if (ChunkedUpload::is_held(held, static_cast<unsigned int>(index)) ||
+				!queued.insert(std::string(reinterpret_cast<const char*>(chunk.hash), sizeof(chunk.hash))).second) {
+				continue;
+			}
+
+			const unsigned char* plain;
+			source.seek(chunk.offset);
+			if (source.next(plain, chunk.length) != chunk.length) {
+				throw std::runtime_error("File changed while it was uploaded: " + _file_path.string());
+			}
+			// mapped data stays valid while the chunk is prepared, read data is overwritten by the next read.
+			pipeline.add(index, chunk.offset, plain, chunk.length, source.is_mapped());
+		}
+
+		if (pipeline.is_empty()) {
+			break;
+		}
+
+		co_await pipeline.async_wait_front();
+		auto& prepared = pipeline.front();
+		const auto& hash = _chunks[prepared.id].hash;
+		std::copy(std::begin(hash), std::end(hash), message.chunk_hash.begin());
+		message.offset = prepared.offset;
+		message.compression = prepared.compression;
+		message.plain_size = static_cast<uint32_t>(prepared.plain_size);
+		message.content_size = static_cast<uint32_t>(prepared.cipher.size());
+		co_await send_chunk(message, boost::asio::buffer(prepared.cipher));
+
+		pipeline.pop();
+		sent++;
+	}
+	co_return sent;
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <functional>
+#include <boost/asio.hpp>
+#include "protocol.h"
+#include "util/CRC.h"
+
+/// <summary>
+/// Uploads a file as content-defined chunks, identified by their SHA-256 hash.
+/// The server is asked which chunks it already holds (from any previous upload of the user), and only the missing ones
+/// are compressed, encrypted & sent. The server then assembles the file from it's chunk store.
+/// </summary>
+class DedupUpload
+{
+public:
+	/// <summary>
+	/// A single content-defined chunk of the file.
+	/// </summary>
+	struct ChunkRef {
+		uint64_t offset = 0;
+		size_t length = 0;
+		unsigned char hash[CHUNK_HASH_SIZE_BYTES] = { 0 };
+	};
+
+	/// <summary>
+	/// Sends a single chunk - it's details, followed by it's content.
+	/// </summary>
+	using ChunkSender = std::function<boost::asio::awaitable<void>(StoreChunkMessage chunk, boost::asio::const_buffer content)>;
+
+	/// <summary>
+	/// Creates a new deduplicated upload of a file, with a new random initial counter block.
+	/// </summary>
+	/// <param name="compress">Whether chunks may be compressed before they are encrypted.</param>
+	DedupUpload(std::filesystem::path file_path, std::string aes_key, bool compress);
+
+	/// <summary>
+	/// Reads the file, splits it into chunks & hashes them.
+	/// </summary>
+	/// <param name="plain_crc">If not null, the plain text is fed into it while it is read.</param>
+	void scan(CRC* plain_crc = nullptr);
+
+	/// <summary>
+	/// Returns the chunks found by scan, in the file's order.
+	/// </summary>
+	const std::vector<ChunkRef>& chunks() const;
+
+	/// <summary>
+	/// Returns the size of the scanned file.
+	/// </summary>
+	uint64_t file_size() const;
+
+	/// <summary>
+	/// Returns the hashes of all chunks, concatenated in the file's order, as sent in the query & assemble requests.
+	/// </summary>
+	std::vector<unsigned char> hash_list() const;
+
+	/// <summary>
+	/// Returns whether all the chunks are set in a held chunks bitmap, as sent by the server.
+	/// </summary>
+	bool is_complete(const std::vector<unsigned char>& held) const;
+
+	/// <summary>
+	/// Compresses, encrypts & sends the chunks that are not held. A chunk that appears several times in the file is sent once.
+	/// The chunks are not answered by the server.
+	/// </summary>
+	/// <param name="held">The held chunks bitmap, as sent by the server.</param>
+	/// <param name="send_chunk">Sends each chunk, in the server's request format.</param>
+	/// <returns>The number of chunks sent.</returns>
+	boost::asio::awaitable<unsigned int> async_send_missing(const std::vector<unsigned char>& held, ChunkSender send_chunk);
+
+private:
+	std::filesystem::path _file_path;
+	std::string _aes_key;
+	std::string _initial_counter;
+	bool _compress;
+	uint64_t _file_size = 0;
+	std::vector<ChunkRef> _chunks;
+};
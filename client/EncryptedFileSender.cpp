@@ -1,33 +1,333 @@
 #include "EncryptedFileSender.h"
 #include "protocol.h"
-#include <fstream>
+#include "util/SocketHelper.h"
+#include "util/Metrics.h"
+#include "util/Trace.h"
+#include <future>
+#include <vector>
 
 #include <cryptopp/modes.h>
 #include <cryptopp/aes.h>
-#include <cryptopp/filters.h>
-#include <cryptopp/files.h>
+#include <cryptopp/osrng.h>
 
 const CryptoPP::byte EncryptedFileSender::iv[CryptoPP::AES::BLOCKSIZE] = { 0 };
 
-EncryptedFileSender::EncryptedFileSender(std::filesystem::path path, std::string key) : file_path(path), _aes_key(key) {}
+static_assert(EncryptedFileSender::CHUNK_SIZE % CryptoPP::AES::BLOCKSIZE == 0, "Chunk size must be a multiple of the AES block size!");
+static_assert(EncryptedFileSender::PARALLEL_CHUNK_SIZE % CryptoPP::AES::BLOCKSIZE == 0, "Chunk size must be a multiple of the AES block size!");
+static_assert(CTR_COUNTER_SIZE_BYTES == CryptoPP::AES::BLOCKSIZE, "The CTR counter is a single AES block!");
 
-#define CHUNK_SIZE (1024)
+EncryptedFileSender::EncryptedFileSender(std::filesystem::path path, std::string key, std::string initial_counter) :
+	file_path(path), _aes_key(key), _initial_counter(initial_counter) {
 
-void EncryptedFileSender::send(boost::asio::ip::tcp::socket& socket) {
-	std::ifstream to_send(file_path, std::ios::binary);
+	if (!_initial_counter.empty() && _initial_counter.length() != CTR_COUNTER_SIZE_BYTES) {
+		throw std::invalid_argument("Initial counter must be " + std::to_string(CTR_COUNTER_SIZE_BYTES) + " bytes long!");
+	}
+}
+
+std::string EncryptedFileSender::generate_initial_counter() {
+	CryptoPP::AutoSeededRandomPool rng;
+	std::string counter(CTR_COUNTER_SIZE_BYTES, '\0');
+	rng.GenerateBlock(reinterpret_cast<CryptoPP::byte*>(counter.data()), counter.length());
+	return counter;
+}
+
+bool EncryptedFileSender::is_parallel() const {
+	return !_initial_counter.empty();
+}
+
+size_t EncryptedFileSender::encrypt_next_chunk(FileSource& source,
+	CryptoPP::CBC_Mode<CryptoPP::AES>::Encryption& encryption,
+	CryptoPP::byte* dest,
+	CRC* plain_crc,
+	bool& is_last) {
+
+	const CryptoPP::byte* plain;
+	size_t length;
+	{
+		TRACE_SCOPE("read");
+		length = source.next(plain, CHUNK_SIZE);
+	}
+
+	if (plain_crc != nullptr) {
+		plain_crc->update(reinterpret_cast<const char*>(plain), length);
+	}
+
+	Metrics::Timer timer(Metrics::PhaseEncrypt, length);
+	TRACE_SCOPE_BYTES("encrypt_cbc", length);
+
+	// a short read means end of file - the last block gets PKCS#7 padding, just like StreamTransformationFilter does.
+	is_last = length < CHUNK_SIZE;
+	size_t full_blocks_length = is_last ? length - (length % CryptoPP::AES::BLOCKSIZE) : length;
+
+	// encrypt straight from the source's data into the destination - no extra copy when the file is mapped.
+	// CBC state is kept by the encryption object between chunks.
+	encryption.ProcessData(dest, plain, full_blocks_length);
+
+	if (is_last) {
+		CryptoPP::byte last_block[CryptoPP::AES::BLOCKSIZE];
+		size_t tail = length - full_blocks_length;
+		auto padding = static_cast<CryptoPP::byte>(CryptoPP::AES::BLOCKSIZE - tail);
+		memcpy(last_block, plain + full_blocks_length, tail);
+		memset(last_block + tail, padding, padding);
+		encryption.ProcessData(dest + full_blocks_length, last_block, sizeof(last_block));
+		return full_blocks_length + sizeof(last_block);
+	}
+	return length;
+}
+
+std::unique_ptr<FileSource> EncryptedFileSender::open_source() {
+	try {
+		return std::make_unique<FileSource>(file_path);
+	}
+	catch (const std::runtime_error&) {
+		throw std::runtime_error("Failed to open file for sending! path: " + file_path.string());
+	}
+}
+
+std::unique_ptr<FileSource> EncryptedFileSender::open_source(CryptoPP::CBC_Mode<CryptoPP::AES>::Encryption& encryption) {
+	auto to_send = open_source();
 
 	unsigned char key_temp[AES_KEY_LENGTH_BYTES];
 	memcpy_s(key_temp, sizeof(key_temp), _aes_key.c_str(), _aes_key.length());
 
-	CryptoPP::CBC_Mode<CryptoPP::AES>::Encryption e;
+	encryption.SetKeyWithIV(key_temp, sizeof(key_temp), iv);
+	return to_send;
+}
+
+void EncryptedFileSender::encrypt_ctr_at(const std::string& aes_key, const std::string& initial_counter, uint64_t offset,
+	const CryptoPP::byte* plain, CryptoPP::byte* dest, size_t length) {
+	Metrics::Timer timer(Metrics::PhaseEncrypt, length);
+	TRACE_SCOPE_BYTES("encrypt_ctr", length);
+	CryptoPP::CTR_Mode<CryptoPP::AES>::Encryption e;
+	e.SetKeyWithIV(reinterpret_cast<const CryptoPP::byte*>(aes_key.data()), aes_key.length(),
+		reinterpret_cast<const CryptoPP::byte*>(initial_counter.data()), initial_counter.length());
+	e.Seek(offset);
+	e.ProcessData(dest, plain, length);
+}
+
+void EncryptedFileSender::encrypt_ctr_parallel(const std::string& aes_key, const std::string& initial_counter, uint64_t offset,
+	const CryptoPP::byte* plain, CryptoPP::byte* dest, size_t length, WorkerPool& pool) {
+	std::vector<std::future<void>> parts;
+	for (size_t done = 0; done < length; done += PARALLEL_CHUNK_SIZE) {
+		size_t part_length = length - done < PARALLEL_CHUNK_SIZE ? length - done : PARALLEL_CHUNK_SIZE;
+		parts.push_back(pool.submit([&, done, part_length]() {
+			encrypt_ctr_at(aes_key, initial_counter, offset + done, plain + done, dest + done, part_length);
+		}));
+	}
+
+	// all parts are waited for before any exception is re-thrown, since they write into dest.
+	for (auto& part : parts) {
+		part.wait();
+	}
+	for (auto& part : parts) {
+		part.get();
+	}
+}
+
+EncryptedFileSender::ParallelChunks::ParallelChunks(FileSource& source, const std::string& aes_key, const std::string& initial_counter,
+	CRC* plain_crc, WorkerPool& pool) :
+	_source(source), _aes_key(aes_key), _initial_counter(initial_counter), _plain_crc(plain_crc), _pool(pool),
+	// enough chunks to keep all the workers busy while the oldest one is being written.
+	_max_in_flight(pool.size() * 2) {}
+
+EncryptedFileSender::ParallelChunks::~ParallelChunks() {
+	// the workers write into the chunks' buffers - wait for them before releasing the buffers.
+	for (auto& chunk : _in_flight) {
+		if (chunk.encrypted.valid()) {
+			chunk.encrypted.wait();
+		}
+	}
+}
 
-	e.SetKeyWithIV(key_temp, sizeof(key_temp), iv);
+void EncryptedFileSender::ParallelChunks::fill() {
+	while (!_read_last && _in_flight.size() < _max_in_flight) {
+		Chunk chunk;
+		if (!_free.empty()) {
+			chunk = std::move(_free.back());
+			_free.pop_back();
+		}
+
+		const CryptoPP::byte* plain;
+		{
+			TRACE_SCOPE("read");
+			chunk.length = _source.next(plain, PARALLEL_CHUNK_SIZE);
+		}
+		_read_last = chunk.length < PARALLEL_CHUNK_SIZE;
+
+		// the CRC is serial - it is updated here, in the file's order.
+		if (_plain_crc != nullptr) {
+			_plain_crc->update(reinterpret_cast<const char*>(plain), chunk.length);
+		}
+
+		// mapped data stays valid while the chunk is encrypted, read data is overwritten by the next read.
+		if (!_source.is_mapped()) {
+			chunk.plain.assign(plain, plain + chunk.length);
+			plain = chunk.plain.data();
+		}
+		chunk.cipher.resize(PARALLEL_CHUNK_SIZE);
+
+		// each chunk starts at it's own position of the key stream, so chunks don't depend on each other.
+		chunk.encrypted = _pool.submit([this, plain, dest = chunk.cipher.data(), length = chunk.length, offset = _next_offset]() {
+			encrypt_ctr_at(_aes_key, _initial_counter, offset, plain, dest, length);
+		}, [encrypted = _encrypted]() {
+			encrypted->notify();
+		});
+		_next_offset += chunk.length;
+		_in_flight.push_back(std::move(chunk));
+	}
+}
+
+boost::asio::awaitable<bool> EncryptedFileSender::ParallelChunks::async_next(const CryptoPP::byte*& data, size_t& length) {
+	// the chunk returned by the previous call is no longer used by the caller, and may be refilled.
+	fill();
+	if (_in_flight.empty()) {
+		co_return false;
+	}
+
+	// the io_context thread runs other operations until the worker wakes it - any chunk's completion does, so the
+	// oldest one is checked again after each.
+	auto& encrypted = _in_flight.front().encrypted;
+	if (encrypted.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+		TRACE_SCOPE("wait_encrypted");
+		do {
+			co_await _encrypted->async_wait();
+		} while (encrypted.wait_for(std::chrono::seconds(0)) != std::future_status::ready);
+	}
+
+	// re-throws the encryption's exception, if any.
+	encrypted.get();
+	_free.push_back(std::move(_in_flight.front()));
+	_in_flight.pop_front();
+
+	data = _free.back().cipher.data();
+	length = _free.back().length;
+	co_return true;
+}
+
+EncryptedFileSender::SerialChunks::SerialChunks(FileSource& source, CryptoPP::CBC_Mode<CryptoPP::AES>::Encryption& encryption,
+	CRC* plain_crc) :
+	_source(source), _encryption(encryption), _plain_crc(plain_crc),
+	_buffers{ std::vector<CryptoPP::byte>(CHUNK_SIZE + CryptoPP::AES::BLOCKSIZE), std::vector<CryptoPP::byte>(CHUNK_SIZE + CryptoPP::AES::BLOCKSIZE) } {
+	_reader = std::thread(&SerialChunks::read, this);
+}
+
+EncryptedFileSender::SerialChunks::~SerialChunks() {
+	{
+		std::lock_guard<std::mutex> guard(_lock);
+		_stopping = true;
+	}
+	_changed.notify_all();
+	_reader.join();
+}
+
+void EncryptedFileSender::SerialChunks::read() {
+	try {
+		bool is_last = false;
+		while (!is_last) {
+			int index;
+			{
+				std::unique_lock<std::mutex> guard(_lock);
+				_changed.wait(guard, [this]() { return _stopping || _ready < 2; });
+				if (_stopping) {
+					return;
+				}
+				index = _next_encrypted;
+			}
+
+			// the buffer is free - it is only touched here until it is counted as ready.
+			auto length = encrypt_next_chunk(_source, _encryption, _buffers[index].data(), _plain_crc, is_last);
+
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				_lengths[index] = length;
+				_next_encrypted = 1 - index;
+				_ready++;
+				_encrypted_last = is_last;
+			}
+			_encrypted.notify();
+		}
+	}
+	catch (...) {
+		{
+			std::lock_guard<std::mutex> guard(_lock);
+			_error = std::current_exception();
+		}
+		_encrypted.notify();
+	}
+}
+
+boost::asio::awaitable<bool> EncryptedFileSender::SerialChunks::async_next(const CryptoPP::byte*& data, size_t& length) {
+	std::unique_lock<std::mutex> guard(_lock);
+	// the chunk returned by the previous call is no longer used by the caller, and may be refilled.
+	if (_holding) {
+		_ready--;
+		_next_returned = 1 - _next_returned;
+		_holding = false;
+		_changed.notify_all();
+	}
+
+	if (!_error && _ready == 0 && !_encrypted_last) {
+		TRACE_SCOPE("wait_encrypted");
+		do {
+			guard.unlock();
+			co_await _encrypted.async_wait();
+			guard.lock();
+		} while (!_error && _ready == 0 && !_encrypted_last);
+	}
+	if (_error) {
+		std::rethrow_exception(_error);
+	}
+	if (_ready == 0) {
+		co_return false;
+	}
+
+	data = _buffers[_next_returned].data();
+	length = _lengths[_next_returned];
+	_holding = true;
+	co_return true;
+}
+
+boost::asio::awaitable<void> EncryptedFileSender::async_send(boost::asio::ip::tcp::socket& socket, CRC* plain_crc, CiphertextCache::Entry* cipher_sink,
+	boost::asio::const_buffer prefix) {
+	if (is_parallel()) {
+		auto to_send = open_source();
+		ParallelChunks chunks(*to_send, _aes_key, _initial_counter, plain_crc);
+		const CryptoPP::byte* data;
+		size_t length;
+		// the next chunks are encrypted by the workers while the current one is written.
+		while (co_await chunks.async_next(data, length)) {
+			if (cipher_sink != nullptr) {
+				cipher_sink->append(data, length);
+			}
+			co_await SocketHelper::async_send_gather(prefix, boost::asio::buffer(data, length), socket);
+			prefix = boost::asio::const_buffer();
+		}
+		co_return;
+	}
+
+	CryptoPP::CBC_Mode<CryptoPP::AES>::Encryption e;
+	auto to_send = open_source(e);
 
-	std::string cipher;
-	CryptoPP::FileSource fs(to_send, true, new CryptoPP::StreamTransformationFilter(e, new CryptoPP::StringSink(cipher)));
-	boost::asio::write(socket, boost::asio::buffer(cipher));
+	// double buffering: the reader thread encrypts the next chunk while the current one is written.
+	SerialChunks chunks(*to_send, e, plain_crc);
+	const CryptoPP::byte* data;
+	size_t length;
+	while (co_await chunks.async_next(data, length)) {
+		if (cipher_sink != nullptr) {
+			cipher_sink->append(data, length);
+		}
+		// the prefix goes out with the first chunk only.
+		co_await SocketHelper::async_send_gather(prefix, boost::asio::buffer(data, length), socket);
+		prefix = boost::asio::const_buffer();
+	}
 }
 
-size_t EncryptedFileSender::encrypted_size() {
-	return (size_t)(ceil(std::filesystem::file_size(file_path) / static_cast<int>(CryptoPP::AES::BLOCKSIZE)) + 1) * static_cast<int>(CryptoPP::AES::BLOCKSIZE);
+uint64_t EncryptedFileSender::encrypted_size() {
+	// CTR is a stream mode - no padding is added.
+	auto file_size = static_cast<uint64_t>(std::filesystem::file_size(file_path));
+	if (is_parallel()) {
+		return file_size;
+	}
+	// CBC pads to the next whole block - a full block is added to a file of whole blocks.
+	return (file_size / CryptoPP::AES::BLOCKSIZE + 1) * CryptoPP::AES::BLOCKSIZE;
 }
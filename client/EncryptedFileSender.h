@@ -1,11 +1,28 @@
 #pragma once
 #include <filesystem>
+#include <memory>
+#include <deque>
+#include <future>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
 #include <boost/asio.hpp>
 #include <cryptopp/aes.h>
+#include <cryptopp/modes.h>
 #include "protocol.h"
+#include "util/CRC.h"
+#include "util/FileSource.h"
+#include "util/WorkerPool.h"
+#include "util/AsyncSignal.h"
+#include "CiphertextCache.h"
 
 /// <summary>
 /// This class helps with sending encrypted files and operating on them.
+/// Files are encrypted with AES-CBC and a zero IV, or with AES-CTR when an initial counter block is specified.
+/// CTR chunks are independent, so they are encrypted in parallel on the shared worker pool, and sent in order.
+/// CBC chunks depend on each other, so they are read & encrypted by a single thread, ahead of the writes.
 /// </summary>
 class EncryptedFileSender
 {
@@ -21,6 +38,10 @@ class EncryptedFileSender
 	/// Holds the IV for the AES encryption
 	/// </summary>
 	static const CryptoPP::byte iv[CryptoPP::AES::BLOCKSIZE];
+	/// <summary>
+	/// The initial CTR counter block, or empty for CBC.
+	/// </summary>
+	std::string _initial_counter;
 
 	/// <summary>
 	/// holds the current file path
@@ -28,20 +49,198 @@ class EncryptedFileSender
 	std::filesystem::path file_path;
 
 public:
+	/// <summary>
+	/// Size of a single plain text chunk that is read, encrypted and sent at once.
+	/// Must be a multiple of the AES block size.
+	/// </summary>
+	static const size_t CHUNK_SIZE = 64 * 1024;
+
+	/// <summary>
+	/// Size of a single plain text chunk that is encrypted by a worker, in CTR mode.
+	/// Larger than CHUNK_SIZE, so each task outweighs the cost of scheduling it.
+	/// </summary>
+	static const size_t PARALLEL_CHUNK_SIZE = 256 * 1024;
+
 	/// <summary>
 	/// Creates a new encrypted file sender.
 	/// <param name="file_path">The source file path.</param>
+	/// <param name="initial_counter">The initial counter block for AES-CTR, or empty for AES-CBC.</param>
+	/// </summary>
+	EncryptedFileSender(std::filesystem::path file_path, std::string aes_key, std::string initial_counter = "");
+
+	/// <summary>
+	/// Returns a new random initial counter block, for a file encrypted with AES-CTR.
+	/// A counter block must never be reused with the same key.
 	/// </summary>
-	EncryptedFileSender(std::filesystem::path file_path, std::string aes_key);
+	static std::string generate_initial_counter();
 
 	/// <summary>
-	/// Encrypts and sends a file through the socket.
+	/// Encrypts and sends a file through the socket, asynchronously.
+	/// The next chunks are read & encrypted off the io_context while the current one is written, so memory usage is
+	/// bounded by a few chunk buffers regardless of the file size, and other operations on the io_context run meanwhile.
 	/// </summary>
-	void send(boost::asio::ip::tcp::socket& socket);
+	/// <param name="plain_crc">If not null, updated with the plain text content while it is read.</param>
+	/// <param name="cipher_sink">If not null, the cipher text is recorded into it while it is sent.</param>
+	/// <param name="prefix">Data to send right before the file (e.g. the request), in the same write as the first chunk.</param>
+	boost::asio::awaitable<void> async_send(boost::asio::ip::tcp::socket& socket, CRC* plain_crc = nullptr, CiphertextCache::Entry* cipher_sink = nullptr,
+		boost::asio::const_buffer prefix = {});
 
 	/// <summary>
 	/// Returns the file size, after it was encrypted.
 	/// </summary>
-	size_t encrypted_size();
+	uint64_t encrypted_size();
+
+	/// <summary>
+	/// Returns whether the file is encrypted with AES-CTR, in parallel.
+	/// </summary>
+	bool is_parallel() const;
+
+	/// <summary>
+	/// Encrypts data with AES-CTR, starting at the specified offset of the key stream.
+	/// </summary>
+	/// <param name="offset">The offset of the data in the key stream, in bytes - it may be within a block.</param>
+	static void encrypt_ctr_at(const std::string& aes_key, const std::string& initial_counter, uint64_t offset,
+		const CryptoPP::byte* plain, CryptoPP::byte* dest, size_t length);
+
+	/// <summary>
+	/// Encrypts data with AES-CTR, starting at the specified offset of the key stream.
+	/// The data is split into PARALLEL_CHUNK_SIZE parts, that are encrypted on the worker pool.
+	/// </summary>
+	/// <param name="offset">The offset of the data in the key stream. Must be a multiple of the AES block size.</param>
+	static void encrypt_ctr_parallel(const std::string& aes_key, const std::string& initial_counter, uint64_t offset,
+		const CryptoPP::byte* plain, CryptoPP::byte* dest, size_t length, WorkerPool& pool = WorkerPool::shared());
+
+private:
+	/// <summary>
+	/// Encrypts the chunks of a file with AES-CTR on the worker pool, and returns them in order.
+	/// The number of chunks in flight is bounded, so memory usage does not depend on the file size.
+	/// </summary>
+	class ParallelChunks {
+		struct Chunk {
+			std::vector<CryptoPP::byte> plain;
+			std::vector<CryptoPP::byte> cipher;
+			size_t length = 0;
+			std::future<void> encrypted;
+		};
+
+		FileSource& _source;
+		const std::string& _aes_key;
+		const std::string& _initial_counter;
+		CRC* _plain_crc;
+		WorkerPool& _pool;
+		size_t _max_in_flight;
+		uint64_t _next_offset = 0;
+		/// <summary>
+		/// Chunks being encrypted, in the file's order.
+		/// </summary>
+		std::deque<Chunk> _in_flight;
+		/// <summary>
+		/// Chunks that may be reused. The last one is the chunk returned by the last call to next.
+		/// </summary>
+		std::vector<Chunk> _free;
+		/// <summary>
+		/// Whether the last chunk of the file (the only one shorter than PARALLEL_CHUNK_SIZE) was read.
+		/// </summary>
+		bool _read_last = false;
+		/// <summary>
+		/// Wakes the caller once a chunk was encrypted. Shared with the workers, which notify it after the chunk's future
+		/// is ready - possibly after the chunks were released.
+		/// </summary>
+		std::shared_ptr<AsyncSignal> _encrypted = std::make_shared<AsyncSignal>();
+
+		/// <summary>
+		/// Reads more chunks from the source and queues their encryption, until the in-flight limit or the end of the file is reached.
+		/// </summary>
+		void fill();
+
+	public:
+		ParallelChunks(FileSource& source, const std::string& aes_key, const std::string& initial_counter, CRC* plain_crc,
+			WorkerPool& pool = WorkerPool::shared());
+		~ParallelChunks();
+
+		/// <summary>
+		/// Waits for the next encrypted chunk, without blocking the io_context.
+		/// The returned data is valid until the next call.
+		/// </summary>
+		/// <returns>Whether a chunk was returned - false once the whole file was returned.</returns>
+		boost::asio::awaitable<bool> async_next(const CryptoPP::byte*& data, size_t& length);
+	};
+
+	/// <summary>
+	/// Reads & encrypts the chunks of a file with AES-CBC on a thread of it's own, one chunk ahead of the caller.
+	/// The thread lives as long as the object, and fills two buffers in turn - one is encrypted while the other is used.
+	/// </summary>
+	class SerialChunks {
+		FileSource& _source;
+		CryptoPP::CBC_Mode<CryptoPP::AES>::Encryption& _encryption;
+		CRC* _plain_crc;
+		std::vector<CryptoPP::byte> _buffers[2];
+		size_t _lengths[2] = { 0, 0 };
+		/// <summary>
+		/// The number of buffers encrypted and not yet released by the caller - including the one it uses.
+		/// </summary>
+		int _ready = 0;
+		int _next_encrypted = 0;
+		int _next_returned = 0;
+		/// <summary>
+		/// Whether the caller uses a returned buffer, until it's next call.
+		/// </summary>
+		bool _holding = false;
+		/// <summary>
+		/// Whether the last chunk of the file was encrypted.
+		/// </summary>
+		bool _encrypted_last = false;
+		bool _stopping = false;
+		std::exception_ptr _error;
+		std::mutex _lock;
+		/// <summary>
+		/// Wakes the reader, once a buffer was released or it should stop.
+		/// </summary>
+		std::condition_variable _changed;
+		/// <summary>
+		/// Wakes the caller, once a chunk was encrypted or the reader failed.
+		/// </summary>
+		AsyncSignal _encrypted;
+		std::thread _reader;
+
+		/// <summary>
+		/// The loop of the reader thread - encrypts chunks into free buffers, until the end of the file.
+		/// </summary>
+		void read();
+
+	public:
+		SerialChunks(FileSource& source, CryptoPP::CBC_Mode<CryptoPP::AES>::Encryption& encryption, CRC* plain_crc);
+		~SerialChunks();
+
+		/// <summary>
+		/// Waits for the next encrypted chunk without blocking the io_context, and lets the reader reuse the previous one.
+		/// The returned data is valid until the next call.
+		/// </summary>
+		/// <returns>Whether a chunk was returned - false once the whole file was returned.</returns>
+		boost::asio::awaitable<bool> async_next(const CryptoPP::byte*& data, size_t& length);
+	};
+
+	/// <summary>
+	/// Opens the source file for reading.
+	/// </summary>
+	std::unique_ptr<FileSource> open_source();
+
+	/// <summary>
+	/// Opens the source file for reading, and prepares the CBC encryption with the session key.
+	/// </summary>
+	std::unique_ptr<FileSource> open_source(CryptoPP::CBC_Mode<CryptoPP::AES>::Encryption& encryption);
+
+	/// <summary>
+	/// Reads the next plain text chunk from the source, and encrypts it into dest.
+	/// The last chunk of the file gets PKCS#7 padded, and is_last is set.
+	/// The plain text is fed into plain_crc (if not null) before it is encrypted.
+	/// </summary>
+	/// <param name="dest">A buffer of at least CHUNK_SIZE + AES::BLOCKSIZE bytes.</param>
+	/// <returns>The number of encrypted bytes written to dest.</returns>
+	static size_t encrypt_next_chunk(FileSource& source,
+		CryptoPP::CBC_Mode<CryptoPP::AES>::Encryption& encryption,
+		CryptoPP::byte* dest,
+		CRC* plain_crc,
+		bool& is_last);
 };
 
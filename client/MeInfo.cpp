@@ -6,66 +6,147 @@
 #include "protocol.h"
 
 
-#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <filesystem>
+#include "util/FileSource.h"
+#include "util/WireFormat.h"
+#include "util/AtomicFile.h"
+
 const std::string MeInfo::FILE_NAME = "me.info";
 
-MeInfo::MeInfo() {
+/// <summary>
+/// Identifies the binary format, and it's version. Files that don't start with it are of the older text format.
+/// </summary>
+static const unsigned char INFO_MAGIC[4] = { 'M', '1', '5', 'I' };
+static const uint32_t INFO_FORMAT_VERSION = 1;
+
+// header: magic, format version, user id, user name length & private key length (u32 each), followed by the user
+// name and the private key (DER encoded - no Base64).
+static const size_t HEADER_SIZE = sizeof(INFO_MAGIC) + sizeof(uint32_t) + USER_ID_SIZE_BYTES + 2 * sizeof(uint32_t);
+static const size_t HEADER_VERSION_OFFSET = sizeof(INFO_MAGIC);
+static const size_t HEADER_USER_ID_OFFSET = HEADER_VERSION_OFFSET + sizeof(uint32_t);
+static const size_t HEADER_NAME_LENGTH_OFFSET = HEADER_USER_ID_OFFSET + USER_ID_SIZE_BYTES;
+static const size_t HEADER_KEY_LENGTH_OFFSET = HEADER_NAME_LENGTH_OFFSET + sizeof(uint32_t);
+
+using WireFormat::load_le;
+using WireFormat::store_le;
+
+MeInfo::MeInfo() : MeInfo(true) {}
+
+MeInfo::MeInfo(bool persistent) {
 	_file_loaded = false;
+	_persistent = persistent;
 
-	if (try_load()) {
+	if (_persistent && try_load()) {
 		_file_loaded = true;
 	}
 }
 
 
-void MeInfo::save() {
-	std::ofstream info_file(FILE_NAME);
-
-	if (!info_file.is_open()) {
-		return;
+bool MeInfo::save() {
+	if (!_persistent) {
+		return false;
 	}
 
-	info_file << this->user_name << std::endl;
-
-	Uuid::write(info_file, this->header_user_id, sizeof(this->header_user_id));
-
-	info_file << std::endl << Base64::encode(this->rsa_private_key);
+	std::vector<unsigned char> content(HEADER_SIZE + user_name.length() + rsa_private_key.length());
+	memcpy_s(content.data(), content.size(), INFO_MAGIC, sizeof(INFO_MAGIC));
+	store_le(INFO_FORMAT_VERSION, content.data() + HEADER_VERSION_OFFSET);
+	memcpy_s(content.data() + HEADER_USER_ID_OFFSET, USER_ID_SIZE_BYTES, header_user_id, sizeof(header_user_id));
+	store_le(static_cast<uint32_t>(user_name.length()), content.data() + HEADER_NAME_LENGTH_OFFSET);
+	store_le(static_cast<uint32_t>(rsa_private_key.length()), content.data() + HEADER_KEY_LENGTH_OFFSET);
+	std::copy(user_name.begin(), user_name.end(), content.begin() + HEADER_SIZE);
+	std::copy(rsa_private_key.begin(), rsa_private_key.end(), content.begin() + HEADER_SIZE + user_name.length());
+
+	// replaced atomically, so a failed save leaves the previous file.
+	if (!AtomicFile::write(FILE_NAME, std::string(content.begin(), content.end()), true)) {
+		return false;
+	}
 
 	// file is up-to-date with loaded data!
 	_file_loaded = true;
+	_text_format = false;
+	return true;
 }
 
 
 bool MeInfo::try_load() {
+	// checked first, since there is no file before registration - and failing to open one throws.
+	if (!std::filesystem::is_regular_file(FILE_NAME)) {
+		return false;
+	}
+
 	try {
-		std::ifstream info_file(FILE_NAME);
+		FileSource source(FILE_NAME);
+		auto size = source.size();
+		const unsigned char* data;
+		if (size < sizeof(INFO_MAGIC) || source.next(data, static_cast<size_t>(size)) != size) {
+			return false;
+		}
+		if (memcmp(data, INFO_MAGIC, sizeof(INFO_MAGIC)) == 0 && try_load_binary(data, static_cast<size_t>(size))) {
+			return true;
+		}
 
-		if (!info_file.is_open()) {
+		// written by an older client (whose user name may even start like the magic). It is not converted here, since
+		// older clients may still read it - only an explicit save does.
+		if (!try_load_text(std::string(reinterpret_cast<const char*>(data), static_cast<size_t>(size)))) {
 			return false;
 		}
-		// user name
-		std::getline(info_file, this->user_name);
+		_text_format = true;
+	}
+	catch (const std::exception&) {
+		return false;
+	}
+	return true;
+}
 
-		std::string temp_line;
+bool MeInfo::try_load_binary(const unsigned char* data, size_t size) {
+	if (size < HEADER_SIZE || load_le<uint32_t>(data + HEADER_VERSION_OFFSET) != INFO_FORMAT_VERSION) {
+		return false;
+	}
+	auto name_length = load_le<uint32_t>(data + HEADER_NAME_LENGTH_OFFSET);
+	auto key_length = load_le<uint32_t>(data + HEADER_KEY_LENGTH_OFFSET);
+	if (static_cast<uint64_t>(name_length) + key_length != size - HEADER_SIZE) {
+		return false;
+	}
 
-		// user id
-		info_file >> temp_line;
-		if (temp_line.empty()) return false;
+	memcpy_s(header_user_id, sizeof(header_user_id), data + HEADER_USER_ID_OFFSET, USER_ID_SIZE_BYTES);
+	auto name = reinterpret_cast<const char*>(data + HEADER_SIZE);
+	user_name.assign(name, name_length);
+	rsa_private_key.assign(name + name_length, key_length);
+	return true;
+}
 
-		Uuid::parse(temp_line, this->header_user_id);
+bool MeInfo::try_load_text(const std::string& content) {
+	std::istringstream info_file(content);
 
-		// private key
-		info_file >> temp_line;
+	// user name
+	std::getline(info_file, this->user_name);
 
-		// decode & set
-		rsa_private_key = Base64::decode(temp_line);
-		return true;
-	}
-	catch (const std::exception&) {
-		return false;
-	}
+	std::string temp_line;
+
+	// user id
+	info_file >> temp_line;
+	if (temp_line.empty()) return false;
+
+	Uuid::parse(temp_line, this->header_user_id);
+
+	// private key
+	info_file >> temp_line;
+
+	// decode & set
+	rsa_private_key = Base64::decode(temp_line);
+	return true;
 }
 
 bool MeInfo::is_loaded() {
 	return _file_loaded;
+}
+
+bool MeInfo::is_persistent() const {
+	return _persistent;
+}
+
+bool MeInfo::is_text_format() const {
+	return _text_format;
 }
\ No newline at end of file
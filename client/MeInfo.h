@@ -17,11 +17,32 @@ class MeInfo {
 	/// </summary>
 	bool _file_loaded;
 
+	/// <summary>
+	/// Whether the data is loaded from & saved to the local source, or kept in memory only.
+	/// </summary>
+	bool _persistent;
+
+	/// <summary>
+	/// Whether the data was loaded from a file of the older text format.
+	/// </summary>
+	bool _text_format = false;
+
 	/// <summary>
 	/// Tries to load the client data from the local source.
+	/// A file of the older text format is loaded too, and left as it is - older clients may still share it.
 	/// </summary>
 	bool try_load();
 
+	/// <summary>
+	/// Loads the client data from the binary format, as read from the file.
+	/// </summary>
+	bool try_load_binary(const unsigned char* data, size_t size);
+
+	/// <summary>
+	/// Loads the client data from the text format: user name, user ID (hex) and Base64 private key, one per line.
+	/// </summary>
+	bool try_load_text(const std::string& content);
+
 public:
 
 	/// <summary>
@@ -46,13 +67,32 @@ public:
 	MeInfo();
 
 	/// <summary>
-	/// Saves the current data into the local source.
+	/// Creates an instance of the client data. A non persistent instance starts empty, and is kept in memory only -
+	/// so many users may run in a single process (e.g. by the load generator).
 	/// </summary>
-	void save();
+	/// <param name="persistent">Whether to load the data from the local source, and save it there.</param>
+	explicit MeInfo(bool persistent);
+
+	/// <summary>
+	/// Saves the current data into the local source, in the binary format - so a file of the text format is converted.
+	/// The file is replaced atomically, and is readable by it's owner only, as it holds the private key.
+	/// </summary>
+	/// <returns>Whether the data was saved.</returns>
+	bool save();
 
 
 	/// <summary>
 	/// Returns whether settings file was loaded to the data class.
 	/// </summary>
 	bool is_loaded();
+
+	/// <summary>
+	/// Returns whether the data is saved to the local source.
+	/// </summary>
+	bool is_persistent() const;
+
+	/// <summary>
+	/// Returns whether the data was loaded from a file of the older text format, which save converts.
+	/// </summary>
+	bool is_text_format() const;
 };
\ No newline at end of file
@@ -1,31 +1,57 @@
 #include "RSAManager.h"
 #include "protocol.h"
+#include "util/Metrics.h"
+#include "util/Trace.h"
 
 RSAManager::RSAManager() {}
 
 void RSAManager::setKey(std::string key)
 {
-	CryptoPP::StringSource ss(key, true);
-	_privateKey.Load(ss);
+	_encodedKey = std::move(key);
+}
+
+CryptoPP::RSA::PrivateKey& RSAManager::private_key()
+{
+	if (!_encodedKey.empty()) {
+		Metrics::Timer timer(Metrics::PhaseRsa);
+		TRACE_SCOPE("rsa_load_key");
+		CryptoPP::StringSource ss(_encodedKey, true);
+		_privateKey.Load(ss);
+		_encodedKey.clear();
+	}
+	return _privateKey;
+}
+
+CryptoPP::AutoSeededRandomPool& RSAManager::rng()
+{
+	if (!_rng) {
+		_rng = std::make_unique<CryptoPP::AutoSeededRandomPool>();
+	}
+	return *_rng;
 }
 
 void RSAManager::gen_key()
 {
-	_privateKey.Initialize(_rng, RSA_KEY_LENGTH_BITS);
+	Metrics::Timer timer(Metrics::PhaseRsa);
+	TRACE_SCOPE("rsa_generate_key");
+	_encodedKey.clear();
+	_privateKey.Initialize(rng(), RSA_KEY_LENGTH_BITS);
 	_initialized = true;
 }
 
 std::string RSAManager::decrypt(std::string cipher)
 {
+	Metrics::Timer timer(Metrics::PhaseRsa, cipher.length());
+	TRACE_SCOPE_BYTES("rsa_decrypt", cipher.length());
 	std::string decrypted;
-	CryptoPP::RSAES_OAEP_SHA_Decryptor d(_privateKey);
-	CryptoPP::StringSource ss_cipher(cipher, true, new CryptoPP::PK_DecryptorFilter(_rng, d, new CryptoPP::StringSink(decrypted)));
+	CryptoPP::RSAES_OAEP_SHA_Decryptor d(private_key());
+	CryptoPP::StringSource ss_cipher(cipher, true, new CryptoPP::PK_DecryptorFilter(rng(), d, new CryptoPP::StringSink(decrypted)));
 	return decrypted;
 }
 
 std::string RSAManager::get_public_key()
 {
-	CryptoPP::RSAFunction publicKey(_privateKey);
+	CryptoPP::RSAFunction publicKey(private_key());
 	std::string key;
 	CryptoPP::StringSink ss(key);
 	publicKey.Save(ss);
@@ -34,6 +60,10 @@ std::string RSAManager::get_public_key()
 
 std::string RSAManager::get_private_key()
 {
+	// a key that wasn't used yet is returned as it was set, without decoding it.
+	if (!_encodedKey.empty()) {
+		return _encodedKey;
+	}
 	std::string key;
 	CryptoPP::StringSink ss(key);
 	_privateKey.Save(ss);
@@ -2,6 +2,7 @@
 
 #include "protocol.h"
 #include <string>
+#include <memory>
 #include <cryptopp/rsa.h>
 #include <cryptopp/osrng.h>
 
@@ -11,9 +12,26 @@
 class RSAManager
 {
 private:
-	CryptoPP::AutoSeededRandomPool _rng;
+	/// <summary>
+	/// Created on first use - seeding it reads the OS's entropy source, and many runs never generate keys or decrypt.
+	/// </summary>
+	std::unique_ptr<CryptoPP::AutoSeededRandomPool> _rng;
 	CryptoPP::RSA::PrivateKey _privateKey;
+	/// <summary>
+	/// The key set by setKey, until it is decoded into _privateKey on first use.
+	/// </summary>
+	std::string _encodedKey;
 	bool _initialized = false;
+
+	/// <summary>
+	/// Returns the private key, decoding the key that was set first if it wasn't yet.
+	/// </summary>
+	CryptoPP::RSA::PrivateKey& private_key();
+
+	/// <summary>
+	/// Returns the random number generator, creating it first if it wasn't yet.
+	/// </summary>
+	CryptoPP::AutoSeededRandomPool& rng();
 public:
 	/// <summary>
 	/// Creates a new, empty instance of a decryptor.
@@ -22,6 +40,7 @@ public:
 
 	/// <summary>
 	/// Loads an existing RSA private key into the decryptor.
+	/// The key is decoded only once it is used, so an invalid key throws then.
 	/// </summary>
 	/// <param name="key">The key to load.</param>
 	void setKey(std::string key);
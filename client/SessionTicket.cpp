@@ -0,0 +1,118 @@
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <cstring>
+#include <stdexcept>
+#include "SessionTicket.h"
+#include "util/formats.h"
+#include "util/AtomicFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <dpapi.h>
+#pragma comment(lib, "crypt32.lib")
+#endif
+
+const std::string SessionTicket::FILE_NAME = "me.ticket";
+
+#ifdef _WIN32
+
+// the key is encrypted with the user's DPAPI key - only the same Windows user (on the same machine) may decrypt it.
+static std::string protect_key(const std::string& key) {
+	DATA_BLOB plain{ static_cast<DWORD>(key.size()), reinterpret_cast<BYTE*>(const_cast<char*>(key.data())) };
+	DATA_BLOB protected_key{};
+	if (!CryptProtectData(&plain, nullptr, nullptr, nullptr, nullptr, CRYPTPROTECT_UI_FORBIDDEN, &protected_key)) {
+		throw std::runtime_error("Failed to protect the session key!");
+	}
+	std::string result(reinterpret_cast<const char*>(protected_key.pbData), protected_key.cbData);
+	LocalFree(protected_key.pbData);
+	return result;
+}
+
+static std::string unprotect_key(const std::string& stored) {
+	DATA_BLOB protected_key{ static_cast<DWORD>(stored.size()), reinterpret_cast<BYTE*>(const_cast<char*>(stored.data())) };
+	DATA_BLOB plain{};
+	if (!CryptUnprotectData(&protected_key, nullptr, nullptr, nullptr, nullptr, CRYPTPROTECT_UI_FORBIDDEN, &plain)) {
+		throw std::runtime_error("Failed to unprotect the session key!");
+	}
+	std::string result(reinterpret_cast<const char*>(plain.pbData), plain.cbData);
+	SecureZeroMemory(plain.pbData, plain.cbData);
+	LocalFree(plain.pbData);
+	return result;
+}
+
+#else
+
+// there's no per-user key store to rely on - the key is kept as is, in a file only it's owner may read (see save).
+static std::string protect_key(const std::string& key) {
+	return key;
+}
+
+static std::string unprotect_key(const std::string& stored) {
+	return stored;
+}
+
+#endif
+
+bool SessionTicket::load() {
+	try {
+		std::ifstream ticket_file(FILE_NAME);
+
+		if (!ticket_file.is_open()) {
+			return false;
+		}
+
+		std::string temp_line;
+
+		// ticket id & user id
+		ticket_file >> temp_line;
+		Uuid::parse(temp_line, this->ticket_id);
+		ticket_file >> temp_line;
+		Uuid::parse(temp_line, this->user_id);
+
+		// expiry
+		long long expiry_seconds = 0;
+		ticket_file >> expiry_seconds;
+		this->expiry = static_cast<std::time_t>(expiry_seconds);
+
+		// session key
+		ticket_file >> temp_line;
+		this->aes_key = unprotect_key(Base64::decode(temp_line));
+		return ticket_file.good() || ticket_file.eof();
+	}
+	catch (const std::exception&) {
+		return false;
+	}
+}
+
+// failing to store the ticket only costs the next run a full key exchange - so failures are ignored.
+void SessionTicket::save() {
+	std::string stored_key;
+	try {
+		stored_key = protect_key(this->aes_key);
+	}
+	catch (const std::runtime_error&) {
+		return;
+	}
+
+	std::ostringstream ticket_file;
+	Uuid::write(ticket_file, this->ticket_id, sizeof(this->ticket_id));
+	ticket_file << std::endl;
+	Uuid::write(ticket_file, this->user_id, sizeof(this->user_id));
+	ticket_file << std::endl << std::dec << static_cast<long long>(this->expiry) << std::endl;
+	ticket_file << Base64::encode(stored_key);
+
+	AtomicFile::write(FILE_NAME, ticket_file.str(), true);
+}
+
+void SessionTicket::remove() {
+	std::error_code ignored;
+	std::filesystem::remove(FILE_NAME, ignored);
+}
+
+bool SessionTicket::is_valid_for(const unsigned char* header_user_id) const {
+	return aes_key.length() == AES_KEY_LENGTH_BYTES &&
+		memcmp(user_id, header_user_id, sizeof(user_id)) == 0 &&
+		std::time(nullptr) < expiry;
+}
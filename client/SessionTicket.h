@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string>
+#include <ctime>
+#include "protocol.h"
+
+/// <summary>
+/// A session resumption ticket, issued by the server after a full key exchange.
+/// Presenting it on a later connection restores the session's AES key, without the RSA key exchange.
+/// It is stored next to the client's info file. The session key is protected at rest: on Windows it is encrypted for the
+/// current user (DPAPI), and on other systems the file is created readable by it's owner only.
+/// </summary>
+class SessionTicket {
+
+	static const std::string FILE_NAME;
+
+public:
+	/// <summary>
+	/// The ticket ID, as issued by the server.
+	/// </summary>
+	unsigned char ticket_id[TICKET_ID_SIZE_BYTES] = { 0 };
+
+	/// <summary>
+	/// The user ID the ticket was issued for.
+	/// </summary>
+	unsigned char user_id[USER_ID_SIZE_BYTES] = { 0 };
+
+	/// <summary>
+	/// The AES session key the ticket resumes.
+	/// </summary>
+	std::string aes_key;
+
+	/// <summary>
+	/// The time (UNIX seconds) the ticket expires at.
+	/// </summary>
+	std::time_t expiry = 0;
+
+	/// <summary>
+	/// Tries to load the ticket from the local source.
+	/// </summary>
+	/// <returns>Whether a ticket was loaded.</returns>
+	bool load();
+
+	/// <summary>
+	/// Saves the ticket into the local source, replacing it atomically.
+	/// </summary>
+	void save();
+
+	/// <summary>
+	/// Removes the ticket from the local source (e.g. after the server rejected it).
+	/// </summary>
+	static void remove();
+
+	/// <summary>
+	/// Returns whether the ticket may be presented for the specified user now.
+	/// </summary>
+	bool is_valid_for(const unsigned char* header_user_id) const;
+};
@@ -0,0 +1,263 @@
+#include "SyncManifest.h"
+#include "util/CRC.h"
+#include "util/WireFormat.h"
+#include "util/AtomicFile.h"
+#include <algorithm>
+#include <cstring>
+
+const std::string SyncManifest::FILE_NAME = "me.manifest";
+
+/// <summary>
+/// Identifies the manifest's format, and it's version.
+/// </summary>
+static const unsigned char MANIFEST_MAGIC[4] = { 'M', '1', '5', 'S' };
+static const uint32_t MANIFEST_FORMAT_VERSION = 1;
+
+// header: magic, format version (u32), user id, entry count (u64).
+static const size_t HEADER_SIZE = sizeof(MANIFEST_MAGIC) + sizeof(uint32_t) + USER_ID_SIZE_BYTES + sizeof(uint64_t);
+static const size_t HEADER_VERSION_OFFSET = sizeof(MANIFEST_MAGIC);
+static const size_t HEADER_USER_ID_OFFSET = HEADER_VERSION_OFFSET + sizeof(uint32_t);
+static const size_t HEADER_COUNT_OFFSET = HEADER_USER_ID_OFFSET + USER_ID_SIZE_BYTES;
+
+// entry: path hash, size, mtime, inode (u64 each), path offset & length in the paths part, CRC, reserved (u32 each).
+static const size_t ENTRY_SIZE = 4 * sizeof(uint64_t) + 4 * sizeof(uint32_t);
+static const size_t ENTRY_HASH_OFFSET = 0;
+static const size_t ENTRY_SIZE_OFFSET = 8;
+static const size_t ENTRY_MTIME_OFFSET = 16;
+static const size_t ENTRY_INODE_OFFSET = 24;
+static const size_t ENTRY_PATH_OFFSET_OFFSET = 32;
+static const size_t ENTRY_PATH_LENGTH_OFFSET = 36;
+static const size_t ENTRY_CRC_OFFSET = 40;
+
+using WireFormat::load_le;
+using WireFormat::store_le;
+
+SyncManifest::SyncManifest(const unsigned char* user_id) {
+	memcpy_s(_user_id, sizeof(_user_id), user_id, USER_ID_SIZE_BYTES);
+	load();
+}
+
+void SyncManifest::load() {
+	_source.reset();
+	_data = nullptr;
+	_loaded_count = 0;
+	_loaded_paths = nullptr;
+	_loaded_paths_size = 0;
+
+	if (!std::filesystem::is_regular_file(FILE_NAME)) {
+		return;
+	}
+
+	uint64_t size;
+	try {
+		_source = std::make_unique<FileSource>(FILE_NAME);
+		size = _source->size();
+		if (size < HEADER_SIZE) {
+			_source.reset();
+			return;
+		}
+		const unsigned char* data;
+		if (_source->next(data, static_cast<size_t>(size)) != size) {
+			_source.reset();
+			return;
+		}
+		// the data stays valid as long as the source isn't read again - mapped, or read whole into it's buffer.
+		_data = data;
+	}
+	catch (const std::runtime_error&) {
+		// an unreadable manifest is the same as a missing one - everything is uploaded.
+		_source.reset();
+		return;
+	}
+
+	auto count = load_le<uint64_t>(_data + HEADER_COUNT_OFFSET);
+	if (memcmp(_data, MANIFEST_MAGIC, sizeof(MANIFEST_MAGIC)) != 0 ||
+		load_le<uint32_t>(_data + HEADER_VERSION_OFFSET) != MANIFEST_FORMAT_VERSION ||
+		memcmp(_data + HEADER_USER_ID_OFFSET, _user_id, sizeof(_user_id)) != 0 ||
+		count > (size - HEADER_SIZE) / ENTRY_SIZE) {
+		_source.reset();
+		_data = nullptr;
+		return;
+	}
+	_loaded_count = count;
+	_loaded_paths = _data + HEADER_SIZE + count * ENTRY_SIZE;
+	_loaded_paths_size = size - HEADER_SIZE - count * ENTRY_SIZE;
+}
+
+std::string SyncManifest::key_of(const std::filesystem::path& path) {
+	return std::filesystem::absolute(path).lexically_normal().generic_string();
+}
+
+uint64_t SyncManifest::hash_of(const std::string& key) {
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (auto c : key) {
+		hash ^= static_cast<unsigned char>(c);
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+const unsigned char* SyncManifest::loaded_entry(uint64_t index) const {
+	return _data + HEADER_SIZE + index * ENTRY_SIZE;
+}
+
+std::string_view SyncManifest::loaded_path(const unsigned char* entry) const {
+	auto path_offset = load_le<uint32_t>(entry + ENTRY_PATH_OFFSET_OFFSET);
+	auto path_length = load_le<uint32_t>(entry + ENTRY_PATH_LENGTH_OFFSET);
+	if (static_cast<uint64_t>(path_offset) + path_length > _loaded_paths_size) {
+		return std::string_view();
+	}
+	return std::string_view(reinterpret_cast<const char*>(_loaded_paths + path_offset), path_length);
+}
+
+SyncManifest::Entry SyncManifest::decode_entry(const unsigned char* entry) {
+	Entry decoded;
+	decoded.stat.size = load_le<uint64_t>(entry + ENTRY_SIZE_OFFSET);
+	decoded.stat.mtime = static_cast<int64_t>(load_le<uint64_t>(entry + ENTRY_MTIME_OFFSET));
+	decoded.stat.inode = load_le<uint64_t>(entry + ENTRY_INODE_OFFSET);
+	decoded.crc = load_le<uint32_t>(entry + ENTRY_CRC_OFFSET);
+	return decoded;
+}
+
+bool SyncManifest::find_loaded(const std::string& key, uint64_t hash, Entry& entry) const {
+	// first entry with the hash, then the entries of the same hash are compared by their path.
+	uint64_t low = 0, high = _loaded_count;
+	while (low < high) {
+		auto middle = low + (high - low) / 2;
+		if (load_le<uint64_t>(loaded_entry(middle) + ENTRY_HASH_OFFSET) < hash)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	for (auto index = low; index < _loaded_count; index++) {
+		const auto* current = loaded_entry(index);
+		if (load_le<uint64_t>(current + ENTRY_HASH_OFFSET) != hash) {
+			break;
+		}
+		if (loaded_path(current) == key) {
+			entry = decode_entry(current);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool SyncManifest::find(const std::filesystem::path& path, Entry& entry) const {
+	auto key = key_of(path);
+	auto updated = _updates.find(key);
+	if (updated != _updates.end()) {
+		entry = updated->second;
+		return true;
+	}
+	return find_loaded(key, hash_of(key), entry);
+}
+
+bool SyncManifest::is_synced(const std::filesystem::path& path, FileStat& current) {
+	current = FileStat();
+	Entry entry;
+	if (!FileStat::of(path, current) || !find(path, entry)) {
+		return false;
+	}
+	if (entry.stat == current) {
+		return true;
+	}
+	if (entry.stat.size != current.size) {
+		return false;
+	}
+
+	// touched or copied over with the same content - reading is still much cheaper than uploading.
+	CRC crc;
+	if (crc.calculate(path.string()) != entry.crc) {
+		return false;
+	}
+	update(path, current, entry.crc);
+	return true;
+}
+
+void SyncManifest::update(const std::filesystem::path& path, const FileStat& stat, uint32_t crc) {
+	_updates[key_of(path)] = Entry{ stat, crc };
+}
+
+size_t SyncManifest::size() const {
+	size_t count = static_cast<size_t>(_loaded_count);
+	for (const auto& [key, entry] : _updates) {
+		Entry ignored;
+		if (!find_loaded(key, hash_of(key), ignored)) {
+			count++;
+		}
+	}
+	return count;
+}
+
+void SyncManifest::save() {
+	struct Record {
+		uint64_t hash;
+		std::string_view path;
+		Entry entry;
+	};
+	std::vector<Record> records;
+	records.reserve(static_cast<size_t>(_loaded_count) + _updates.size());
+
+	// the loaded entries that were not updated, then the updates.
+	for (uint64_t index = 0; index < _loaded_count; index++) {
+		const auto* current = loaded_entry(index);
+		auto path = loaded_path(current);
+		if (path.empty() || _updates.count(std::string(path)) > 0) {
+			continue;
+		}
+		records.push_back({ load_le<uint64_t>(current + ENTRY_HASH_OFFSET), path, decode_entry(current) });
+	}
+	for (const auto& [key, entry] : _updates) {
+		records.push_back({ hash_of(key), key, entry });
+	}
+	std::sort(records.begin(), records.end(), [](const Record& a, const Record& b) {
+		return a.hash != b.hash ? a.hash < b.hash : a.path < b.path;
+	});
+
+	// the whole file is built in memory - it's written with a single write.
+	size_t paths_size = 0;
+	for (const auto& record : records) {
+		paths_size += record.path.length();
+	}
+	if (paths_size > UINT32_MAX) {
+		throw std::runtime_error("Sync manifest is too large!");
+	}
+	std::string content(HEADER_SIZE + records.size() * ENTRY_SIZE + paths_size, '\0');
+	auto* dest = reinterpret_cast<unsigned char*>(content.data());
+	memcpy_s(dest, content.size(), MANIFEST_MAGIC, sizeof(MANIFEST_MAGIC));
+	store_le(MANIFEST_FORMAT_VERSION, dest + HEADER_VERSION_OFFSET);
+	memcpy_s(dest + HEADER_USER_ID_OFFSET, USER_ID_SIZE_BYTES, _user_id, sizeof(_user_id));
+	store_le(static_cast<uint64_t>(records.size()), dest + HEADER_COUNT_OFFSET);
+
+	auto* entry_dest = dest + HEADER_SIZE;
+	auto* paths_dest = entry_dest + records.size() * ENTRY_SIZE;
+	uint32_t path_offset = 0;
+	for (const auto& record : records) {
+		store_le(record.hash, entry_dest + ENTRY_HASH_OFFSET);
+		store_le(record.entry.stat.size, entry_dest + ENTRY_SIZE_OFFSET);
+		store_le(static_cast<uint64_t>(record.entry.stat.mtime), entry_dest + ENTRY_MTIME_OFFSET);
+		store_le(record.entry.stat.inode, entry_dest + ENTRY_INODE_OFFSET);
+		store_le(path_offset, entry_dest + ENTRY_PATH_OFFSET_OFFSET);
+		store_le(static_cast<uint32_t>(record.path.length()), entry_dest + ENTRY_PATH_LENGTH_OFFSET);
+		store_le(record.entry.crc, entry_dest + ENTRY_CRC_OFFSET);
+		std::copy(record.path.begin(), record.path.end(), paths_dest + path_offset);
+		path_offset += static_cast<uint32_t>(record.path.length());
+		entry_dest += ENTRY_SIZE;
+	}
+
+	// the records point into the loaded file - it is released only once they're copied, and before it is replaced.
+	records.clear();
+	_source.reset();
+	_data = nullptr;
+	_loaded_count = 0;
+	_loaded_paths = nullptr;
+	_loaded_paths_size = 0;
+
+	if (!AtomicFile::write(FILE_NAME, content)) {
+		throw std::runtime_error("Failed to write the sync manifest!");
+	}
+
+	_updates.clear();
+	load();
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <filesystem>
+#include "protocol.h"
+#include "util/FileStat.h"
+#include "util/FileSource.h"
+
+/// <summary>
+/// The files that were verified by the server in previous uploads - their path, stat & CRC - for incremental syncs.
+/// It is stored next to the client's info file, in a binary format that is used in place (memory mapped), so loading it
+/// takes no parsing even with millions of entries:
+/// a header, the entries sorted by their path's hash (found by binary search), and the entries' paths.
+/// </summary>
+class SyncManifest
+{
+public:
+	static const std::string FILE_NAME;
+
+	/// <summary>
+	/// The state of a file when it was last verified.
+	/// </summary>
+	struct Entry {
+		FileStat stat;
+		uint32_t crc = 0;
+	};
+
+	/// <summary>
+	/// Loads the manifest of the user. A missing or invalid manifest (or one of another user) is loaded empty.
+	/// </summary>
+	explicit SyncManifest(const unsigned char* user_id);
+
+	/// <summary>
+	/// Finds the entry of a file.
+	/// </summary>
+	/// <returns>Whether the file has an entry.</returns>
+	bool find(const std::filesystem::path& path, Entry& entry) const;
+
+	/// <summary>
+	/// Returns whether the file is unchanged since it was last verified - so it doesn't have to be uploaded.
+	/// A file whose stat changed but not it's size is checksummed: if the CRC is unchanged, the entry is updated.
+	/// </summary>
+	/// <param name="current">Set to the current stat of the file, to update the entry with once it is uploaded.</param>
+	bool is_synced(const std::filesystem::path& path, FileStat& current);
+
+	/// <summary>
+	/// Sets the entry of a file, after it was verified by the server.
+	/// </summary>
+	void update(const std::filesystem::path& path, const FileStat& stat, uint32_t crc);
+
+	/// <summary>
+	/// Returns the number of files in the manifest.
+	/// </summary>
+	size_t size() const;
+
+	/// <summary>
+	/// Saves the manifest with it's updates. The file is replaced atomically, so a failed save leaves the previous one.
+	/// </summary>
+	void save();
+
+private:
+	/// <summary>
+	/// Returns the key of a file in the manifest - it's absolute, normalized path.
+	/// </summary>
+	static std::string key_of(const std::filesystem::path& path);
+
+	/// <summary>
+	/// Returns the hash the entries are sorted by (64-bit FNV-1a).
+	/// </summary>
+	static uint64_t hash_of(const std::string& key);
+
+	/// <summary>
+	/// Maps the manifest file, and validates it.
+	/// </summary>
+	void load();
+
+	/// <summary>
+	/// Finds the entry of a key in the loaded file.
+	/// </summary>
+	bool find_loaded(const std::string& key, uint64_t hash, Entry& entry) const;
+
+	/// <summary>
+	/// Returns the data of a loaded entry.
+	/// </summary>
+	const unsigned char* loaded_entry(uint64_t index) const;
+
+	/// <summary>
+	/// Returns the path of a loaded entry - empty if it's not within the file.
+	/// </summary>
+	std::string_view loaded_path(const unsigned char* entry) const;
+
+	/// <summary>
+	/// Decodes the state of a loaded entry.
+	/// </summary>
+	static Entry decode_entry(const unsigned char* entry);
+
+	unsigned char _user_id[USER_ID_SIZE_BYTES];
+	std::unique_ptr<FileSource> _source;
+	/// <summary>
+	/// The loaded file's data - mapped by the source, or read whole into it's buffer when it can't be mapped.
+	/// </summary>
+	const unsigned char* _data = nullptr;
+	uint64_t _loaded_count = 0;
+	const unsigned char* _loaded_paths = nullptr;
+	uint64_t _loaded_paths_size = 0;
+	/// <summary>
+	/// Entries set since the file was loaded - they replace the loaded entries of the same paths.
+	/// </summary>
+	std::unordered_map<std::string, Entry> _updates;
+};
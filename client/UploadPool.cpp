@@ -0,0 +1,140 @@
+#include "UploadPool.h"
+#include <thread>
+#include <mutex>
+#include <iostream>
+#include <algorithm>
+#include <map>
+#include <deque>
+
+UploadPool::UploadPool(std::unique_ptr<Client> first_client, const std::string& host, int port, size_t connections) :
+	first_client(std::move(first_client)), host(host), port(port), connections(std::max<size_t>(connections, 1)) {}
+
+size_t UploadPool::default_connection_count() {
+	auto cores = std::thread::hardware_concurrency();
+	return cores > 0 ? cores : 1;
+}
+
+std::vector<UploadPool::UploadResult> UploadPool::upload(const std::vector<std::filesystem::path>& file_paths) {
+	std::vector<UploadResult> results(file_paths.size());
+	size_t next_file = 0;
+	std::deque<size_t> returned_files;
+	std::mutex queue_lock;
+	std::mutex output_lock;
+
+	// files put back by a failed connection are taken first.
+	auto take_file = [&](size_t& index) {
+		std::lock_guard<std::mutex> lock(queue_lock);
+		if (!returned_files.empty()) {
+			index = returned_files.front();
+			returned_files.pop_front();
+			return true;
+		}
+		index = next_file++;
+		return index < file_paths.size();
+	};
+
+	// each worker owns a connection, and takes the next pending file until none is left.
+	auto worker = [&](Client* client) {
+		std::unique_ptr<Client> extra_client;
+		try {
+			if (client == nullptr) {
+				// the first client stores the session's ticket - the extra connections neither store nor resume it, so
+				// each one exchanges an AES key of it's own.
+				extra_client = std::make_unique<Client>(host, port);
+				extra_client->set_stores_ticket(false);
+				extra_client->set_resumes_session(false);
+				extra_client->exchange_keys();
+				client = extra_client.get();
+			}
+		}
+		catch (const std::exception& ex) {
+			// the other connections will take care of the files.
+			std::lock_guard<std::mutex> lock(output_lock);
+			std::cerr << "Failed to open an extra connection: " << ex.what() << std::endl;
+			return;
+		}
+
+		// a file's result is final (and printed) only once it's checksum status was acknowledged - which is read
+		// before the next file's response, or by the flush.
+		std::map<std::filesystem::path, size_t> sent_files;
+		size_t unacknowledged = file_paths.size();
+		auto apply_acknowledgements = [&]() {
+			for (const auto& failed : client->take_failed_acknowledgements()) {
+				auto found = sent_files.find(failed.file_path);
+				if (found != sent_files.end()) {
+					results[found->second].verified = false;
+					results[found->second].error = "Not acknowledged: " + failed.error;
+				}
+			}
+		};
+		auto print_result = [&](size_t index) {
+			const auto& result = results[index];
+			std::lock_guard<std::mutex> lock(output_lock);
+			std::cout << (result.verified ? "Uploaded " : "Failed to upload ") << result.file_path.string() << std::endl;
+		};
+
+		size_t index;
+		while (take_file(index)) {
+			auto& result = results[index];
+			result.file_path = file_paths[index];
+			sent_files[result.file_path] = index;
+			try {
+				result.verified = client->send_file(result.file_path, &result.crc);
+			}
+			catch (const boost::system::system_error& ex) {
+				// the connection failed, so every file sent on it next would fail too - the file is put back for the
+				// other connections, and this one stops.
+				sent_files.erase(result.file_path);
+				result = UploadResult();
+				{
+					std::lock_guard<std::mutex> lock(queue_lock);
+					returned_files.push_back(index);
+				}
+				std::lock_guard<std::mutex> lock(output_lock);
+				std::cerr << "Connection failed: " << ex.what() << std::endl;
+				break;
+			}
+			catch (const std::exception& ex) {
+				result.error = ex.what();
+			}
+
+			apply_acknowledgements();
+			if (unacknowledged < file_paths.size()) {
+				print_result(unacknowledged);
+			}
+			unacknowledged = index;
+		}
+
+		// the server's response to the last file's checksum status is still pending.
+		try {
+			client->flush();
+		}
+		catch (const std::exception&) {
+			// the files it failed are reported by their acknowledgements.
+		}
+		apply_acknowledgements();
+		if (unacknowledged < file_paths.size()) {
+			print_result(unacknowledged);
+		}
+	};
+
+	auto worker_count = std::min(connections, std::max<size_t>(file_paths.size(), 1));
+	std::vector<std::thread> workers;
+	for (size_t i = 1; i < worker_count; i++) {
+		workers.emplace_back(worker, nullptr);
+	}
+	worker(first_client.get());
+
+	for (auto& t : workers) {
+		t.join();
+	}
+
+	// files left unhandled (e.g. all connections failed) are reported as failed.
+	for (size_t i = 0; i < file_paths.size(); i++) {
+		if (results[i].file_path.empty()) {
+			results[i].file_path = file_paths[i];
+			results[i].error = "No connection available";
+		}
+	}
+	return results;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <filesystem>
+#include "Client.h"
+
+/// <summary>
+/// Uploads a batch of files over several parallel connections.
+/// Each connection has it's own Client, session and AES key, and takes the next file from a shared queue.
+/// A connection that fails puts it's file back in the queue, and stops.
+/// </summary>
+class UploadPool
+{
+public:
+	/// <summary>
+	/// The result of a single file upload.
+	/// </summary>
+	struct UploadResult {
+		std::filesystem::path file_path;
+		bool verified = false;
+		/// <summary>
+		/// The file's CRC, once verified.
+		/// </summary>
+		uint32_t crc = 0;
+		/// <summary>
+		/// The error message, if the upload threw.
+		/// </summary>
+		std::string error;
+	};
+
+	/// <summary>
+	/// Creates a new upload pool.
+	/// </summary>
+	/// <param name="first_client">A connected & registered client, with exchanged keys. It is used as the first connection.</param>
+	/// <param name="host">The server's host name, for the extra connections.</param>
+	/// <param name="port">The server's port number, for the extra connections.</param>
+	/// <param name="connections">Maximal number of parallel connections.</param>
+	UploadPool(std::unique_ptr<Client> first_client, const std::string& host, int port, size_t connections = default_connection_count());
+
+	/// <summary>
+	/// Returns the default number of connections - the number of CPU cores.
+	/// </summary>
+	static size_t default_connection_count();
+
+	/// <summary>
+	/// Uploads all the files, and returns the result of each one, in the same order.
+	/// Extra connections are opened (and exchange keys) for this call, up to one per file.
+	/// </summary>
+	std::vector<UploadResult> upload(const std::vector<std::filesystem::path>& file_paths);
+
+private:
+	std::unique_ptr<Client> first_client;
+	std::string host;
+	int port;
+	size_t connections;
+};
+
@@ -0,0 +1,382 @@
+// Micro benchmarks for the client's hot paths.
+// Each benchmark is swept over payload sizes, and the results are printed as JSON:
+//   Maman15.Client.Bench.exe [name filter] > results.json
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+#include <functional>
+#include <boost/asio.hpp>
+#include <cryptopp/rsa.h>
+#include <cryptopp/osrng.h>
+#include <cryptopp/filters.h>
+#include "../protocol.h"
+#include "../RSAManager.h"
+#include "../EncryptedFileSender.h"
+#include "../util/CRC.h"
+#include "../util/CRCKernels.h"
+#include "../util/ChunkCompressor.h"
+#include "../util/ContentChunker.h"
+#include "../util/formats.h"
+#include "../util/Metrics.h"
+#include "../util/SocketHelper.h"
+
+using boost::asio::ip::tcp;
+
+/// <summary>
+/// Minimal time to run each benchmark for.
+/// </summary>
+static const std::chrono::milliseconds MIN_DURATION(300);
+
+struct BenchmarkResult {
+	std::string name;
+	size_t size;
+	uint64_t iterations;
+	double ns_per_op;
+	double bytes_per_sec;
+};
+
+static std::vector<BenchmarkResult> results;
+static std::string name_filter;
+
+/// <summary>
+/// Runs the operation repeatedly (after a single warm up run), and records the result.
+/// </summary>
+/// <param name="size">The payload size processed by a single operation.</param>
+static void measure(const std::string& name, size_t size, const std::function<void()>& operation) {
+	if (name.find(name_filter) == std::string::npos)
+		return;
+
+	operation();
+
+	uint64_t iterations = 0;
+	auto start = std::chrono::steady_clock::now();
+	std::chrono::steady_clock::duration elapsed;
+	do {
+		operation();
+		iterations++;
+		elapsed = std::chrono::steady_clock::now() - start;
+	} while (elapsed < MIN_DURATION);
+
+	double seconds = std::chrono::duration<double>(elapsed).count();
+	BenchmarkResult result;
+	result.name = name;
+	result.size = size;
+	result.iterations = iterations;
+	result.ns_per_op = seconds * 1e9 / iterations;
+	result.bytes_per_sec = size * iterations / seconds;
+	results.push_back(result);
+
+	std::cerr << name << " [" << size << "]: " << result.ns_per_op << " ns/op" << std::endl;
+}
+
+/// <summary>
+/// Returns deterministic pseudo-random data.
+/// </summary>
+static std::string make_payload(size_t size) {
+	std::string payload(size, '\0');
+	uint32_t state = 0x9E3779B9;
+	for (auto& c : payload) {
+		state = state * 1664525 + 1013904223;
+		c = static_cast<char>(state >> 24);
+	}
+	return payload;
+}
+
+/// <summary>
+/// A connected loopback socket pair.
+/// </summary>
+struct LoopbackPair {
+	boost::asio::io_context io_ctx;
+	tcp::socket client;
+	tcp::socket server;
+
+	LoopbackPair() : client(io_ctx), server(io_ctx) {
+		tcp::acceptor acceptor(io_ctx, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+		client.connect(acceptor.local_endpoint());
+		acceptor.accept(server);
+		SocketHelper::set_no_delay(client);
+		SocketHelper::set_no_delay(server);
+	}
+
+	/// <summary>
+	/// Sends a file through the client socket, running the io_context until it was sent.
+	/// </summary>
+	void send(EncryptedFileSender& sender) {
+		auto sent = boost::asio::co_spawn(io_ctx, sender.async_send(client), boost::asio::use_future);
+		io_ctx.restart();
+		io_ctx.run();
+		sent.get();
+	}
+};
+
+static void bench_crc() {
+	const size_t sizes[] = { 1024, 64 * 1024, 1024 * 1024, 16 * 1024 * 1024 };
+
+	for (auto size : sizes) {
+		auto payload = make_payload(size);
+		auto data = reinterpret_cast<const unsigned char*>(payload.data());
+
+		measure("crc_update", size, [&]() {
+			CRC crc;
+			crc.update(payload.data(), payload.size());
+			crc.digest();
+		});
+
+		for (int k = 0; k < CRCKernels::KernelCount; k++) {
+			auto kernel = static_cast<CRCKernels::Kernel>(k);
+			if (!CRCKernels::is_supported(kernel))
+				continue;
+			auto update = CRCKernels::get(kernel);
+			measure(std::string("crc_kernel_") + CRCKernels::name(kernel), size, [&]() {
+				update(0, data, size);
+			});
+		}
+
+		auto file_path = std::filesystem::temp_directory_path() / ("m15-bench-" + std::to_string(size));
+		std::ofstream(file_path, std::ios::binary).write(payload.data(), payload.size());
+		measure("crc_calculate", size, [&]() {
+			CRC().calculate(file_path.string());
+		});
+		std::filesystem::remove(file_path);
+	}
+}
+
+static void bench_encrypt() {
+	const size_t sizes[] = { 1024, 64 * 1024, 1024 * 1024, 16 * 1024 * 1024 };
+	LoopbackPair sockets;
+	std::string aes_key = make_payload(AES_KEY_LENGTH_BYTES);
+
+	// drain the loopback, so only the client side is measured.
+	std::thread drain([&]() {
+		std::vector<char> sink(1024 * 1024);
+		boost::system::error_code ec;
+		while (!ec) {
+			sockets.server.read_some(boost::asio::buffer(sink), ec);
+		}
+	});
+
+	for (auto size : sizes) {
+		auto file_path = std::filesystem::temp_directory_path() / ("m15-bench-" + std::to_string(size));
+		auto payload = make_payload(size);
+		std::ofstream(file_path, std::ios::binary).write(payload.data(), payload.size());
+
+		EncryptedFileSender sender(file_path, aes_key);
+		measure("aes_cbc_send", size, [&]() {
+			sockets.send(sender);
+		});
+
+		EncryptedFileSender parallel_sender(file_path, aes_key, EncryptedFileSender::generate_initial_counter());
+		measure("aes_ctr_parallel_send", size, [&]() {
+			sockets.send(parallel_sender);
+		});
+		std::filesystem::remove(file_path);
+	}
+
+	sockets.client.shutdown(tcp::socket::shutdown_send);
+	drain.join();
+}
+
+static void bench_rsa() {
+	RSAManager rsa;
+	measure("rsa_gen_key", RSA_KEY_LENGTH_BITS / 8, [&]() {
+		rsa.gen_key();
+	});
+
+	// encrypt an AES key with the public key, like the server does.
+	CryptoPP::AutoSeededRandomPool rng;
+	CryptoPP::RSA::PublicKey public_key;
+	CryptoPP::StringSource key_source(rsa.get_public_key(), true);
+	public_key.Load(key_source);
+	CryptoPP::RSAES_OAEP_SHA_Encryptor encryptor(public_key);
+
+	std::string cipher;
+	CryptoPP::StringSource ss(make_payload(AES_KEY_LENGTH_BYTES), true,
+		new CryptoPP::PK_EncryptorFilter(rng, encryptor, new CryptoPP::StringSink(cipher)));
+
+	measure("rsa_decrypt", cipher.size(), [&]() {
+		rsa.decrypt(cipher);
+	});
+}
+
+static void bench_compress() {
+	const size_t sizes[] = { 64 * 1024, 1024 * 1024, 4 * 1024 * 1024 };
+
+	for (auto size : sizes) {
+		// log-like text compresses well, while random data should be rejected by the entropy sampling.
+		std::string text;
+		for (int line = 0; text.size() < size; line++) {
+			text += "log line " + std::to_string(line) + ": status=ok latency=" + std::to_string(line % 97) + "ms\n";
+		}
+		text.resize(size);
+		auto random = make_payload(size);
+		std::vector<unsigned char> dest;
+
+		measure("chunk_compress_text", size, [&]() {
+			ChunkCompressor::compress(reinterpret_cast<const unsigned char*>(text.data()), size, dest);
+		});
+		measure("chunk_compress_random", size, [&]() {
+			ChunkCompressor::compress(reinterpret_cast<const unsigned char*>(random.data()), size, dest);
+		});
+	}
+}
+
+static void bench_content_chunker() {
+	const size_t sizes[] = { 1024 * 1024, 16 * 1024 * 1024 };
+
+	for (auto size : sizes) {
+		auto payload = make_payload(size);
+		auto data = reinterpret_cast<const unsigned char*>(payload.data());
+
+		measure("content_chunk", size, [&]() {
+			ContentChunker chunker;
+			bool is_boundary;
+			for (size_t done = 0; done < size; ) {
+				done += chunker.next(data + done, size - done, is_boundary);
+			}
+		});
+	}
+}
+
+static void bench_formats() {
+	const size_t sizes[] = { 16, 256, 4096, 64 * 1024 };
+
+	for (auto size : sizes) {
+		auto payload = make_payload(size);
+		auto encoded = Base64::encode(payload);
+		measure("base64_encode", size, [&]() {
+			Base64::encode(payload);
+		});
+		measure("base64_decode", size, [&]() {
+			Base64::decode(encoded);
+		});
+	}
+
+	auto uuid = make_payload(USER_ID_SIZE_BYTES);
+	std::ostringstream uuid_stream;
+	Uuid::write(uuid_stream, reinterpret_cast<unsigned char*>(uuid.data()), uuid.size());
+	auto uuid_hex = uuid_stream.str();
+	unsigned char parsed[USER_ID_SIZE_BYTES];
+
+	measure("uuid_parse", USER_ID_SIZE_BYTES, [&]() {
+		Uuid::parse(uuid_hex, parsed);
+	});
+	measure("uuid_write", USER_ID_SIZE_BYTES, [&]() {
+		std::ostringstream out;
+		Uuid::write(out, reinterpret_cast<unsigned char*>(uuid.data()), uuid.size());
+	});
+}
+
+static void bench_socket_framing() {
+	LoopbackPair sockets;
+
+	// a minimal server: answers every request with a response header.
+	std::thread echo([&]() {
+		try {
+			ClientRequestBase request;
+			std::vector<unsigned char> payload;
+			ServerResponseHeader response{ PROTOCOL_VERSION, ResponseCodeMessageOk, 0 };
+			while (true) {
+				SocketHelper::recieve_static(&request, sockets.server);
+				payload.resize(request.payload_size);
+				boost::asio::read(sockets.server, boost::asio::buffer(payload));
+				SocketHelper::send_static(&response, sockets.server);
+			}
+		}
+		catch (const std::exception&) {
+			// client closed the connection.
+		}
+	});
+
+	ChecksumStatusRequest request{};
+	request.payload_size = sizeof(request) - sizeof(ClientRequestBase);
+	ServerResponseHeader response;
+	measure("socket_request_roundtrip", sizeof(request) + sizeof(response), [&]() {
+		SocketHelper::send_static(&request, sockets.client);
+		SocketHelper::recieve_static(&response, sockets.client);
+	});
+
+	// the same request, as a compact message.
+	ChecksumStatusMessage message{ "report.txt" };
+	std::vector<unsigned char> compact(sizeof(ClientRequestBase));
+	WireFormat::encode(message, compact);
+	ClientRequestBase compact_header{};
+	compact_header.payload_size = static_cast<unsigned int>(compact.size() - sizeof(compact_header));
+	memcpy(compact.data(), &compact_header, sizeof(compact_header));
+	measure("socket_compact_roundtrip", compact.size() + sizeof(response), [&]() {
+		boost::asio::write(sockets.client, boost::asio::buffer(compact));
+		SocketHelper::recieve_static(&response, sockets.client);
+	});
+
+	sockets.client.shutdown(tcp::socket::shutdown_send);
+	echo.join();
+}
+
+static void bench_wire_format() {
+	// a typical small file upload request - the size of each case is it's size on the wire.
+	UploadSmallFileMessage message{};
+	message.plain_size = 4096;
+	message.content_size = 4096;
+	message.file_name = "report.txt";
+	std::vector<unsigned char> encoded;
+
+	measure("wire_encode_small_upload", WireFormat::encoded_size(message), [&]() {
+		encoded.clear();
+		WireFormat::encode(message, encoded);
+	});
+	measure("wire_decode_small_upload", encoded.size(), [&]() {
+		WireFormat::decode<UploadSmallFileMessage>(encoded.data(), encoded.size());
+	});
+}
+
+static void bench_metrics() {
+	// the cost every instrumented phase pays, so it can be kept on.
+	measure("metrics_timer", 0, [&]() {
+		Metrics::Timer timer(Metrics::PhaseChecksum, 0);
+	});
+}
+
+static void print_json(std::ostream& out) {
+	out << "{" << std::endl;
+	out << "  \"crc_kernels_valid\": " << (CRCKernels::validate() ? "true" : "false") << "," << std::endl;
+	out << "  \"crc_best_kernel\": \"" << CRCKernels::name(CRCKernels::best()) << "\"," << std::endl;
+	out << "  \"benchmarks\": [" << std::endl;
+	for (size_t i = 0; i < results.size(); i++) {
+		const auto& result = results[i];
+		out << "    {\"name\": \"" << result.name << "\", \"size\": " << result.size
+			<< ", \"iterations\": " << result.iterations
+			<< ", \"ns_per_op\": " << result.ns_per_op
+			<< ", \"bytes_per_sec\": " << result.bytes_per_sec << "}"
+			<< (i + 1 < results.size() ? "," : "") << std::endl;
+	}
+	out << "  ]" << std::endl;
+	out << "}" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+	if (argc > 1) {
+		name_filter = argv[1];
+	}
+
+	try {
+		bench_crc();
+		bench_encrypt();
+		bench_compress();
+		bench_content_chunker();
+		bench_rsa();
+		bench_formats();
+		bench_wire_format();
+		bench_metrics();
+		bench_socket_framing();
+	}
+	catch (const std::exception& ex) {
+		std::cerr << "Exception! " << ex.what() << std::endl;
+		return 1;
+	}
+
+	print_json(std::cout);
+	return 0;
+}
@@ -0,0 +1,857 @@
+// Load generator: simulates many users, each registering, exchanging keys and uploading a file on it's own connection.
+// The users arrive at random (a Poisson process of the specified rate), with file sizes drawn from a distribution,
+// and the throughput & the latency percentiles of each phase are printed as JSON:
+//   Maman15.Client.LoadGen.exe [--users=N] [--rate=R] [--sizes=4K:50,1M:40,16M:10] [--threads=T] [--seed=S]
+//       [--server=host:port | --server-version=V] > load.json
+// Without --server, the users connect to a minimal stand-in server on the loopback, that runs in the same process -
+// so no network (nor the Python server) is needed. It answers at PROTOCOL_VERSION, unless --server-version sets an
+// older one (from MIN_VERSION_PARALLEL_ENCRYPTION on). Against the Python server, each run registers new users.
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+#include <random>
+#include <mutex>
+#include <atomic>
+#include <map>
+#include <cstring>
+#include <filesystem>
+#include <boost/asio.hpp>
+#include <cryptopp/aes.h>
+#include <cryptopp/modes.h>
+#include <cryptopp/rsa.h>
+#include <cryptopp/osrng.h>
+#include <cryptopp/filters.h>
+#include <cryptopp/zinflate.h>
+#include "../protocol.h"
+#include "../Client.h"
+#include "../MeInfo.h"
+#include "../EncryptedFileSender.h"
+#include "../util/ChunkCompressor.h"
+#include "../util/CRCKernels.h"
+#include "../util/Metrics.h"
+#include "../util/SocketHelper.h"
+
+using boost::asio::ip::tcp;
+using boost::asio::awaitable;
+using boost::asio::use_awaitable;
+
+/// <summary>
+/// Size of the blocks the stand-in server receives uploaded files in.
+/// </summary>
+static const size_t STAND_IN_BLOCK_SIZE = 1024 * 1024;
+
+/// <summary>
+/// Size of the largest cipher text each user keeps in memory for upload retries - larger ones go to a temp file, so
+/// the users' memory doesn't grow with their files.
+/// </summary>
+static const size_t USER_CIPHER_CACHE_MEMORY = 256 * 1024;
+
+/// <summary>
+/// Number of failures whose errors are reported.
+/// </summary>
+static const size_t REPORTED_ERROR_COUNT = 5;
+
+struct FileSize {
+	uint64_t size;
+	double weight;
+};
+
+struct LoadOptions {
+	size_t users = 100;
+	/// <summary>
+	/// Users arriving per second, on average. 0 starts all of them at once.
+	/// </summary>
+	double rate = 20;
+	std::vector<FileSize> sizes = { { 4 * 1024, 50 }, { 1024 * 1024, 40 }, { 16 * 1024 * 1024, 10 } };
+	size_t threads = std::thread::hardware_concurrency();
+	uint64_t seed = 1;
+	/// <summary>
+	/// The server to load. Empty for the stand-in server.
+	/// </summary>
+	std::string host;
+	int port = 0;
+	/// <summary>
+	/// The protocol version the stand-in server answers at.
+	/// </summary>
+	unsigned char server_version = PROTOCOL_VERSION;
+};
+
+struct LoadStats {
+	std::atomic<uint64_t> succeeded{ 0 };
+	std::atomic<uint64_t> failed{ 0 };
+	std::atomic<uint64_t> uploaded_bytes{ 0 };
+	/// <summary>
+	/// The time each user took, from connecting to the server's last response.
+	/// </summary>
+	LatencyHistogram sessions;
+	std::mutex errors_lock;
+	std::vector<std::string> errors;
+};
+
+/// <summary>
+/// A minimal server for the load generator: it answers the requests of the register, key exchange and upload
+/// workflow like the Python server does, but keeps nothing - uploaded files are decrypted only for their CRC, and the
+/// chunks of a file are held only until it's assembled.
+/// It answers at PROTOCOL_VERSION by default, so the client takes the upload paths it takes against an up to date
+/// server - an older version (from MIN_VERSION_PARALLEL_ENCRYPTION on) runs the paths of older servers.
+/// The server runs on threads of it's own, and records no metrics, so the client's metrics are the client's only.
+/// </summary>
+class StandInServer
+{
+public:
+	StandInServer(size_t threads, unsigned char version) :
+		_acceptor(_io_ctx, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0)), _version(version) {
+		boost::asio::co_spawn(_io_ctx, accept_loop(), boost::asio::detached);
+		for (size_t i = 0; i < threads; i++) {
+			_threads.emplace_back([this]() { _io_ctx.run(); });
+		}
+	}
+
+	~StandInServer() {
+		_io_ctx.stop();
+		for (auto& thread : _threads) {
+			thread.join();
+		}
+	}
+
+	unsigned short port() const {
+		return _acceptor.local_endpoint().port();
+	}
+
+private:
+	boost::asio::io_context _io_ctx;
+	tcp::acceptor _acceptor;
+	std::vector<std::thread> _threads;
+	/// <summary>
+	/// The protocol version the server answers at.
+	/// </summary>
+	unsigned char _version;
+
+	/// <summary>
+	/// The state of a single connection - it's user, and the chunks of the file being uploaded.
+	/// </summary>
+	struct Session {
+		unsigned char client_id[USER_ID_SIZE_BYTES] = { 0 };
+		std::string aes_key;
+		/// <summary>
+		/// The chunked upload in progress, and it's plain chunks by index.
+		/// </summary>
+		std::string upload_id;
+		std::string upload_file_name;
+		uint64_t upload_file_size = 0;
+		unsigned int upload_chunk_size = 0;
+		std::map<unsigned int, std::vector<unsigned char>> upload_chunks;
+		/// <summary>
+		/// The plain chunks stored for the file being deduplicated, by their hash.
+		/// </summary>
+		std::map<std::string, std::vector<unsigned char>> stored_chunks;
+	};
+
+	awaitable<void> accept_loop() {
+		while (true) {
+			auto socket = co_await _acceptor.async_accept(use_awaitable);
+			SocketHelper::set_no_delay(socket);
+			boost::asio::co_spawn(_io_ctx, serve(std::move(socket)), boost::asio::detached);
+		}
+	}
+
+	bool is_compact() const {
+		return _version >= MIN_VERSION_COMPACT_FRAMING;
+	}
+
+	/// <summary>
+	/// Sends a response header, followed by it's payload.
+	/// </summary>
+	awaitable<void> async_respond(tcp::socket& socket, ServerResponseCode code, const void* payload, size_t size) {
+		ServerResponseHeader header{ _version, code, static_cast<unsigned int>(size) };
+		std::vector<unsigned char> response(sizeof(header) + size);
+		memcpy_s(response.data(), response.size(), &header, sizeof(header));
+		if (size > 0) {
+			memcpy_s(response.data() + sizeof(header), size, payload, size);
+		}
+		co_await boost::asio::async_write(socket, boost::asio::buffer(response), use_awaitable);
+	}
+
+	/// <summary>
+	/// Sends a response whose payload is a compact message.
+	/// </summary>
+	template <class T>
+	awaitable<void> async_respond_message(tcp::socket& socket, ServerResponseCode code, const T& message) {
+		std::vector<unsigned char> payload;
+		WireFormat::encode(message, payload);
+		co_await async_respond(socket, code, payload.data(), payload.size());
+	}
+
+	/// <summary>
+	/// Receives the payload of a fixed request, after it's header, into the request.
+	/// </summary>
+	template <class T>
+	static awaitable<void> async_receive_request(tcp::socket& socket, const ClientRequestBase& header, T& request) {
+		std::vector<char> payload(header.payload_size);
+		co_await boost::asio::async_read(socket, boost::asio::buffer(payload), use_awaitable);
+		auto fields = reinterpret_cast<char*>(&request) + sizeof(ClientRequestBase);
+		auto size = sizeof(T) - sizeof(ClientRequestBase);
+		if (payload.size() < size) {
+			size = payload.size();
+		}
+		memcpy_s(fields, sizeof(T) - sizeof(ClientRequestBase), payload.data(), size);
+	}
+
+	/// <summary>
+	/// Receives the compact message of a request, after it's header.
+	/// </summary>
+	template <class T>
+	static awaitable<T> async_receive_message(tcp::socket& socket, const ClientRequestBase& header) {
+		std::vector<unsigned char> payload(header.payload_size);
+		co_await boost::asio::async_read(socket, boost::asio::buffer(payload), use_awaitable);
+		co_return WireFormat::decode<T>(payload.data(), payload.size());
+	}
+
+	/// <summary>
+	/// Receives the content that follows a request.
+	/// </summary>
+	static awaitable<std::vector<unsigned char>> async_receive_content(tcp::socket& socket, size_t size) {
+		std::vector<unsigned char> content(size);
+		co_await boost::asio::async_read(socket, boost::asio::buffer(content), use_awaitable);
+		co_return content;
+	}
+
+	/// <summary>
+	/// Encrypts a new AES key with the client's public RSA key.
+	/// </summary>
+	static std::string encrypt_key(CryptoPP::AutoSeededRandomPool& rng, const KeyExchangeRequestType& request,
+		const std::string& aes_key) {
+		CryptoPP::RSA::PublicKey public_key;
+		CryptoPP::StringSource key_source(std::string(request.public_key, sizeof(request.public_key)), true);
+		public_key.Load(key_source);
+		CryptoPP::RSAES_OAEP_SHA_Encryptor encryptor(public_key);
+
+		std::string cipher;
+		CryptoPP::StringSource ss(aes_key, true,
+			new CryptoPP::PK_EncryptorFilter(rng, encryptor, new CryptoPP::StringSink(cipher)));
+		return cipher;
+	}
+
+	/// <summary>
+	/// Decrypts a chunk encrypted with AES-CTR at the specified offset of the key stream, and decompresses it.
+	/// </summary>
+	static std::vector<unsigned char> open_chunk(const Session& session, const unsigned char* initial_counter, uint64_t offset,
+		unsigned char compression, const std::vector<unsigned char>& content) {
+		std::vector<unsigned char> plain(content.size());
+		EncryptedFileSender::encrypt_ctr_at(session.aes_key, std::string(reinterpret_cast<const char*>(initial_counter), CTR_COUNTER_SIZE_BYTES),
+			offset, content.data(), plain.data(), plain.size());
+		if (compression == ChunkCompressor::MethodNone) {
+			return plain;
+		}
+
+		std::string decompressed;
+		CryptoPP::ArraySource source(plain.data(), plain.size(), true, new CryptoPP::Inflator(new CryptoPP::StringSink(decompressed)));
+		return std::vector<unsigned char>(decompressed.begin(), decompressed.end());
+	}
+
+	/// <summary>
+	/// Finishes a CRC calculated like CRC::digest, but without recording metrics - the file's length is appended to it.
+	/// </summary>
+	static uint32_t finish_crc(uint32_t crc, uint64_t length) {
+		for (uint64_t n = length; n; n >>= 8) {
+			unsigned char c = n & 0xff;
+			crc = CRCKernels::scalar(crc, &c, 1);
+		}
+		return ~crc;
+	}
+
+	/// <summary>
+	/// Returns the CRC of a file made of the chunks, in order.
+	/// </summary>
+	static uint32_t chunks_crc(const std::vector<const std::vector<unsigned char>*>& chunks) {
+		auto update = CRCKernels::get(CRCKernels::best());
+		uint32_t crc = 0;
+		uint64_t length = 0;
+		for (const std::vector<unsigned char>* chunk : chunks) {
+			crc = update(crc, chunk->data(), chunk->size());
+			length += chunk->size();
+		}
+		return finish_crc(crc, length);
+	}
+
+	/// <summary>
+	/// Receives a whole file, encrypted with AES-CTR, and returns it's CRC.
+	/// </summary>
+	static awaitable<uint32_t> async_receive_file(tcp::socket& socket, const unsigned char* initial_counter, uint64_t content_size,
+		const std::string& aes_key) {
+		CryptoPP::CTR_Mode<CryptoPP::AES>::Encryption cipher;
+		cipher.SetKeyWithIV(reinterpret_cast<const CryptoPP::byte*>(aes_key.data()), aes_key.size(),
+			initial_counter, CTR_COUNTER_SIZE_BYTES);
+		auto update = CRCKernels::get(CRCKernels::best());
+
+		uint32_t crc = 0;
+		std::vector<CryptoPP::byte> block(STAND_IN_BLOCK_SIZE);
+		uint64_t left = content_size;
+		while (left > 0) {
+			auto length = static_cast<size_t>(left < block.size() ? left : block.size());
+			co_await boost::asio::async_read(socket, boost::asio::buffer(block.data(), length), use_awaitable);
+			cipher.ProcessData(block.data(), block.data(), length);
+			crc = update(crc, block.data(), length);
+			left -= length;
+		}
+		co_return finish_crc(crc, content_size);
+	}
+
+	/// <summary>
+	/// Answers an upload with the file's CRC.
+	/// </summary>
+	awaitable<void> async_respond_uploaded(tcp::socket& socket, const Session& session, uint64_t content_size,
+		const std::string& file_name, uint32_t checksum) {
+		if (is_compact()) {
+			FileUploadedMessage message{ checksum };
+			co_await async_respond_message(socket, ServerResponseCode::ResponseCodeFileUploaded, message);
+			co_return;
+		}
+
+		FileUploadSuccess response{};
+		memcpy_s(response.client_id, sizeof(response.client_id), session.client_id, sizeof(session.client_id));
+		response.content_size = static_cast<unsigned int>(content_size);
+		strcpy_s(response.file_name, sizeof(response.file_name), file_name.c_str());
+		response.checksum = checksum;
+		co_await async_respond(socket, ServerResponseCode::ResponseCodeFileUploaded, &response, sizeof(response));
+	}
+
+	/// <summary>
+	/// Answers a chunked upload with the chunks it holds.
+	/// </summary>
+	awaitable<void> async_respond_upload_status(tcp::socket& socket, const Session& session) {
+		auto chunk_count = static_cast<unsigned int>((session.upload_file_size + session.upload_chunk_size - 1) / session.upload_chunk_size);
+		std::vector<unsigned char> response(sizeof(UploadStatus) + (chunk_count + 7) / 8);
+		auto status = reinterpret_cast<UploadStatus*>(response.data());
+		memcpy_s(status->client_id, sizeof(status->client_id), session.client_id, sizeof(session.client_id));
+		memcpy_s(status->upload_id, sizeof(status->upload_id), session.upload_id.data(), session.upload_id.size());
+		status->chunk_count = chunk_count;
+		status->held_count = static_cast<unsigned int>(session.upload_chunks.size());
+		for (const auto& chunk : session.upload_chunks) {
+			response[sizeof(UploadStatus) + chunk.first / 8] |= 1 << (chunk.first % 8);
+		}
+		co_await async_respond(socket, ServerResponseCode::ResponseCodeUploadStatus, response.data(), response.size());
+	}
+
+	/// <summary>
+	/// Answers a deduplicated upload with which of the chunks the server holds.
+	/// </summary>
+	awaitable<void> async_respond_chunks_held(tcp::socket& socket, const Session& session, const std::vector<std::string>& hashes) {
+		ChunksHeldMessage message{ static_cast<uint32_t>(hashes.size()), 0, std::vector<unsigned char>((hashes.size() + 7) / 8) };
+		for (size_t i = 0; i < hashes.size(); i++) {
+			if (session.stored_chunks.count(hashes[i]) > 0) {
+				message.held[i / 8] |= 1 << (i % 8);
+				message.held_count++;
+			}
+		}
+		if (is_compact()) {
+			co_await async_respond_message(socket, ServerResponseCode::ResponseCodeChunksHeld, message);
+			co_return;
+		}
+
+		std::vector<unsigned char> response(sizeof(ChunksHeld) + message.held.size());
+		auto held = reinterpret_cast<ChunksHeld*>(response.data());
+		memcpy_s(held->client_id, sizeof(held->client_id), session.client_id, sizeof(session.client_id));
+		held->chunk_count = message.chunk_count;
+		held->held_count = message.held_count;
+		memcpy_s(response.data() + sizeof(ChunksHeld), message.held.size(), message.held.data(), message.held.size());
+		co_await async_respond(socket, ServerResponseCode::ResponseCodeChunksHeld, response.data(), response.size());
+	}
+
+	/// <summary>
+	/// Receives the chunk hashes that follow a query or an assemble request.
+	/// </summary>
+	static awaitable<std::vector<std::string>> async_receive_hashes(tcp::socket& socket, size_t count) {
+		auto content = co_await async_receive_content(socket, count * CHUNK_HASH_SIZE_BYTES);
+		std::vector<std::string> hashes;
+		for (size_t i = 0; i < count; i++) {
+			hashes.emplace_back(reinterpret_cast<const char*>(content.data()) + i * CHUNK_HASH_SIZE_BYTES, CHUNK_HASH_SIZE_BYTES);
+		}
+		co_return hashes;
+	}
+
+	awaitable<void> serve(tcp::socket socket) {
+		CryptoPP::AutoSeededRandomPool rng;
+		Session session;
+
+		try {
+			while (true) {
+				ClientRequestBase header;
+				co_await boost::asio::async_read(socket, boost::asio::buffer(&header, sizeof(header)), use_awaitable);
+
+				switch (header.code) {
+				case ClientRequestsCode::RequestCodeRegister: {
+					RegisterRequestType request{};
+					co_await async_receive_request(socket, header, request);
+					rng.GenerateBlock(session.client_id, sizeof(session.client_id));
+					RegisterSuccess response;
+					memcpy_s(response.client_id, sizeof(response.client_id), session.client_id, sizeof(session.client_id));
+					co_await async_respond(socket, ServerResponseCode::ResponseCodeRegisterSuccess, &response, sizeof(response));
+					break;
+				}
+				case ClientRequestsCode::RequestCodeKeyExchange: {
+					KeyExchangeRequestType request{};
+					co_await async_receive_request(socket, header, request);
+					session.aes_key.assign(AES_KEY_LENGTH_BYTES, '\0');
+					rng.GenerateBlock(reinterpret_cast<CryptoPP::byte*>(session.aes_key.data()), session.aes_key.size());
+					auto cipher = encrypt_key(rng, request, session.aes_key);
+
+					std::vector<unsigned char> response(sizeof(KeyExchangeSuccess) + cipher.size());
+					memcpy_s(response.data(), response.size(), session.client_id, sizeof(session.client_id));
+					memcpy_s(response.data() + sizeof(KeyExchangeSuccess), cipher.size(), cipher.data(), cipher.size());
+					co_await async_respond(socket, ServerResponseCode::ResponseCodeExchangeAes, response.data(), response.size());
+					break;
+				}
+				case ClientRequestsCode::RequestCodeUploadFileCtr: {
+					if (_version >= MIN_VERSION_LARGE_FILES) {
+						auto request = co_await async_receive_message<UploadFileMessage>(socket, header);
+						auto checksum = co_await async_receive_file(socket, request.initial_counter.data(), request.content_size, session.aes_key);
+						co_await async_respond_uploaded(socket, session, request.content_size, request.file_name, checksum);
+						break;
+					}
+
+					SendFileCtrRequestType request{};
+					co_await async_receive_request(socket, header, request);
+					auto checksum = co_await async_receive_file(socket, request.initial_counter, request.content_size, session.aes_key);
+					std::string file_name(request.file_name, strnlen(request.file_name, sizeof(request.file_name)));
+					co_await async_respond_uploaded(socket, session, request.content_size, file_name, checksum);
+					break;
+				}
+				case ClientRequestsCode::RequestCodeUploadSmallFile: {
+					auto request = co_await async_receive_message<UploadSmallFileMessage>(socket, header);
+					auto content = co_await async_receive_content(socket, request.content_size);
+					auto plain = open_chunk(session, request.initial_counter.data(), 0, request.compression, content);
+					std::vector<const std::vector<unsigned char>*> chunks = { &plain };
+					co_await async_respond_uploaded(socket, session, request.plain_size, request.file_name, chunks_crc(chunks));
+					break;
+				}
+				case ClientRequestsCode::RequestCodeBeginChunkedUpload: {
+					BeginChunkedUploadRequest request{};
+					co_await async_receive_request(socket, header, request);
+					std::string upload_id(reinterpret_cast<const char*>(request.upload_id), sizeof(request.upload_id));
+					if (upload_id != session.upload_id) {
+						// a single upload is held at a time - a new one drops the previous one's chunks.
+						session.upload_id = upload_id;
+						session.upload_file_name.assign(request.file_name, strnlen(request.file_name, sizeof(request.file_name)));
+						session.upload_file_size = request.file_size;
+						session.upload_chunk_size = request.chunk_size;
+						session.upload_chunks.clear();
+					}
+					co_await async_respond_upload_status(socket, session);
+					break;
+				}
+				case ClientRequestsCode::RequestCodeUploadChunk:
+				case ClientRequestsCode::RequestCodeUploadCompressedChunk: {
+					// an uncompressed chunk's request is shorter - the compression fields are left zero.
+					UploadCompressedChunkRequest request{};
+					co_await async_receive_request(socket, header, request);
+					auto content = co_await async_receive_content(socket, request.content_size);
+					auto offset = static_cast<uint64_t>(request.chunk_index) * session.upload_chunk_size;
+					session.upload_chunks[request.chunk_index] = open_chunk(session, request.initial_counter, offset, request.compression, content);
+					break;
+				}
+				case ClientRequestsCode::RequestCodeFinishChunkedUpload: {
+					FinishChunkedUploadRequest request{};
+					co_await async_receive_request(socket, header, request);
+					auto chunk_count = (session.upload_file_size + session.upload_chunk_size - 1) / session.upload_chunk_size;
+					if (session.upload_chunks.size() < chunk_count) {
+						co_await async_respond_upload_status(socket, session);
+						break;
+					}
+
+					std::vector<const std::vector<unsigned char>*> chunks;
+					for (const auto& chunk : session.upload_chunks) {
+						chunks.push_back(&chunk.second);
+					}
+					auto checksum = chunks_crc(chunks);
+					session.upload_id.clear();
+					session.upload_chunks.clear();
+					co_await async_respond_uploaded(socket, session, session.upload_file_size, session.upload_file_name, checksum);
+					break;
+				}
+				case ClientRequestsCode::RequestCodeQueryChunks: {
+					uint32_t chunk_count = 0;
+					if (is_compact()) {
+						chunk_count = (co_await async_receive_message<QueryChunksMessage>(socket, header)).chunk_count;
+					}
+					else {
+						QueryChunksRequest request{};
+						co_await async_receive_request(socket, header, request);
+						chunk_count = request.chunk_count;
+					}
+					auto hashes = co_await async_receive_hashes(socket, chunk_count);
+					co_await async_respond_chunks_held(socket, session, hashes);
+					break;
+				}
+				case ClientRequestsCode::RequestCodeStoreChunk: {
+					StoreChunkMessage request{};
+					if (is_compact()) {
+						request = co_await async_receive_message<StoreChunkMessage>(socket, header);
+					}
+					else {
+						StoreChunkRequest fixed{};
+						co_await async_receive_request(socket, header, fixed);
+						std::copy(std::begin(fixed.chunk_hash), std::end(fixed.chunk_hash), request.chunk_hash.begin());
+						request.offset = fixed.offset;
+						std::copy(std::begin(fixed.initial_counter), std::end(fixed.initial_counter), request.initial_counter.begin());
+						request.compression = fixed.compression;
+						request.plain_size = fixed.plain_size;
+						request.content_size = fixed.content_size;
+					}
+					auto content = co_await async_receive_content(socket, request.content_size);
+					std::string hash(request.chunk_hash.begin(), request.chunk_hash.end());
+					session.stored_chunks[hash] = open_chunk(session, request.initial_counter.data(), request.offset, request.compression, content);
+					break;
+				}
+				case ClientRequestsCode::RequestCodeAssembleFile: {
+					uint64_t file_size = 0;
+					uint32_t chunk_count = 0;
+					std::string file_name;
+					if (is_compact()) {
+						auto request = co_await async_receive_message<AssembleFileMessage>(socket, header);
+						file_size = request.file_size;
+						chunk_count = request.chunk_count;
+						file_name = request.file_name;
+					}
+					else {
+						AssembleFileRequest request{};
+						co_await async_receive_request(socket, header, request);
+						file_size = request.file_size;
+						chunk_count = request.chunk_count;
+						file_name.assign(request.file_name, strnlen(request.file_name, sizeof(request.file_name)));
+					}
+					auto hashes = co_await async_receive_hashes(socket, chunk_count);
+
+					std::vector<const std::vector<unsigned char>*> chunks;
+					for (const auto& hash : hashes) {
+						auto chunk = session.stored_chunks.find(hash);
+						if (chunk == session.stored_chunks.end()) {
+							break;
+						}
+						chunks.push_back(&chunk->second);
+					}
+					if (chunks.size() < hashes.size()) {
+						co_await async_respond_chunks_held(socket, session, hashes);
+						break;
+					}
+
+					// the stand-in keeps no files, so the chunks are dropped once the file is assembled.
+					auto checksum = chunks_crc(chunks);
+					session.stored_chunks.clear();
+					co_await async_respond_uploaded(socket, session, file_size, file_name, checksum);
+					break;
+				}
+				case ClientRequestsCode::RequestCodeValidChecksum:
+				case ClientRequestsCode::RequestCodeInvalidChecksumRetry:
+				case ClientRequestsCode::RequestCodeInvalidChecksumAbort: {
+					// the fixed request & the compact message are both skipped the same way.
+					ChecksumStatusRequest request{};
+					co_await async_receive_request(socket, header, request);
+					co_await async_respond(socket, ServerResponseCode::ResponseCodeMessageOk, nullptr, 0);
+					break;
+				}
+				default:
+					// the workflow sends nothing else - a user with in-memory data neither stores nor resumes tickets.
+					co_await async_respond(socket, ServerResponseCode::ResponseCodeServerError, nullptr, 0);
+					co_return;
+				}
+			}
+		}
+		catch (const boost::system::system_error&) {
+			// the client disconnected.
+		}
+	}
+};
+
+/// <summary>
+/// Parses a size, with an optional K, M or G suffix.
+/// </summary>
+static uint64_t parse_size(const std::string& text) {
+	size_t end = 0;
+	uint64_t size = std::stoull(text, &end);
+	auto suffix = text.substr(end);
+	if (suffix == "K")
+		size *= 1024;
+	else if (suffix == "M")
+		size *= 1024 * 1024;
+	else if (suffix == "G")
+		size *= 1024ULL * 1024 * 1024;
+	else if (!suffix.empty())
+		throw std::invalid_argument("Unknown size suffix: " + text);
+	return size;
+}
+
+/// <summary>
+/// Parses a file size distribution - comma separated sizes, each with a relative weight (size:weight).
+/// </summary>
+static std::vector<FileSize> parse_sizes(const std::string& text) {
+	std::vector<FileSize> sizes;
+	std::istringstream items(text);
+	std::string item;
+	while (std::getline(items, item, ',')) {
+		auto separator = item.find(':');
+		FileSize size;
+		size.size = parse_size(item.substr(0, separator));
+		size.weight = separator == std::string::npos ? 1 : std::stod(item.substr(separator + 1));
+		sizes.push_back(size);
+	}
+	if (sizes.empty()) {
+		throw std::invalid_argument("No file sizes specified");
+	}
+	return sizes;
+}
+
+static LoadOptions parse_options(int argc, char* argv[]) {
+	LoadOptions options;
+	for (int i = 1; i < argc; i++) {
+		std::string argument = argv[i];
+		auto separator = argument.find('=');
+		auto name = argument.substr(0, separator);
+		auto value = separator == std::string::npos ? "" : argument.substr(separator + 1);
+
+		if (name == "--users")
+			options.users = std::stoul(value);
+		else if (name == "--rate")
+			options.rate = std::stod(value);
+		else if (name == "--sizes")
+			options.sizes = parse_sizes(value);
+		else if (name == "--threads")
+			options.threads = std::stoul(value);
+		else if (name == "--seed")
+			options.seed = std::stoull(value);
+		else if (name == "--server-version") {
+			auto version = std::stoi(value);
+			if (version < MIN_VERSION_PARALLEL_ENCRYPTION || version > PROTOCOL_VERSION)
+				throw std::invalid_argument("Server version must be " + std::to_string(MIN_VERSION_PARALLEL_ENCRYPTION) + " to " +
+					std::to_string(PROTOCOL_VERSION) + " - " + value);
+			options.server_version = static_cast<unsigned char>(version);
+		}
+		else if (name == "--server") {
+			auto port_separator = value.rfind(':');
+			if (port_separator == std::string::npos)
+				throw std::invalid_argument("Server must be host:port - " + value);
+			options.host = value.substr(0, port_separator);
+			options.port = std::stoi(value.substr(port_separator + 1));
+		}
+		else
+			throw std::invalid_argument("Unknown argument: " + argument);
+	}
+	if (options.threads == 0) {
+		options.threads = 1;
+	}
+	return options;
+}
+
+/// <summary>
+/// Writes a file of deterministic pseudo-random data, for each of the sizes.
+/// </summary>
+static std::vector<std::filesystem::path> make_files(const std::filesystem::path& directory, const std::vector<FileSize>& sizes) {
+	std::vector<std::filesystem::path> paths;
+	std::vector<char> block(1024 * 1024);
+	uint32_t state = 0x9E3779B9;
+	for (const auto& size : sizes) {
+		auto path = directory / ("load-" + std::to_string(size.size) + ".bin");
+		std::ofstream file(path, std::ios::binary);
+		for (uint64_t left = size.size; left > 0; ) {
+			auto length = static_cast<size_t>(left < block.size() ? left : block.size());
+			for (size_t i = 0; i < length; i++) {
+				state = state * 1664525 + 1013904223;
+				block[i] = static_cast<char>(state >> 24);
+			}
+			file.write(block.data(), length);
+			left -= length;
+		}
+		if (!file.good()) {
+			throw std::runtime_error("Failed to write load file: " + path.string());
+		}
+		paths.push_back(path);
+	}
+	return paths;
+}
+
+/// <summary>
+/// Runs a single user's workflow on it's own connection, with in-memory user data.
+/// </summary>
+static awaitable<void> run_user(boost::asio::io_context& io_ctx, const LoadOptions& options, std::string user_name,
+	std::filesystem::path file_path, LoadStats& stats) {
+	auto start = std::chrono::steady_clock::now();
+	try {
+		Client client(io_ctx, MeInfo(false));
+		client.set_cipher_cache_memory(USER_CIPHER_CACHE_MEMORY);
+		co_await client.async_connect(options.host, options.port);
+		auto registered = co_await client.async_register_user(user_name);
+		if (!registered) {
+			throw std::runtime_error("Registration of " + user_name + " failed");
+		}
+		co_await client.async_exchange_keys();
+		auto verified = co_await client.async_send_file(file_path);
+		co_await client.async_flush();
+		auto failed_acknowledgements = client.take_failed_acknowledgements();
+		if (!failed_acknowledgements.empty()) {
+			throw std::runtime_error("Upload of " + file_path.filename().string() + " was not acknowledged: " +
+				failed_acknowledgements.front().error);
+		}
+		if (!verified) {
+			throw std::runtime_error("Upload of " + file_path.filename().string() + " was not verified");
+		}
+
+		stats.sessions.record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+		stats.uploaded_bytes += std::filesystem::file_size(file_path);
+		stats.succeeded++;
+	}
+	catch (const std::exception& ex) {
+		stats.failed++;
+		std::lock_guard<std::mutex> guard(stats.errors_lock);
+		if (stats.errors.size() < REPORTED_ERROR_COUNT) {
+			stats.errors.push_back(ex.what());
+		}
+	}
+}
+
+/// <summary>
+/// Starts the users at the arrival rate - the gaps between them are exponentially distributed, and are measured from
+/// the previous arrival's schedule (not from when it started), so a slow start doesn't lower the rate.
+/// </summary>
+static awaitable<void> run_arrivals(boost::asio::io_context& io_ctx, const LoadOptions& options,
+	const std::vector<std::filesystem::path>& files, LoadStats& stats) {
+	std::mt19937_64 random(options.seed);
+	std::vector<double> weights;
+	for (const auto& size : options.sizes) {
+		weights.push_back(size.weight);
+	}
+	std::discrete_distribution<size_t> pick_file(weights.begin(), weights.end());
+	std::exponential_distribution<double> gap(options.rate > 0 ? options.rate : 1);
+	auto run_id = std::to_string(std::random_device()());
+
+	boost::asio::steady_timer timer(io_ctx);
+	auto next_arrival = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < options.users; i++) {
+		if (options.rate > 0 && i > 0) {
+			next_arrival += std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(gap(random)));
+			timer.expires_at(next_arrival);
+			co_await timer.async_wait(use_awaitable);
+		}
+
+		auto user_name = "loadgen-" + run_id + "-" + std::to_string(i);
+		auto user = run_user(io_ctx, options, user_name, files[pick_file(random)], stats);
+		boost::asio::co_spawn(io_ctx, std::move(user), boost::asio::detached);
+	}
+}
+
+/// <summary>
+/// Writes the percentiles of a histogram of durations, in milliseconds.
+/// </summary>
+static void print_latencies(std::ostream& out, const LatencyHistogram& durations) {
+	out << "{\"count\": " << durations.count()
+		<< ", \"p50_ms\": " << durations.percentile(50) / 1e6
+		<< ", \"p99_ms\": " << durations.percentile(99) / 1e6
+		<< ", \"p999_ms\": " << durations.percentile(99.9) / 1e6
+		<< ", \"max_ms\": " << durations.max() / 1e6 << "}";
+}
+
+static std::string json_string(const std::string& text) {
+	std::string quoted = "\"";
+	for (auto c : text) {
+		if (c == '"' || c == '\\')
+			quoted += '\\';
+		quoted += (c == '\n' || c == '\r') ? ' ' : c;
+	}
+	return quoted + "\"";
+}
+
+static void print_json(std::ostream& out, const LoadOptions& options, LoadStats& stats, double seconds) {
+	out << "{" << std::endl;
+	out << "  \"server\": " << json_string(options.host.empty() ? "stand-in v" + std::to_string(options.server_version) : options.host + ":" + std::to_string(options.port)) << "," << std::endl;
+	out << "  \"users\": " << options.users << "," << std::endl;
+	out << "  \"rate\": " << options.rate << "," << std::endl;
+	out << "  \"threads\": " << options.threads << "," << std::endl;
+	out << "  \"succeeded\": " << stats.succeeded << "," << std::endl;
+	out << "  \"failed\": " << stats.failed << "," << std::endl;
+	out << "  \"duration_sec\": " << seconds << "," << std::endl;
+	out << "  \"users_per_sec\": " << stats.succeeded / seconds << "," << std::endl;
+	out << "  \"bytes_per_sec\": " << stats.uploaded_bytes / seconds << "," << std::endl;
+	out << "  \"session\": ";
+	print_latencies(out, stats.sessions);
+	out << "," << std::endl;
+
+	out << "  \"phases\": {" << std::endl;
+	bool first = true;
+	for (int i = 0; i < Metrics::PhaseCount; i++) {
+		auto phase = static_cast<Metrics::Phase>(i);
+		if (Metrics::durations(phase).count() == 0)
+			continue;
+		out << (first ? "" : ",\n") << "    \"" << Metrics::name(phase) << "\": ";
+		print_latencies(out, Metrics::durations(phase));
+		first = false;
+	}
+	out << std::endl << "  }," << std::endl;
+
+	out << "  \"errors\": [";
+	for (size_t i = 0; i < stats.errors.size(); i++) {
+		out << (i > 0 ? ", " : "") << json_string(stats.errors[i]);
+	}
+	out << "]" << std::endl;
+	out << "}" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+	LoadOptions options;
+	try {
+		options = parse_options(argc, argv);
+	}
+	catch (const std::exception& ex) {
+		std::cerr << ex.what() << std::endl;
+		std::cerr << "Usage: " << argv[0] << " [--users=N] [--rate=R] [--sizes=4K:50,1M:40,16M:10] [--threads=T]"
+			<< " [--seed=S] [--server=host:port | --server-version=V]" << std::endl;
+		return 1;
+	}
+
+	auto directory = std::filesystem::temp_directory_path() / ("m15-loadgen-" + std::to_string(options.seed));
+	LoadStats stats;
+	double seconds = 0;
+	try {
+		std::filesystem::create_directories(directory);
+		auto files = make_files(directory, options.sizes);
+
+		// the stand-in server gets threads of it's own, so it doesn't delay the users it serves.
+		std::unique_ptr<StandInServer> stand_in;
+		if (options.host.empty()) {
+			stand_in = std::make_unique<StandInServer>(options.threads, options.server_version);
+			options.host = "127.0.0.1";
+			options.port = stand_in->port();
+		}
+
+		std::cerr << "Running " << options.users << " users against " << options.host << ":" << options.port << std::endl;
+		boost::asio::io_context io_ctx;
+		auto start = std::chrono::steady_clock::now();
+		auto arrivals = run_arrivals(io_ctx, options, files, stats);
+		boost::asio::co_spawn(io_ctx, std::move(arrivals), boost::asio::detached);
+
+		std::vector<std::thread> threads;
+		for (size_t i = 1; i < options.threads; i++) {
+			threads.emplace_back([&io_ctx]() { io_ctx.run(); });
+		}
+		io_ctx.run();
+		for (auto& thread : threads) {
+			thread.join();
+		}
+		seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		if (stand_in) {
+			options.host.clear();
+		}
+	}
+	catch (const std::exception& ex) {
+		std::cerr << "Exception! " << ex.what() << std::endl;
+		std::filesystem::remove_all(directory);
+		return 1;
+	}
+	std::filesystem::remove_all(directory);
+
+	print_json(std::cout, options, stats, seconds);
+	return stats.failed > 0 ? 1 : 0;
+}
@@ -1,6 +1,62 @@
 #include <iostream>
 #include <fstream>
+#include <vector>
+#include <map>
+#include <thread>
+#include <csignal>
+#include <boost/asio.hpp>
 #include "Client.h"
+#include "UploadPool.h"
+#include "SyncManifest.h"
+#include "util/Metrics.h"
+#include "util/Trace.h"
+#include "util/Connector.h"
+
+#ifdef _WIN32
+/// <summary>
+/// The signal that writes the metrics on demand - Ctrl+Break, as Windows has no user signals.
+/// </summary>
+static const int METRICS_DUMP_SIGNAL = SIGBREAK;
+#else
+/// <summary>
+/// The signal that writes the metrics on demand, e.g. kill -USR1 &lt;pid&gt;.
+/// </summary>
+static const int METRICS_DUMP_SIGNAL = SIGUSR1;
+#endif
+
+/// <summary>
+/// Writes the metrics of the run to a path (with .json & .prom extensions) - whenever the process gets
+/// METRICS_DUMP_SIGNAL, and when it is destroyed.
+/// The signal is waited for on a thread of it's own, so the metrics are never written by a signal handler.
+/// </summary>
+class MetricsDump {
+public:
+	explicit MetricsDump(std::filesystem::path path) : _path(std::move(path)), _signals(_io_ctx, METRICS_DUMP_SIGNAL) {
+		wait_for_signal();
+		_thread = std::thread([this]() { _io_ctx.run(); });
+	}
+
+	~MetricsDump() {
+		_io_ctx.stop();
+		_thread.join();
+		Metrics::dump(_path);
+	}
+
+private:
+	void wait_for_signal() {
+		_signals.async_wait([this](const boost::system::error_code& error, int) {
+			if (!error) {
+				Metrics::dump(_path);
+				wait_for_signal();
+			}
+		});
+	}
+
+	std::filesystem::path _path;
+	boost::asio::io_context _io_ctx;
+	boost::asio::signal_set _signals;
+	std::thread _thread;
+};
 
 // The transfer file is just a helper for the batch operations execution
 // it has nothing to do with the internal client logic itself.
@@ -10,7 +66,11 @@ public:
 	std::string host;
 	int port = -1;
 	std::string user_name;
-	std::filesystem::path file_path;
+	/// <summary>
+	/// The files to upload - each entry is a file, a directory (uploaded recursively),
+	/// or a wildcard pattern (* and ?) in it's file name part.
+	/// </summary>
+	std::vector<std::string> file_entries;
 
 	/// <summary>
 	/// Loads a transfer file info data from the specified file path.
@@ -35,31 +95,168 @@ public:
 			throw std::runtime_error("Invalid file: " + transfer_file_name + "!");
 		}
 
-		// get user name & file to upload path.
+		// get user name & files to upload, one entry per line.
 		std::getline(info_file, user_name);
 
-		if (info_file.eof()) {
+		while (std::getline(info_file, temp)) {
+			if (!temp.empty() && temp.back() == '\r')
+				temp.pop_back();
+			if (!temp.empty())
+				file_entries.push_back(temp);
+		}
+
+		if (file_entries.empty()) {
 			throw std::runtime_error("Invalid file: " + transfer_file_name + "!");
 		}
+	}
 
-		std::getline(info_file, temp);
-		file_path = temp;
+	/// <summary>
+	/// Expands the file entries into the list of regular files to upload.
+	/// The server stores a user's files by name only, so files of the same name in different directories are
+	/// rejected (std::runtime_error, listing them) - one would overwrite the other. A file listed twice is uploaded once.
+	/// </summary>
+	std::vector<std::filesystem::path> get_file_paths() {
+		std::vector<std::filesystem::path> result;
+
+		for (const auto& entry : file_entries) {
+			std::filesystem::path entry_path(entry);
+			auto pattern = entry_path.filename().string();
+
+			if (pattern.find_first_of("*?") != std::string::npos) {
+				// wildcard: match files in the parent directory by name.
+				auto parent = entry_path.has_parent_path() ? entry_path.parent_path() : std::filesystem::path(".");
+				if (!std::filesystem::is_directory(parent))
+					continue;
+				for (const auto& dir_entry : std::filesystem::directory_iterator(parent)) {
+					if (dir_entry.is_regular_file() && wildcard_match(pattern.c_str(), dir_entry.path().filename().string().c_str()))
+						result.push_back(dir_entry.path());
+				}
+			}
+			else if (std::filesystem::is_directory(entry_path)) {
+				for (const auto& dir_entry : std::filesystem::recursive_directory_iterator(entry_path)) {
+					if (dir_entry.is_regular_file())
+						result.push_back(dir_entry.path());
+				}
+			}
+			else {
+				// a missing file is reported as a failure when sent.
+				result.push_back(entry_path);
+			}
+		}
+		return without_collisions(result);
+	}
+
+private:
+	/// <summary>
+	/// Drops repeated paths, and throws if different paths share a file name.
+	/// </summary>
+	static std::vector<std::filesystem::path> without_collisions(const std::vector<std::filesystem::path>& file_paths) {
+		std::vector<std::filesystem::path> result;
+		std::map<std::string, std::filesystem::path> by_name;
+		std::string collisions;
+		for (const auto& file_path : file_paths) {
+			auto normal_path = file_path.lexically_normal();
+			auto inserted = by_name.emplace(file_path.filename().string(), normal_path);
+			if (inserted.second) {
+				result.push_back(file_path);
+			}
+			else if (inserted.first->second != normal_path) {
+				collisions += "\n  " + inserted.first->second.string() + " & " + normal_path.string();
+			}
+		}
+
+		if (!collisions.empty()) {
+			throw std::runtime_error("Files of the same name would overwrite each other on the server - rename them or "
+				"upload them separately:" + collisions);
+		}
+		return result;
+	}
+
+	/// <summary>
+	/// Returns whether the name matches the pattern, where * matches any sequence and ? any single char.
+	/// </summary>
+	static bool wildcard_match(const char* pattern, const char* name) {
+		if (*pattern == '\0')
+			return *name == '\0';
+		if (*pattern == '*')
+			return wildcard_match(pattern + 1, name) || (*name != '\0' && wildcard_match(pattern, name + 1));
+		if (*name != '\0' && (*pattern == '?' || *pattern == *name))
+			return wildcard_match(pattern + 1, name + 1);
+		return false;
 	}
 };
 
-int main() {
+int main(int argc, char* argv[]) {
+	// the trace (when it is compiled in) is written on every way out of main, including failures - and so are the
+	// metrics, when asked for.
+	struct TraceDump {
+		~TraceDump() {
+			TRACE_DUMP("trace.json");
+		}
+	} trace_dump;
+	std::unique_ptr<MetricsDump> metrics_dump;
+
 	try {
+		// optional arguments: number of parallel connections to upload with,
+		// --sync to upload only the files that changed since they were last verified,
+		// --connect-timeout=<ms> to bound the time each connection may take,
+		// --metrics=<path> to write the metrics to <path>.json & <path>.prom,
+		// and --convert-info to convert a me.info of the older text format to the binary one (and do nothing else).
+		size_t connections = UploadPool::default_connection_count();
+		bool sync = false;
+		bool convert_info = false;
+		const std::string connect_timeout_flag = "--connect-timeout=";
+		const std::string metrics_flag = "--metrics=";
+		for (int i = 1; i < argc; i++) {
+			std::string argument = argv[i];
+			if (argument == "--sync")
+				sync = true;
+			else if (argument == "--convert-info")
+				convert_info = true;
+			else if (argument.rfind(connect_timeout_flag, 0) == 0)
+				Connector::set_timeout(std::chrono::milliseconds(std::stoll(argument.substr(connect_timeout_flag.length()))));
+			else if (argument.rfind(metrics_flag, 0) == 0)
+				metrics_dump = std::make_unique<MetricsDump>(argument.substr(metrics_flag.length()));
+			else
+				connections = std::stoul(argument);
+		}
+
+		// older clients read only the text format, so it is converted only when asked to.
+		if (convert_info) {
+			MeInfo info;
+			if (!info.is_loaded()) {
+				std::cerr << "No user data to convert!" << std::endl;
+				return -1;
+			}
+			if (!info.is_text_format()) {
+				std::cout << "User data is already in the binary format." << std::endl;
+				return 0;
+			}
+			if (!info.save()) {
+				std::cerr << "Failed to save the converted user data!" << std::endl;
+				return -1;
+			}
+			std::cout << "User data converted to the binary format." << std::endl;
+			return 0;
+		}
+
 		auto tinfo = TransferInfo("transfer.info");
+		auto file_paths = tinfo.get_file_paths();
+
+		if (file_paths.empty()) {
+			std::cerr << "No files to upload!" << std::endl;
+			return -1;
+		}
 
 
 		std::cout << "Connecting client... ";
-		Client client(tinfo.host, tinfo.port);
+		auto client = std::make_unique<Client>(tinfo.host, tinfo.port);
 		std::cout << "Client connected." << std::endl;
 
 
-		if (!client.is_registered()) {
+		if (!client->is_registered()) {
 			std::cout << "Registering client... ";
-			if (client.register_user(tinfo.user_name)) {
+			if (client->register_user(tinfo.user_name)) {
 				std::cout << "Registration succeeded." << std::endl;
 			}
 			else {
@@ -72,22 +269,61 @@ int main() {
 		}
 
 
+		// in sync mode, the unchanged files are skipped, and the manifest is updated with the verified ones.
+		std::unique_ptr<SyncManifest> manifest;
+		std::vector<FileStat> file_stats;
+		if (sync) {
+			manifest = std::make_unique<SyncManifest>(MeInfo().header_user_id);
+			std::vector<std::filesystem::path> changed_paths;
+			for (const auto& file_path : file_paths) {
+				FileStat current;
+				if (!manifest->is_synced(file_path, current)) {
+					changed_paths.push_back(file_path);
+					file_stats.push_back(current);
+				}
+			}
+			std::cout << (file_paths.size() - changed_paths.size()) << " of " << file_paths.size() << " files are unchanged." << std::endl;
+			file_paths = std::move(changed_paths);
+
+			if (file_paths.empty()) {
+				manifest->save();
+				return 0;
+			}
+		}
+
+
 		std::cout << "Exchanging keys... ";
-		client.exchange_keys();
+		client->exchange_keys();
 		std::cout << "Keys exchanged." << std::endl;
 
 
-		std::cout << "Uploading file... ";
+		// upload all the files, spread over the pool's connections, and print each result in the summary.
+		std::cout << "Uploading " << file_paths.size() << " files over up to " << connections << " connections..." << std::endl;
+		UploadPool pool(std::move(client), tinfo.host, tinfo.port, connections);
+		auto results = pool.upload(file_paths);
 
-		if (client.send_file(tinfo.file_path)) {
-			std::cout << "File sent & verified." << std::endl;
+		size_t verified_count = 0;
+		for (size_t i = 0; i < results.size(); i++) {
+			if (!results[i].verified)
+				continue;
+			verified_count++;
+			if (manifest)
+				manifest->update(results[i].file_path, file_stats[i], results[i].crc);
 		}
-		else {
-			std::cerr << "Failed to send file! Upload won't verify!" << std::endl;
-			return -1;
+		if (manifest)
+			manifest->save();
+
+		std::cout << std::endl << "Summary: " << verified_count << "/" << file_paths.size() << " files uploaded." << std::endl;
+		for (const auto& result : results) {
+			if (result.verified)
+				std::cout << "  OK     " << result.file_path.string() << std::endl;
+			else if (result.error.empty())
+				std::cout << "  FAILED " << result.file_path.string() << " (checksum mismatch)" << std::endl;
+			else
+				std::cout << "  FAILED " << result.file_path.string() << " (" << result.error << ")" << std::endl;
 		}
 
-		return 0;
+		return verified_count == file_paths.size() ? 0 : -1;
 	}
 	catch (const std::exception& ex) {
 		std::cerr << "Exception! " << ex.what() << std::endl;
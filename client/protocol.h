@@ -4,6 +4,11 @@ This file contains protocol specific defintitions such as codes, sizes and data
 
 #pragma once
 #include <cstdint>
+#include <string>
+#include <array>
+#include <vector>
+#include <bit>
+#include "util/WireFormat.h"
 
 #define AES_KEY_LENGTH_BYTES (16)
 #define RSA_KEY_LENGTH_BITS (1024)
@@ -15,10 +20,32 @@ This file contains protocol specific defintitions such as codes, sizes and data
 #define PUBLIC_KEY_EXPORTED_SIZE (160)
 #define MAX_FILENAME_SIZE (255)
 #define EXCHANGED_AES_KEY_SIZE_LIMIT (512)
+#define TICKET_ID_SIZE_BYTES (16)
+#define CTR_COUNTER_SIZE_BYTES (16)
+#define UPLOAD_ID_SIZE_BYTES (16)
+#define CHUNK_HASH_SIZE_BYTES (32)
 
-#define PROTOCOL_VERSION (3)
+#define PROTOCOL_VERSION (10)
+
+// Minimal server version (as sent in the response headers) that supports each optional feature.
+#define MIN_VERSION_SESSION_TICKETS (4)
+#define MIN_VERSION_PARALLEL_ENCRYPTION (5)
+#define MIN_VERSION_RESUMABLE_UPLOADS (6)
+#define MIN_VERSION_COMPRESSION (7)
+#define MIN_VERSION_DEDUPLICATION (8)
+#define MIN_VERSION_COMPACT_FRAMING (9)
+#define MIN_VERSION_LARGE_FILES (10)
 
 #define SEND_FILE_RETRY_COUNT (3)
+// Maximal size of a file that is sent in a single small file request.
+#define MAX_SMALL_FILE_SIZE (16 * 1024)
+// Minimal size of a file that is streamed whole (with a 64-bit size) rather than deduplicated, to servers that support it.
+// The memory of a deduplicated upload grows with the file's chunk count, while a streamed one takes the same at any size.
+#define MIN_STREAMED_FILE_SIZE (4ULL * 1024 * 1024 * 1024)
+// Maximal size of a file that is sent in the fixed (32-bit sized) upload requests.
+#define MAX_FIXED_UPLOAD_SIZE (0xFFFFFFFFULL)
+// Maximal number of rounds of sending the missing chunks of a chunked or deduplicated upload.
+#define SEND_CHUNKS_ROUND_COUNT (5)
 
 /// <summary>
 /// The codes for each client request.
@@ -29,7 +56,18 @@ enum ClientRequestsCode : uint16_t {
 	RequestCodeUploadFile = 1103,
 	RequestCodeValidChecksum = 1104,
 	RequestCodeInvalidChecksumRetry = 1105,
-	RequestCodeInvalidChecksumAbort = 1106
+	RequestCodeInvalidChecksumAbort = 1106,
+	RequestCodeResumeSession = 1107,
+	RequestCodeIssueTicket = 1108,
+	RequestCodeUploadFileCtr = 1109,
+	RequestCodeBeginChunkedUpload = 1110,
+	RequestCodeUploadChunk = 1111,
+	RequestCodeFinishChunkedUpload = 1112,
+	RequestCodeUploadCompressedChunk = 1113,
+	RequestCodeQueryChunks = 1114,
+	RequestCodeStoreChunk = 1115,
+	RequestCodeAssembleFile = 1116,
+	RequestCodeUploadSmallFile = 1117
 };
 
 /// <summary>
@@ -40,6 +78,11 @@ enum ServerResponseCode : uint16_t {
 	ResponseCodeExchangeAes = 2102,
 	ResponseCodeFileUploaded = 2103,
 	ResponseCodeMessageOk = 2104,
+	ResponseCodeSessionResumed = 2105,
+	ResponseCodeResumeRejected = 2106,
+	ResponseCodeTicketIssued = 2107,
+	ResponseCodeUploadStatus = 2108,
+	ResponseCodeChunksHeld = 2109,
 	ResponseCodeServerError = 0
 };
 
@@ -47,6 +90,10 @@ enum ServerResponseCode : uint16_t {
 
 #pragma pack(push, 1)
 
+// The fixed structs are sent & received as they are in memory, so their integers are in the host's byte order - while
+// the server reads them as little-endian. Only the compact messages are encoded independently of the host.
+static_assert(std::endian::native == std::endian::little, "The fixed protocol structs must be sent from a little-endian host!");
+
 /* Requests Data */
 struct ClientRequestBase {
 	unsigned char header_user_id[USER_ID_SIZE_BYTES];
@@ -70,11 +117,84 @@ struct SendFileRequestType : ClientRequestBase {
 	char file_name[MAX_FILENAME_SIZE];
 };
 
+// Uploads a file encrypted with AES-CTR, starting from the specified counter block.
+struct SendFileCtrRequestType : SendFileRequestType {
+	unsigned char initial_counter[CTR_COUNTER_SIZE_BYTES];
+};
+
+// Starts a chunked upload, or resumes the upload with the same ID. Answered with the upload status.
+struct BeginChunkedUploadRequest : ClientRequestBase {
+	unsigned char client_id[USER_ID_SIZE_BYTES];
+	unsigned char upload_id[UPLOAD_ID_SIZE_BYTES];
+	unsigned long long file_size;
+	unsigned int chunk_size;
+	char file_name[MAX_FILENAME_SIZE];
+};
+
+// Followed by content_size bytes of the chunk, encrypted with AES-CTR at the chunk's offset. Not answered.
+struct UploadChunkRequest : ClientRequestBase {
+	unsigned char client_id[USER_ID_SIZE_BYTES];
+	unsigned char upload_id[UPLOAD_ID_SIZE_BYTES];
+	unsigned int chunk_index;
+	unsigned int chunk_checksum;
+	unsigned char initial_counter[CTR_COUNTER_SIZE_BYTES];
+	unsigned int content_size;
+};
+
+// Followed by content_size bytes of the chunk, compressed with the specified method (see ChunkCompressor::Method),
+// and then encrypted with AES-CTR at the chunk's offset. The checksum is of the plain chunk. Not answered.
+struct UploadCompressedChunkRequest : UploadChunkRequest {
+	unsigned char compression;
+	unsigned int plain_size;
+};
+
+// Answered with FileUploadSuccess once all chunks are held, or with the upload status otherwise.
+struct FinishChunkedUploadRequest : ClientRequestBase {
+	unsigned char client_id[USER_ID_SIZE_BYTES];
+	unsigned char upload_id[UPLOAD_ID_SIZE_BYTES];
+};
+
+// Followed by chunk_count chunk hashes (SHA-256 of the plain chunk). Answered with the held chunks.
+struct QueryChunksRequest : ClientRequestBase {
+	unsigned char client_id[USER_ID_SIZE_BYTES];
+	unsigned int chunk_count;
+};
+
+// Followed by content_size bytes of the chunk, compressed with the specified method (see ChunkCompressor::Method),
+// and then encrypted with AES-CTR at the chunk's offset in the file. Not answered.
+struct StoreChunkRequest : ClientRequestBase {
+	unsigned char client_id[USER_ID_SIZE_BYTES];
+	unsigned char chunk_hash[CHUNK_HASH_SIZE_BYTES];
+	unsigned long long offset;
+	unsigned char initial_counter[CTR_COUNTER_SIZE_BYTES];
+	unsigned char compression;
+	unsigned int plain_size;
+	unsigned int content_size;
+};
+
+// Followed by chunk_count chunk hashes, in the file's order. Answered with FileUploadSuccess once all chunks are held,
+// or with the held chunks otherwise.
+struct AssembleFileRequest : ClientRequestBase {
+	unsigned char client_id[USER_ID_SIZE_BYTES];
+	unsigned long long file_size;
+	unsigned int chunk_count;
+	char file_name[MAX_FILENAME_SIZE];
+};
+
 struct ChecksumStatusRequest : ClientRequestBase {
 	unsigned char client_id[USER_ID_SIZE_BYTES];
 	char file_name[MAX_FILENAME_SIZE];
 };
 
+struct IssueTicketRequest : ClientRequestBase {
+	unsigned char client_id[USER_ID_SIZE_BYTES];
+};
+
+struct ResumeSessionRequest : ClientRequestBase {
+	unsigned char client_id[USER_ID_SIZE_BYTES];
+	unsigned char ticket_id[TICKET_ID_SIZE_BYTES];
+};
+
 
 /* Responses Data */
 struct ServerResponseHeader {
@@ -99,5 +219,136 @@ struct FileUploadSuccess {
 	unsigned int checksum;
 };
 
+struct TicketIssued {
+	unsigned char client_id[USER_ID_SIZE_BYTES];
+	unsigned char ticket_id[TICKET_ID_SIZE_BYTES];
+	unsigned int lifetime_seconds;
+};
+
+// Followed by a bitmap of (chunk_count + 7) / 8 bytes - bit i (LSB first) is set if chunk i is held by the server.
+struct UploadStatus {
+	unsigned char client_id[USER_ID_SIZE_BYTES];
+	unsigned char upload_id[UPLOAD_ID_SIZE_BYTES];
+	unsigned int chunk_count;
+	unsigned int held_count;
+};
+
+// Followed by a bitmap of (chunk_count + 7) / 8 bytes - bit i (LSB first) is set if the i-th queried chunk is held by the server.
+struct ChunksHeld {
+	unsigned char client_id[USER_ID_SIZE_BYTES];
+	unsigned int chunk_count;
+	unsigned int held_count;
+};
+
+struct SessionResumed {
+	unsigned char client_id[USER_ID_SIZE_BYTES];
+};
+
+
+#pragma pack(pop)
+
+
+/*
+Compact messages - sent to servers from MIN_VERSION_COMPACT_FRAMING on, after the usual request/response header.
+They are encoded with WireFormat: fields are in wire order, strings are length-prefixed & there is no padding.
+They carry no user ID, since the request header already has it.
+*/
+
+// Followed by content_size bytes of the whole file, compressed with the specified method (see ChunkCompressor::Method),
+// and then encrypted with AES-CTR. Answered with FileUploadedMessage.
+struct UploadSmallFileMessage {
+	uint32_t plain_size;
+	uint8_t compression;
+	std::array<unsigned char, CTR_COUNTER_SIZE_BYTES> initial_counter;
+	uint32_t content_size;
+	std::string file_name;
+
+	static constexpr auto fields() {
+		return WireFormat::fields(&UploadSmallFileMessage::plain_size, &UploadSmallFileMessage::compression,
+			&UploadSmallFileMessage::initial_counter, &UploadSmallFileMessage::content_size, &UploadSmallFileMessage::file_name);
+	}
+};
+
+// The compact form of SendFileCtrRequestType, from MIN_VERSION_LARGE_FILES on - it's content size has 64 bits.
+// Followed by content_size bytes of the whole file, encrypted with AES-CTR. Answered with FileUploadedMessage.
+struct UploadFileMessage {
+	uint64_t content_size;
+	std::string file_name;
+	std::array<unsigned char, CTR_COUNTER_SIZE_BYTES> initial_counter;
+
+	static constexpr auto fields() {
+		return WireFormat::fields(&UploadFileMessage::content_size, &UploadFileMessage::file_name, &UploadFileMessage::initial_counter);
+	}
+};
+
+// The compact form of ChecksumStatusRequest.
+struct ChecksumStatusMessage {
+	std::string file_name;
+
+	static constexpr auto fields() {
+		return WireFormat::fields(&ChecksumStatusMessage::file_name);
+	}
+};
+
+// The compact form of QueryChunksRequest - followed by chunk_count chunk hashes.
+struct QueryChunksMessage {
+	uint32_t chunk_count;
+
+	static constexpr auto fields() {
+		return WireFormat::fields(&QueryChunksMessage::chunk_count);
+	}
+};
+
+// The compact form of StoreChunkRequest - followed by content_size bytes of the chunk.
+struct StoreChunkMessage {
+	std::array<unsigned char, CHUNK_HASH_SIZE_BYTES> chunk_hash;
+	uint64_t offset;
+	std::array<unsigned char, CTR_COUNTER_SIZE_BYTES> initial_counter;
+	uint8_t compression;
+	uint32_t plain_size;
+	uint32_t content_size;
+
+	static constexpr auto fields() {
+		return WireFormat::fields(&StoreChunkMessage::chunk_hash, &StoreChunkMessage::offset, &StoreChunkMessage::initial_counter,
+			&StoreChunkMessage::compression, &StoreChunkMessage::plain_size, &StoreChunkMessage::content_size);
+	}
+};
+
+// The compact form of AssembleFileRequest - followed by chunk_count chunk hashes.
+struct AssembleFileMessage {
+	uint64_t file_size;
+	uint32_t chunk_count;
+	std::string file_name;
+
+	static constexpr auto fields() {
+		return WireFormat::fields(&AssembleFileMessage::file_size, &AssembleFileMessage::chunk_count, &AssembleFileMessage::file_name);
+	}
+};
+
+// The compact form of FileUploadSuccess - the client knows the file it sent, so only the server's CRC is returned.
+struct FileUploadedMessage {
+	uint32_t checksum;
+
+	static constexpr auto fields() {
+		return WireFormat::fields(&FileUploadedMessage::checksum);
+	}
+};
+
+// The compact form of ChunksHeld - bit i (LSB first) of held is set if the i-th queried chunk is held by the server.
+struct ChunksHeldMessage {
+	uint32_t chunk_count;
+	uint32_t held_count;
+	std::vector<unsigned char> held;
+
+	static constexpr auto fields() {
+		return WireFormat::fields(&ChunksHeldMessage::chunk_count, &ChunksHeldMessage::held_count, &ChunksHeldMessage::held);
+	}
+};
 
-#pragma pack(pop)
\ No newline at end of file
+// The fixed layouts must match the server's compact formats (see protocol.py).
+static_assert(WireFormat::fixed_size<UploadSmallFileMessage>() == 4 + 1 + CTR_COUNTER_SIZE_BYTES + 4 + 1);
+static_assert(WireFormat::fixed_size<UploadFileMessage>() == 8 + 1 + CTR_COUNTER_SIZE_BYTES);
+static_assert(WireFormat::fixed_size<StoreChunkMessage>() == CHUNK_HASH_SIZE_BYTES + 8 + CTR_COUNTER_SIZE_BYTES + 1 + 4 + 4);
+static_assert(WireFormat::is_fixed_size<StoreChunkMessage>() && WireFormat::is_fixed_size<FileUploadedMessage>());
+static_assert(WireFormat::fixed_size<AssembleFileMessage>() == 8 + 4 + 1);
+static_assert(WireFormat::fixed_size<ChunksHeldMessage>() == 4 + 4 + 4);
@@ -0,0 +1,37 @@
+#include "AsyncSignal.h"
+#include <memory>
+
+boost::asio::awaitable<void> AsyncSignal::async_wait() {
+	auto initiation = [this](auto handler) {
+		// the handler is move only, while the waiter is copyable - it is shared.
+		auto executor = boost::asio::get_associated_executor(handler);
+		auto shared_handler = std::make_shared<decltype(handler)>(std::move(handler));
+		std::function<void()> resume = [executor, shared_handler]() {
+			boost::asio::post(executor, [shared_handler]() { (*shared_handler)(); });
+		};
+
+		std::unique_lock<std::mutex> lock(_lock);
+		if (!_notified) {
+			_waiter = std::move(resume);
+			return;
+		}
+		_notified = false;
+		lock.unlock();
+		resume();
+	};
+	co_await boost::asio::async_initiate<const boost::asio::use_awaitable_t<>&, void()>(initiation, boost::asio::use_awaitable);
+}
+
+void AsyncSignal::notify() {
+	std::function<void()> waiter;
+	{
+		std::lock_guard<std::mutex> lock(_lock);
+		if (!_waiter) {
+			_notified = true;
+			return;
+		}
+		waiter = std::move(_waiter);
+		_waiter = nullptr;
+	}
+	waiter();
+}
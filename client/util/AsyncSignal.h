@@ -0,0 +1,36 @@
+#pragma once
+#include <mutex>
+#include <functional>
+#include <boost/asio.hpp>
+
+/// <summary>
+/// Wakes a coroutine from another thread (e.g. a worker), without blocking an io_context thread while it waits:
+/// the waiting coroutine is resumed by posting it to it's own executor.
+/// A notification that comes while no one waits is kept, and completes the next wait at once - so it is never lost.
+/// Waits may wake up spuriously, so the waited condition should be checked again after each one.
+/// </summary>
+class AsyncSignal
+{
+public:
+	AsyncSignal() = default;
+	AsyncSignal(const AsyncSignal&) = delete;
+	AsyncSignal& operator=(const AsyncSignal&) = delete;
+
+	/// <summary>
+	/// Waits for a notification. Only a single coroutine may wait at a time.
+	/// </summary>
+	boost::asio::awaitable<void> async_wait();
+
+	/// <summary>
+	/// Wakes the waiting coroutine, or the next one to wait. May be called from any thread.
+	/// </summary>
+	void notify();
+
+private:
+	std::mutex _lock;
+	bool _notified = false;
+	/// <summary>
+	/// Resumes the waiting coroutine, if any.
+	/// </summary>
+	std::function<void()> _waiter;
+};
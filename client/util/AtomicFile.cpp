@@ -0,0 +1,69 @@
+#include "AtomicFile.h"
+#include <atomic>
+#include <fstream>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+std::filesystem::path AtomicFile::unique_temp_path(const std::filesystem::path& path) {
+	static std::atomic<uint64_t> counter(0);
+#ifdef _WIN32
+	auto pid = _getpid();
+#else
+	auto pid = getpid();
+#endif
+	auto name = path.filename().string() + "." + std::to_string(pid) + "." + std::to_string(counter++) + ".tmp";
+	return path.parent_path() / name;
+}
+
+#ifdef _WIN32
+
+static bool write_new_file(const std::filesystem::path& path, const std::string& content, bool) {
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	out.write(content.data(), static_cast<std::streamsize>(content.size()));
+	out.close();
+	return out.good();
+}
+
+#else
+
+static bool write_new_file(const std::filesystem::path& path, const std::string& content, bool owner_only) {
+	// the mode is set on creation, so the content is never readable by others - not even for a moment.
+	int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, owner_only ? 0600 : 0666);
+	if (fd < 0) {
+		return false;
+	}
+	size_t written = 0;
+	while (written < content.size()) {
+		auto result = ::write(fd, content.data() + written, content.size() - written);
+		if (result < 0 && errno == EINTR) {
+			continue;
+		}
+		if (result <= 0) {
+			close(fd);
+			return false;
+		}
+		written += static_cast<size_t>(result);
+	}
+	return close(fd) == 0;
+}
+
+#endif
+
+bool AtomicFile::write(const std::filesystem::path& path, const std::string& content, bool owner_only) {
+	auto temp_path = unique_temp_path(path);
+	std::error_code error;
+	if (write_new_file(temp_path, content, owner_only)) {
+		std::filesystem::rename(temp_path, path, error);
+		if (!error) {
+			return true;
+		}
+	}
+	std::filesystem::remove(temp_path, error);
+	return false;
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <string>
+#include <filesystem>
+
+/// <summary>
+/// Replaces small files atomically: the content is written to a temp file of the writer's own, which is then renamed
+/// over the file. So concurrent clients in the same directory never read, or rename into place, a half written file.
+/// </summary>
+class AtomicFile
+{
+public:
+	/// <summary>
+	/// Writes the whole content to the file, replacing it. The temp file is removed if anything fails.
+	/// </summary>
+	/// <param name="owner_only">Whether the file may be read by it's owner only - for files that hold secrets.
+	/// Applies to POSIX systems; on Windows the file inherits the directory's access list.</param>
+	/// <returns>Whether the file was replaced.</returns>
+	static bool write(const std::filesystem::path& path, const std::string& content, bool owner_only = false);
+
+private:
+	/// <summary>
+	/// Returns a temp file name next to the file, unique to the process and the call.
+	/// </summary>
+	static std::filesystem::path unique_temp_path(const std::filesystem::path& path);
+};
@@ -8,7 +8,7 @@
 class CRC
 {
 	uint32_t crc;
-	size_t nchar;
+	uint64_t nchar;
 
 public:
 	/// <summary>
@@ -28,12 +28,12 @@ public:
 	/// </summary>
 	uint32_t digest();
 
-private:
 	/// <summary>
-	/// Updates the CRC value by the read block & it's size
+	/// Updates the CRC value by the read block & it's size.
+	/// Lets callers that already read the data (e.g. while sending it) calculate the CRC without re-reading the file.
 	/// </summary>
 	/// <param name="buf">The read block</param>
 	/// <param name="size">The block's size</param>
-	void update(char* buf, uint32_t size);
+	void update(const char* buf, size_t size);
 };
 
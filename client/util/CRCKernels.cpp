@@ -0,0 +1,299 @@
+#include "CRCKernels.h"
+#include <vector>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define CRC_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#define CRC_TARGET_CLMUL
+#else
+#include <cpuid.h>
+#define CRC_TARGET_CLMUL __attribute__((target("pclmul,ssse3")))
+#endif
+#include <immintrin.h>
+#endif
+
+static uint32_t const crctab[256] = {
+	0x00000000,	0x04C11DB7,	0x09823B6E,	0x0D4326D9,	0x130476DC,
+	0x17C56B6B,	0x1A864DB2,	0x1E475005,	0x2608EDB8,	0x22C9F00F,
+	0x2F8AD6D6,	0x2B4BCB61,	0x350C9B64,	0x31CD86D3,	0x3C8EA00A,
+	0x384FBDBD,	0x4C11DB70,	0x48D0C6C7,	0x4593E01E,	0x4152FDA9,
+	0x5F15ADAC,	0x5BD4B01B,	0x569796C2,	0x52568B75,	0x6A1936C8,
+	0x6ED82B7F,	0x639B0DA6,	0x675A1011,	0x791D4014,	0x7DDC5DA3,
+	0x709F7B7A,	0x745E66CD,	0x9823B6E0,	0x9CE2AB57,	0x91A18D8E,
+	0x95609039,	0x8B27C03C,	0x8FE6DD8B,	0x82A5FB52,	0x8664E6E5,
+	0xBE2B5B58,	0xBAEA46EF,	0xB7A96036,	0xB3687D81,	0xAD2F2D84,
+	0xA9EE3033,	0xA4AD16EA,	0xA06C0B5D,	0xD4326D90,	0xD0F37027,
+	0xDDB056FE,	0xD9714B49,	0xC7361B4C,	0xC3F706FB,	0xCEB42022,
+	0xCA753D95,	0xF23A8028,	0xF6FB9D9F,	0xFBB8BB46,	0xFF79A6F1,
+	0xE13EF6F4,	0xE5FFEB43,	0xE8BCCD9A,	0xEC7DD02D,	0x34867077,
+	0x30476DC0,	0x3D044B19,	0x39C556AE,	0x278206AB,	0x23431B1C,
+	0x2E003DC5,	0x2AC12072,	0x128E9DCF,	0x164F8078,	0x1B0CA6A1,
+	0x1FCDBB16,	0x018AEB13,	0x054BF6A4,	0x0808D07D,	0x0CC9CDCA,
+	0x7897AB07,	0x7C56B6B0,	0x71159069,	0x75D48DDE,	0x6B93DDDB,
+	0x6F52C06C,	0x6211E6B5,	0x66D0FB02,	0x5E9F46BF,	0x5A5E5B08,
+	0x571D7DD1,	0x53DC6066,	0x4D9B3063,	0x495A2DD4,	0x44190B0D,
+	0x40D816BA,	0xACA5C697,	0xA864DB20,	0xA527FDF9,	0xA1E6E04E,
+	0xBFA1B04B,	0xBB60ADFC,	0xB6238B25,	0xB2E29692,	0x8AAD2B2F,
+	0x8E6C3698,	0x832F1041,	0x87EE0DF6,	0x99A95DF3,	0x9D684044,
+	0x902B669D,	0x94EA7B2A,	0xE0B41DE7,	0xE4750050,	0xE9362689,
+	0xEDF73B3E,	0xF3B06B3B,	0xF771768C,	0xFA325055,	0xFEF34DE2,
+	0xC6BCF05F,	0xC27DEDE8,	0xCF3ECB31,	0xCBFFD686,	0xD5B88683,
+	0xD1799B34,	0xDC3ABDED,	0xD8FBA05A,	0x690CE0EE,	0x6DCDFD59,
+	0x608EDB80,	0x644FC637,	0x7A089632,	0x7EC98B85,	0x738AAD5C,
+	0x774BB0EB,	0x4F040D56,	0x4BC510E1,	0x46863638,	0x42472B8F,
+	0x5C007B8A,	0x58C1663D,	0x558240E4,	0x51435D53,	0x251D3B9E,
+	0x21DC2629,	0x2C9F00F0,	0x285E1D47,	0x36194D42,	0x32D850F5,
+	0x3F9B762C,	0x3B5A6B9B,	0x0315D626,	0x07D4CB91,	0x0A97ED48,
+	0x0E56F0FF,	0x1011A0FA,	0x14D0BD4D,	0x19939B94,	0x1D528623,
+	0xF12F560E,	0xF5EE4BB9,	0xF8AD6D60,	0xFC6C70D7,	0xE22B20D2,
+	0xE6EA3D65,	0xEBA91BBC,	0xEF68060B,	0xD727BBB6,	0xD3E6A601,
+	0xDEA580D8,	0xDA649D6F,	0xC423CD6A,	0xC0E2D0DD,	0xCDA1F604,
+	0xC960EBB3,	0xBD3E8D7E,	0xB9FF90C9,	0xB4BCB610,	0xB07DABA7,
+	0xAE3AFBA2,	0xAAFBE615,	0xA7B8C0CC,	0xA379DD7B,	0x9B3660C6,
+	0x9FF77D71,	0x92B45BA8,	0x9675461F,	0x8832161A,	0x8CF30BAD,
+	0x81B02D74,	0x857130C3,	0x5D8A9099,	0x594B8D2E,	0x5408ABF7,
+	0x50C9B640,	0x4E8EE645,	0x4A4FFBF2,	0x470CDD2B,	0x43CDC09C,
+	0x7B827D21,	0x7F436096,	0x7200464F,	0x76C15BF8,	0x68860BFD,
+	0x6C47164A,	0x61043093,	0x65C52D24,	0x119B4BE9,	0x155A565E,
+	0x18197087,	0x1CD86D30,	0x029F3D35,	0x065E2082,	0x0B1D065B,
+	0x0FDC1BEC,	0x3793A651,	0x3352BBE6,	0x3E119D3F,	0x3AD08088,
+	0x2497D08D,	0x2056CD3A,	0x2D15EBE3,	0x29D4F654,	0xC5A92679,
+	0xC1683BCE,	0xCC2B1D17,	0xC8EA00A0,	0xD6AD50A5,	0xD26C4D12,
+	0xDF2F6BCB,	0xDBEE767C,	0xE3A1CBC1,	0xE760D676,	0xEA23F0AF,
+	0xEEE2ED18,	0xF0A5BD1D,	0xF464A0AA,	0xF9278673,	0xFDE69BC4,
+	0x89B8FD09,	0x8D79E0BE,	0x803AC667,	0x84FBDBD0,	0x9ABC8BD5,
+	0x9E7D9662,	0x933EB0BB,	0x97FFAD0C,	0xAFB010B1,	0xAB710D06,
+	0xA6322BDF,	0xA2F33668,	0xBCB4666D,	0xB8757BDA,	0xB5365D03,
+	0xB1F740B4,
+};
+
+/// <summary>
+/// Slicing tables: table[k][b] is the CRC of byte b followed by k zero bytes.
+/// table[0] is crctab itself.
+/// </summary>
+struct SliceTables {
+	uint32_t table[16][256];
+
+	SliceTables() {
+		for (int i = 0; i < 256; i++) {
+			table[0][i] = crctab[i];
+		}
+		for (int k = 1; k < 16; k++) {
+			for (int i = 0; i < 256; i++) {
+				uint32_t prev = table[k - 1][i];
+				table[k][i] = (prev << 8) ^ crctab[prev >> 24];
+			}
+		}
+	}
+};
+
+static const SliceTables& slice_tables() {
+	static const SliceTables tables;
+	return tables;
+}
+
+static inline uint32_t load_big_endian(const unsigned char* buf) {
+	return ((uint32_t)buf[0] << 24) | ((uint32_t)buf[1] << 16) | ((uint32_t)buf[2] << 8) | (uint32_t)buf[3];
+}
+
+uint32_t CRCKernels::scalar(uint32_t crc, const unsigned char* buf, size_t size) {
+	for (size_t i = 0; i < size; i++)
+	{
+		crc = crctab[(crc >> 24) ^ buf[i]] ^ ((crc << 8) & 0xFFFFFFFF);
+	}
+	return crc;
+}
+
+uint32_t CRCKernels::slice_by_8(uint32_t crc, const unsigned char* buf, size_t size) {
+	const auto& t = slice_tables().table;
+
+	while (size >= 8) {
+		uint32_t high = crc ^ load_big_endian(buf);
+		crc = t[7][high >> 24] ^ t[6][(high >> 16) & 0xff] ^ t[5][(high >> 8) & 0xff] ^ t[4][high & 0xff] ^
+			t[3][buf[4]] ^ t[2][buf[5]] ^ t[1][buf[6]] ^ t[0][buf[7]];
+		buf += 8;
+		size -= 8;
+	}
+	return scalar(crc, buf, size);
+}
+
+uint32_t CRCKernels::slice_by_16(uint32_t crc, const unsigned char* buf, size_t size) {
+	const auto& t = slice_tables().table;
+
+	while (size >= 16) {
+		uint32_t high = crc ^ load_big_endian(buf);
+		crc = t[15][high >> 24] ^ t[14][(high >> 16) & 0xff] ^ t[13][(high >> 8) & 0xff] ^ t[12][high & 0xff] ^
+			t[11][buf[4]] ^ t[10][buf[5]] ^ t[9][buf[6]] ^ t[8][buf[7]] ^
+			t[7][buf[8]] ^ t[6][buf[9]] ^ t[5][buf[10]] ^ t[4][buf[11]] ^
+			t[3][buf[12]] ^ t[2][buf[13]] ^ t[1][buf[14]] ^ t[0][buf[15]];
+		buf += 16;
+		size -= 16;
+	}
+	return scalar(crc, buf, size);
+}
+
+#ifdef CRC_X86
+
+// Folding constants: x^n mod P, for folding a 128 bit value n bits forward.
+// The high qword multiplies the high half of the value (x^(n+64) mod P), the low qword the low half (x^n mod P).
+#define CRC_FOLD_128 _mm_set_epi64x(0xC5B9CD4C, 0xE8A45605)
+#define CRC_FOLD_256 _mm_set_epi64x(0x569700E5, 0x75BE46B7)
+#define CRC_FOLD_384 _mm_set_epi64x(0x64BF7A9B, 0x8C3828A8)
+#define CRC_FOLD_512 _mm_set_epi64x(0x8833794C, 0xE6228B11)
+
+/// <summary>
+/// Returns a value congruent to x * x^n (mod P), where constants hold the matching fold constants.
+/// </summary>
+CRC_TARGET_CLMUL static inline __m128i fold(__m128i x, __m128i constants) {
+	return _mm_xor_si128(_mm_clmulepi64_si128(x, constants, 0x11), _mm_clmulepi64_si128(x, constants, 0x00));
+}
+
+/// <summary>
+/// Loads 16 message bytes, so that the first message bit is the highest polynomial coefficient.
+/// </summary>
+CRC_TARGET_CLMUL static inline __m128i load_block(const unsigned char* buf) {
+	const __m128i reverse = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	return _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(buf)), reverse);
+}
+
+CRC_TARGET_CLMUL uint32_t CRCKernels::carryless_multiply(uint32_t crc, const unsigned char* buf, size_t size) {
+	if (size < 64) {
+		return slice_by_16(crc, buf, size);
+	}
+
+	// four independent lanes, to hide the multiplication latency.
+	__m128i x0 = _mm_xor_si128(load_block(buf), _mm_set_epi32((int)crc, 0, 0, 0));
+	__m128i x1 = load_block(buf + 16);
+	__m128i x2 = load_block(buf + 32);
+	__m128i x3 = load_block(buf + 48);
+	buf += 64;
+	size -= 64;
+
+	while (size >= 64) {
+		x0 = _mm_xor_si128(fold(x0, CRC_FOLD_512), load_block(buf));
+		x1 = _mm_xor_si128(fold(x1, CRC_FOLD_512), load_block(buf + 16));
+		x2 = _mm_xor_si128(fold(x2, CRC_FOLD_512), load_block(buf + 32));
+		x3 = _mm_xor_si128(fold(x3, CRC_FOLD_512), load_block(buf + 48));
+		buf += 64;
+		size -= 64;
+	}
+
+	// merge the lanes into a single one
+	__m128i acc = _mm_xor_si128(_mm_xor_si128(fold(x0, CRC_FOLD_384), fold(x1, CRC_FOLD_256)),
+		_mm_xor_si128(fold(x2, CRC_FOLD_128), x3));
+
+	while (size >= 16) {
+		acc = _mm_xor_si128(fold(acc, CRC_FOLD_128), load_block(buf));
+		buf += 16;
+		size -= 16;
+	}
+
+	// acc is congruent to the message so far (mod P) - reduce it by running it through the table,
+	// which also applies the final x^32 multiplication.
+	unsigned char remainder[16];
+	const __m128i reverse = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(remainder), _mm_shuffle_epi8(acc, reverse));
+	crc = slice_by_16(0, remainder, sizeof(remainder));
+
+	return slice_by_16(crc, buf, size);
+}
+
+static bool cpu_has_clmul() {
+	unsigned int ecx;
+#ifdef _MSC_VER
+	int regs[4];
+	__cpuid(regs, 1);
+	ecx = (unsigned int)regs[2];
+#else
+	unsigned int eax, ebx, edx;
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return false;
+#endif
+	const unsigned int PCLMULQDQ_BIT = 1 << 1;
+	const unsigned int SSSE3_BIT = 1 << 9;
+	return (ecx & PCLMULQDQ_BIT) && (ecx & SSSE3_BIT);
+}
+
+#else
+
+uint32_t CRCKernels::carryless_multiply(uint32_t crc, const unsigned char* buf, size_t size) {
+	// not available on this architecture; is_supported() never reports it.
+	return slice_by_16(crc, buf, size);
+}
+
+static bool cpu_has_clmul() {
+	return false;
+}
+
+#endif
+
+CRCKernels::UpdateFunction CRCKernels::get(Kernel kernel) {
+	switch (kernel) {
+	case KernelSliceBy8:
+		return slice_by_8;
+	case KernelSliceBy16:
+		return slice_by_16;
+	case KernelCarrylessMultiply:
+		return carryless_multiply;
+	default:
+		return scalar;
+	}
+}
+
+bool CRCKernels::is_supported(Kernel kernel) {
+	static const bool has_clmul = cpu_has_clmul();
+	if (kernel == KernelCarrylessMultiply)
+		return has_clmul;
+	return kernel >= KernelScalar && kernel < KernelCount;
+}
+
+CRCKernels::Kernel CRCKernels::best() {
+	return is_supported(KernelCarrylessMultiply) ? KernelCarrylessMultiply : KernelSliceBy16;
+}
+
+const char* CRCKernels::name(Kernel kernel) {
+	switch (kernel) {
+	case KernelScalar:
+		return "scalar";
+	case KernelSliceBy8:
+		return "slice-by-8";
+	case KernelSliceBy16:
+		return "slice-by-16";
+	case KernelCarrylessMultiply:
+		return "pclmulqdq";
+	default:
+		return "unknown";
+	}
+}
+
+bool CRCKernels::validate() {
+	// deterministic pseudo-random input (xorshift), long enough to cover every kernel's main loop & tails.
+	const size_t MAX_LENGTH = 4096 + 64;
+	const size_t MAX_OFFSET = 16;
+	std::vector<unsigned char> data(MAX_LENGTH + MAX_OFFSET);
+	uint32_t state = 0x12345678;
+	for (auto& b : data) {
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		b = (unsigned char)state;
+	}
+
+	for (int k = KernelScalar + 1; k < KernelCount; k++) {
+		auto kernel = static_cast<Kernel>(k);
+		if (!is_supported(kernel))
+			continue;
+		auto update = get(kernel);
+
+		for (size_t offset = 0; offset < MAX_OFFSET; offset += 3) {
+			for (size_t length = 0; length <= MAX_LENGTH; length += (length < 256 ? 1 : 61)) {
+				for (uint32_t initial : { 0u, 0xFFFFFFFFu, state }) {
+					if (update(initial, data.data() + offset, length) != scalar(initial, data.data() + offset, length))
+						return false;
+				}
+			}
+		}
+	}
+	return true;
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/// <summary>
+/// This class holds the different CRC update implementations (kernels),
+/// and selects the fastest one supported by the running CPU.
+/// All kernels compute the same POSIX cksum (non-reflected, polynomial 0x04C11DB7) CRC.
+/// </summary>
+class CRCKernels
+{
+public:
+	/// <summary>
+	/// The available kernel types.
+	/// </summary>
+	enum Kernel {
+		KernelScalar,
+		KernelSliceBy8,
+		KernelSliceBy16,
+		KernelCarrylessMultiply,
+		KernelCount
+	};
+
+	/// <summary>
+	/// A kernel function - returns the updated CRC value after processing size bytes of buf.
+	/// </summary>
+	typedef uint32_t(*UpdateFunction)(uint32_t crc, const unsigned char* buf, size_t size);
+
+	/// <summary>
+	/// Returns the function that implements the specified kernel.
+	/// </summary>
+	static UpdateFunction get(Kernel kernel);
+
+	/// <summary>
+	/// Returns whether the specified kernel can run on the current CPU.
+	/// </summary>
+	static bool is_supported(Kernel kernel);
+
+	/// <summary>
+	/// Returns the fastest kernel supported by the current CPU (detected once, by CPUID).
+	/// </summary>
+	static Kernel best();
+
+	/// <summary>
+	/// Returns a printable name of the kernel.
+	/// </summary>
+	static const char* name(Kernel kernel);
+
+	/// <summary>
+	/// Validates every supported kernel against the scalar reference, over various buffer sizes and alignments.
+	/// </summary>
+	/// <returns>Whether all the supported kernels match the reference.</returns>
+	static bool validate();
+
+	/// <summary>
+	/// Byte-at-a-time reference implementation.
+	/// </summary>
+	static uint32_t scalar(uint32_t crc, const unsigned char* buf, size_t size);
+
+	/// <summary>
+	/// Slicing-by-8 table implementation.
+	/// </summary>
+	static uint32_t slice_by_8(uint32_t crc, const unsigned char* buf, size_t size);
+
+	/// <summary>
+	/// Slicing-by-16 table implementation.
+	/// </summary>
+	static uint32_t slice_by_16(uint32_t crc, const unsigned char* buf, size_t size);
+
+	/// <summary>
+	/// PCLMULQDQ folding implementation. Requires PCLMULQDQ & SSSE3 support.
+	/// </summary>
+	static uint32_t carryless_multiply(uint32_t crc, const unsigned char* buf, size_t size);
+};
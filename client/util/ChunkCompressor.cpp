@@ -0,0 +1,64 @@
+#include "ChunkCompressor.h"
+#include "Metrics.h"
+#include "Trace.h"
+#include <cmath>
+#include <string>
+
+#include <cryptopp/zdeflate.h>
+#include <cryptopp/filters.h>
+
+double ChunkCompressor::sample_entropy(const unsigned char* data, size_t length) {
+	if (length == 0) {
+		return 0;
+	}
+
+	size_t counts[256] = { 0 };
+	size_t sampled = 0;
+	if (length <= SAMPLE_COUNT * SAMPLE_SIZE) {
+		for (size_t i = 0; i < length; i++) {
+			counts[data[i]]++;
+		}
+		sampled = length;
+	}
+	else {
+		// samples are spread over the whole data, since files often change their content type along the way.
+		size_t stride = (length - SAMPLE_SIZE) / (SAMPLE_COUNT - 1);
+		for (size_t s = 0; s < SAMPLE_COUNT; s++) {
+			auto sample = data + s * stride;
+			for (size_t i = 0; i < SAMPLE_SIZE; i++) {
+				counts[sample[i]]++;
+			}
+		}
+		sampled = SAMPLE_COUNT * SAMPLE_SIZE;
+	}
+
+	double entropy = 0;
+	for (auto count : counts) {
+		if (count > 0) {
+			double p = static_cast<double>(count) / sampled;
+			entropy -= p * std::log2(p);
+		}
+	}
+	return entropy;
+}
+
+ChunkCompressor::Method ChunkCompressor::compress(const unsigned char* data, size_t length, std::vector<unsigned char>& dest) {
+	if (length == 0 || sample_entropy(data, length) > MAX_ENTROPY) {
+		return MethodNone;
+	}
+
+	Metrics::Timer timer(Metrics::PhaseCompress, length);
+	TRACE_SCOPE_BYTES("compress", length);
+	std::string compressed;
+	CryptoPP::Deflator deflator(new CryptoPP::StringSink(compressed), DEFLATE_LEVEL);
+	deflator.Put(data, length);
+	deflator.MessageEnd();
+
+	// poor gain isn't worth the server's decompression.
+	if (compressed.size() > length * MAX_COMPRESSED_RATIO) {
+		return MethodNone;
+	}
+
+	dest.assign(compressed.begin(), compressed.end());
+	return MethodDeflate;
+}
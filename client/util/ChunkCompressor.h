@@ -0,0 +1,54 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+/// <summary>
+/// Compresses upload chunks before they are encrypted, when it is worth it.
+/// The entropy of each chunk is sampled first, so random-looking data (e.g. already compressed files)
+/// is not compressed in vain. Compressed chunks use raw Deflate (RFC 1951) at the fastest level.
+/// </summary>
+class ChunkCompressor
+{
+public:
+	/// <summary>
+	/// The compression methods of a chunk, as sent to the server.
+	/// </summary>
+	enum Method : unsigned char {
+		MethodNone = 0,
+		MethodDeflate = 1
+	};
+
+	/// <summary>
+	/// Chunks with a higher sampled entropy (in bits per byte) are not compressed.
+	/// </summary>
+	static constexpr double MAX_ENTROPY = 7.5;
+
+	/// <summary>
+	/// A compressed chunk is used only if it is at most this part of the original size.
+	/// </summary>
+	static constexpr double MAX_COMPRESSED_RATIO = 0.875;
+
+	/// <summary>
+	/// Estimates the entropy of the data, in bits per byte, from evenly spread samples of it.
+	/// </summary>
+	static double sample_entropy(const unsigned char* data, size_t length);
+
+	/// <summary>
+	/// Compresses the data into dest, if it is worth it.
+	/// </summary>
+	/// <returns>The method the data was compressed with into dest, or MethodNone if it should be sent as is.</returns>
+	static Method compress(const unsigned char* data, size_t length, std::vector<unsigned char>& dest);
+
+private:
+	/// <summary>
+	/// The number & size of the samples taken to estimate the entropy.
+	/// </summary>
+	static const size_t SAMPLE_COUNT = 16;
+	static const size_t SAMPLE_SIZE = 256;
+
+	/// <summary>
+	/// The Deflate level to compress with - the fastest one that compresses.
+	/// </summary>
+	static const int DEFLATE_LEVEL = 1;
+};
@@ -0,0 +1,161 @@
+#include "Connector.h"
+#include <atomic>
+#include <memory>
+
+using boost::asio::ip::tcp;
+using boost::asio::awaitable;
+using boost::asio::use_awaitable;
+
+namespace {
+	const size_t NO_WINNER = SIZE_MAX;
+
+	/// <summary>
+	/// The state shared by a connection's attempts. They all run on the same strand.
+	/// </summary>
+	struct ConnectRace {
+		explicit ConnectRace(const boost::asio::any_io_executor& executor) : wake(executor) {}
+
+		std::vector<std::unique_ptr<tcp::socket>> sockets;
+		/// <summary>
+		/// Cancelled by each attempt that completes, to wake the race up before the next attempt is due.
+		/// </summary>
+		boost::asio::steady_timer wake;
+		size_t finished = 0;
+		size_t winner = NO_WINNER;
+		bool done = false;
+		boost::system::error_code error;
+	};
+
+	std::atomic<int64_t>& timeout_ms() {
+		static std::atomic<int64_t> timeout(Connector::DEFAULT_TIMEOUT_MS);
+		return timeout;
+	}
+
+	/// <summary>
+	/// Asks the OS to send the first request in the SYN (TCP Fast Open), once the server gave it a cookie.
+	/// The connect then completes right away, and it's failures show up on the first write.
+	/// </summary>
+	void enable_fast_open(tcp::socket& socket) {
+		// Linux only: Windows sends data in the SYN only through ConnectEx's own buffer, which asio doesn't use.
+#ifdef TCP_FASTOPEN_CONNECT
+		typedef boost::asio::detail::socket_option::boolean<IPPROTO_TCP, TCP_FASTOPEN_CONNECT> tcp_fast_open_connect;
+		boost::system::error_code ignored;
+		socket.set_option(tcp_fast_open_connect(true), ignored);
+#endif
+	}
+
+	awaitable<void> attempt(std::shared_ptr<ConnectRace> race, size_t index, tcp::endpoint endpoint, bool fast_open) {
+		// the race may be decided before the attempt had the chance to start.
+		if (race->done) {
+			co_return;
+		}
+
+		auto& socket = *race->sockets[index];
+		boost::system::error_code error;
+		socket.open(endpoint.protocol(), error);
+		if (!error) {
+			if (fast_open) {
+				enable_fast_open(socket);
+			}
+			co_await socket.async_connect(endpoint, boost::asio::redirect_error(use_awaitable, error));
+		}
+
+		race->finished++;
+		if (!error && race->winner == NO_WINNER && !race->done) {
+			race->winner = index;
+		}
+		else if (error && !race->done) {
+			race->error = error;
+		}
+		race->wake.cancel();
+	}
+
+	/// <summary>
+	/// Starts the attempts one after the other, until one of them connects, all of them failed or the time is up.
+	/// </summary>
+	awaitable<boost::system::error_code> run_race(tcp::socket& socket, std::vector<tcp::endpoint> endpoints,
+		boost::asio::any_io_executor strand) {
+		auto race = std::make_shared<ConnectRace>(strand);
+		auto deadline = std::chrono::steady_clock::now() + Connector::timeout();
+		auto next_attempt = std::chrono::steady_clock::now();
+		// with a single endpoint there's nothing to race - the connect may complete before the handshake does.
+		bool fast_open = endpoints.size() == 1;
+
+		while (race->winner == NO_WINNER) {
+			auto now = std::chrono::steady_clock::now();
+			if (now >= deadline) {
+				race->error = boost::asio::error::timed_out;
+				break;
+			}
+			auto started = race->sockets.size();
+			if (started == endpoints.size() && race->finished == started) {
+				break;
+			}
+
+			// the next attempt starts once it's due, or right away when all the started ones failed.
+			if (started < endpoints.size() && (now >= next_attempt || race->finished == started)) {
+				race->sockets.push_back(std::make_unique<tcp::socket>(socket.get_executor()));
+				boost::asio::co_spawn(strand, attempt(race, started, endpoints[started], fast_open),
+					boost::asio::detached);
+				next_attempt = now + std::chrono::milliseconds(static_cast<int64_t>(Connector::ATTEMPT_DELAY_MS));
+				continue;
+			}
+
+			auto wake_at = started < endpoints.size() && next_attempt < deadline ? next_attempt : deadline;
+			race->wake.expires_at(wake_at);
+			boost::system::error_code ignored;
+			co_await race->wake.async_wait(boost::asio::redirect_error(use_awaitable, ignored));
+		}
+
+		// the losers are closed, which cancels their pending connects.
+		race->done = true;
+		for (size_t i = 0; i < race->sockets.size(); i++) {
+			if (i != race->winner) {
+				boost::system::error_code ignored;
+				race->sockets[i]->close(ignored);
+			}
+		}
+		if (race->winner == NO_WINNER) {
+			co_return race->error;
+		}
+		socket = std::move(*race->sockets[race->winner]);
+		co_return boost::system::error_code();
+	}
+}
+
+awaitable<boost::system::error_code> Connector::async_connect(tcp::socket& socket, std::vector<tcp::endpoint> endpoints) {
+	if (endpoints.empty()) {
+		co_return boost::asio::error::host_not_found;
+	}
+
+	// the attempts and the race share their state, so they all run on a single strand even on a multi-threaded context.
+	auto strand = boost::asio::make_strand(socket.get_executor());
+	auto connect = run_race(socket, interleave_families(endpoints), strand);
+	co_return co_await boost::asio::co_spawn(strand, std::move(connect), use_awaitable);
+}
+
+std::vector<tcp::endpoint> Connector::interleave_families(const std::vector<tcp::endpoint>& endpoints) {
+	std::vector<tcp::endpoint> preferred, other;
+	auto preferred_v6 = endpoints.front().address().is_v6();
+	for (const auto& endpoint : endpoints) {
+		(endpoint.address().is_v6() == preferred_v6 ? preferred : other).push_back(endpoint);
+	}
+
+	std::vector<tcp::endpoint> ordered;
+	ordered.reserve(endpoints.size());
+	for (size_t i = 0; i < preferred.size() || i < other.size(); i++) {
+		if (i < preferred.size())
+			ordered.push_back(preferred[i]);
+		if (i < other.size())
+			ordered.push_back(other[i]);
+	}
+	return ordered;
+}
+
+void Connector::set_timeout(std::chrono::milliseconds timeout) {
+	timeout_ms().store(timeout.count(), std::memory_order_relaxed);
+}
+
+std::chrono::milliseconds Connector::timeout() {
+	return std::chrono::milliseconds(timeout_ms().load(std::memory_order_relaxed));
+}
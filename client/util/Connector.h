@@ -0,0 +1,40 @@
+#pragma once
+#include <vector>
+#include <chrono>
+#include <boost/asio.hpp>
+
+/// <summary>
+/// Connects a socket to the first of a host's endpoints that answers ("happy eyeballs", RFC 8305).
+/// The attempts start one after the other, ATTEMPT_DELAY apart (or as soon as the previous one failed), and race each
+/// other - so a dead address costs a short delay instead of the OS's full SYN retry timeout. The address families
+/// are interleaved, so a broken IPv6 (or IPv4) path is passed over after a single attempt.
+/// </summary>
+class Connector
+{
+public:
+	static const unsigned int DEFAULT_TIMEOUT_MS = 10000;
+	static const unsigned int ATTEMPT_DELAY_MS = 250;
+
+	/// <summary>
+	/// Connects the socket to one of the endpoints, within the connect timeout.
+	/// </summary>
+	/// <returns>The error of the last failed attempt (or timed_out) if none connected.</returns>
+	static boost::asio::awaitable<boost::system::error_code> async_connect(boost::asio::ip::tcp::socket& socket,
+		std::vector<boost::asio::ip::tcp::endpoint> endpoints);
+
+	/// <summary>
+	/// Sets the time a connection may take (all attempts included), for all connections.
+	/// </summary>
+	static void set_timeout(std::chrono::milliseconds timeout);
+
+	/// <summary>
+	/// Returns the time a connection may take.
+	/// </summary>
+	static std::chrono::milliseconds timeout();
+
+private:
+	/// <summary>
+	/// Orders the endpoints for racing: the resolver's order, with the address families alternating.
+	/// </summary>
+	static std::vector<boost::asio::ip::tcp::endpoint> interleave_families(const std::vector<boost::asio::ip::tcp::endpoint>& endpoints);
+};
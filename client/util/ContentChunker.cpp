@@ -0,0 +1,53 @@
+#include "ContentChunker.h"
+#include <array>
+
+/// <summary>
+/// Returns the gear table - a random 64 bit value for each byte value, generated at compile time (splitmix64).
+/// </summary>
+static constexpr std::array<uint64_t, 256> make_gear_table() {
+	std::array<uint64_t, 256> table{};
+	uint64_t state = 0x4D616D616E313521ULL;
+	for (auto& value : table) {
+		state += 0x9E3779B97F4A7C15ULL;
+		uint64_t z = state;
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		value = z ^ (z >> 31);
+	}
+	return table;
+}
+
+static constexpr auto GEAR = make_gear_table();
+
+static_assert(ContentChunker::MIN_CHUNK_SIZE < ContentChunker::AVERAGE_CHUNK_SIZE &&
+	ContentChunker::AVERAGE_CHUNK_SIZE < ContentChunker::MAX_CHUNK_SIZE, "Chunk sizes must be ordered!");
+
+size_t ContentChunker::next(const unsigned char* data, size_t length, bool& is_boundary) {
+	is_boundary = false;
+	size_t i = 0;
+
+	// a chunk can't end before the minimal size, so it's first bytes are skipped without hashing.
+	if (_length < MIN_CHUNK_SIZE) {
+		size_t skip = MIN_CHUNK_SIZE - _length < length ? MIN_CHUNK_SIZE - _length : length;
+		i = skip;
+		_length += skip;
+	}
+
+	for (; i < length; i++) {
+		_hash = (_hash << 1) + GEAR[data[i]];
+		_length++;
+
+		auto mask = _length < AVERAGE_CHUNK_SIZE ? MASK_STRICT : MASK_LOOSE;
+		if ((_hash & mask) == 0 || _length >= MAX_CHUNK_SIZE) {
+			is_boundary = true;
+			_hash = 0;
+			_length = 0;
+			return i + 1;
+		}
+	}
+	return length;
+}
+
+size_t ContentChunker::current_length() const {
+	return _length;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/// <summary>
+/// Splits a stream into content-defined chunks, with a rolling gear hash (FastCDC style, with normalized chunking).
+/// Boundaries depend only on the nearby content, so data inserted or removed in a file changes only the chunks around it,
+/// and identical content in different files is split into identical chunks.
+/// </summary>
+class ContentChunker
+{
+public:
+	static const size_t MIN_CHUNK_SIZE = 16 * 1024;
+	static const size_t AVERAGE_CHUNK_SIZE = 64 * 1024;
+	static const size_t MAX_CHUNK_SIZE = 256 * 1024;
+
+	/// <summary>
+	/// Finds the end of the current chunk in the next part of the stream.
+	/// </summary>
+	/// <param name="is_boundary">Set if the current chunk ends within the data - the next call starts a new chunk.</param>
+	/// <returns>The length of the data that belongs to the current chunk.</returns>
+	size_t next(const unsigned char* data, size_t length, bool& is_boundary);
+
+	/// <summary>
+	/// Returns the length of the current chunk so far.
+	/// </summary>
+	size_t current_length() const;
+
+private:
+	/// <summary>
+	/// The boundary masks - a stricter mask (more bits) is used before the average size, and a looser one after it,
+	/// so chunk sizes are concentrated around the average. The masks use high bits, that depend on more of the window.
+	/// </summary>
+	static const uint64_t MASK_STRICT = 0x9292524a49490000ULL;
+	static const uint64_t MASK_LOOSE = 0x8912224448910000ULL;
+
+	uint64_t _hash = 0;
+	size_t _length = 0;
+};
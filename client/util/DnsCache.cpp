@@ -0,0 +1,138 @@
+#include "DnsCache.h"
+#include "AtomicFile.h"
+#include <map>
+#include <mutex>
+#include <fstream>
+#include <sstream>
+
+const std::string DnsCache::FILE_NAME = "dns.cache";
+
+namespace {
+	struct CacheEntry {
+		/// <summary>
+		/// Seconds since the epoch - the file outlives the process, so the steady clock can't be used.
+		/// </summary>
+		int64_t expires = 0;
+		std::vector<boost::asio::ip::tcp::endpoint> endpoints;
+	};
+
+	/// <summary>
+	/// The cache's entries by "host port", loaded from the file on first use.
+	/// </summary>
+	struct CacheState {
+		std::mutex lock;
+		bool loaded = false;
+		std::chrono::seconds ttl = std::chrono::seconds(static_cast<int64_t>(DnsCache::DEFAULT_TTL_SECONDS));
+		std::map<std::string, CacheEntry> entries;
+	};
+
+	CacheState& cache_state() {
+		static CacheState state;
+		return state;
+	}
+
+	std::string key_of(const std::string& host, int port) {
+		return host + " " + std::to_string(port);
+	}
+
+	int64_t now_seconds() {
+		return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	}
+
+	// each line: host, port, expiry time (seconds since the epoch) and addresses, separated by spaces.
+	void load(CacheState& state) {
+		state.loaded = true;
+		std::ifstream file(DnsCache::FILE_NAME);
+		std::string line;
+		auto now = now_seconds();
+		while (std::getline(file, line)) {
+			std::istringstream fields(line);
+			std::string host, address;
+			int port = 0;
+			CacheEntry entry;
+			if (!(fields >> host >> port >> entry.expires) || entry.expires <= now) {
+				continue;
+			}
+			while (fields >> address) {
+				boost::system::error_code error;
+				auto parsed = boost::asio::ip::make_address(address, error);
+				if (!error) {
+					entry.endpoints.emplace_back(parsed, static_cast<unsigned short>(port));
+				}
+			}
+			if (!entry.endpoints.empty()) {
+				state.entries[key_of(host, port)] = std::move(entry);
+			}
+		}
+	}
+
+	void save(CacheState& state) {
+		auto now = now_seconds();
+		std::ostringstream content;
+		for (const auto& [key, entry] : state.entries) {
+			if (entry.expires <= now) {
+				continue;
+			}
+			content << key << " " << entry.expires;
+			for (const auto& endpoint : entry.endpoints) {
+				content << " " << endpoint.address().to_string();
+			}
+			content << "\n";
+		}
+
+		// replaced atomically through a temp file of this process's own, so concurrent clients never read (or rename
+		// into place) half a file.
+		AtomicFile::write(DnsCache::FILE_NAME, content.str());
+	}
+}
+
+bool DnsCache::lookup(const std::string& host, int port, std::vector<boost::asio::ip::tcp::endpoint>& endpoints) {
+	auto& state = cache_state();
+	std::lock_guard<std::mutex> guard(state.lock);
+	if (state.ttl.count() == 0) {
+		return false;
+	}
+	if (!state.loaded) {
+		load(state);
+	}
+
+	auto found = state.entries.find(key_of(host, port));
+	if (found == state.entries.end() || found->second.expires <= now_seconds()) {
+		return false;
+	}
+	endpoints = found->second.endpoints;
+	return true;
+}
+
+void DnsCache::store(const std::string& host, int port, const std::vector<boost::asio::ip::tcp::endpoint>& endpoints) {
+	auto& state = cache_state();
+	std::lock_guard<std::mutex> guard(state.lock);
+	if (state.ttl.count() == 0 || endpoints.empty()) {
+		return;
+	}
+	if (!state.loaded) {
+		load(state);
+	}
+
+	auto& entry = state.entries[key_of(host, port)];
+	entry.expires = now_seconds() + state.ttl.count();
+	entry.endpoints = endpoints;
+	save(state);
+}
+
+void DnsCache::forget(const std::string& host, int port) {
+	auto& state = cache_state();
+	std::lock_guard<std::mutex> guard(state.lock);
+	if (!state.loaded) {
+		load(state);
+	}
+	if (state.entries.erase(key_of(host, port)) > 0) {
+		save(state);
+	}
+}
+
+void DnsCache::set_ttl(std::chrono::seconds ttl) {
+	auto& state = cache_state();
+	std::lock_guard<std::mutex> guard(state.lock);
+	state.ttl = ttl;
+}
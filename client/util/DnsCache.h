@@ -0,0 +1,38 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <chrono>
+#include <boost/asio.hpp>
+
+/// <summary>
+/// Keeps the server's resolved addresses on the disk for a while, so short runs connect without waiting for DNS.
+/// The cache is shared by all the process's connections (and by following runs), and is safe to use from any thread.
+/// The OS resolver doesn't report the records' TTL, so entries expire after a fixed time (see set_ttl).
+/// </summary>
+class DnsCache
+{
+public:
+	static const std::string FILE_NAME;
+	static const unsigned int DEFAULT_TTL_SECONDS = 300;
+
+	/// <summary>
+	/// Finds the cached, unexpired endpoints of a host.
+	/// </summary>
+	/// <returns>Whether the host has any.</returns>
+	static bool lookup(const std::string& host, int port, std::vector<boost::asio::ip::tcp::endpoint>& endpoints);
+
+	/// <summary>
+	/// Caches the endpoints a host resolved to, and saves the cache. Failing to save it is ignored.
+	/// </summary>
+	static void store(const std::string& host, int port, const std::vector<boost::asio::ip::tcp::endpoint>& endpoints);
+
+	/// <summary>
+	/// Removes a host's endpoints - e.g. when none of them could be connected to.
+	/// </summary>
+	static void forget(const std::string& host, int port);
+
+	/// <summary>
+	/// Sets how long resolved endpoints are kept. Zero disables the cache.
+	/// </summary>
+	static void set_ttl(std::chrono::seconds ttl);
+};
@@ -0,0 +1,211 @@
+#include "FileSource.h"
+#include <stdexcept>
+#include <string>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+/// <summary>
+/// Files are mapped only when the whole file fits comfortably in the address space.
+/// Larger ones are read through the buffer: the pages of a mapping that were read stay charged to the process (and the
+/// whole file is read ahead), while a buffer keeps the memory of a multi-gigabyte file the same as of a small one.
+/// </summary>
+static const uint64_t MAX_MAPPED_SIZE = sizeof(void*) >= 8 ? 4ULL * 1024 * 1024 * 1024 : 256 * 1024 * 1024;
+
+#define READ_BUFFER_SIZE (256 * 1024)
+
+/// <summary>
+/// The part of a mapping that is read ahead of the current offset. It is advanced once half of it was consumed.
+/// </summary>
+static const uint64_t READ_AHEAD_WINDOW = 8 * 1024 * 1024;
+
+#ifdef _WIN32
+
+static HANDLE open_file(const std::filesystem::path& path, DWORD share_mode) {
+	return CreateFileW(path.wstring().c_str(), GENERIC_READ, share_mode, nullptr, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+}
+
+FileSource::FileSource(const std::filesystem::path& path, bool allow_mapping) {
+	// a file is mapped only through a handle without FILE_SHARE_WRITE: while it is open, no one may write to the file
+	// or truncate it - so the mapping never faults at a page that is gone. That open fails while another process has
+	// the file open for writing (e.g. a log being appended), so such a file is opened shared & read into the buffer.
+	std::error_code error;
+	auto expected_size = std::filesystem::file_size(path, error);
+	bool may_map = allow_mapping && !error && expected_size > 0 && expected_size <= MAX_MAPPED_SIZE;
+
+	_handle = may_map ? open_file(path, FILE_SHARE_READ) : INVALID_HANDLE_VALUE;
+	if (_handle == INVALID_HANDLE_VALUE) {
+		may_map = false;
+		_handle = open_file(path, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE);
+	}
+	if (_handle == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("Failed to open file! path: " + path.string());
+	}
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(_handle, &file_size)) {
+		CloseHandle(_handle);
+		throw std::runtime_error("Failed to get file size! path: " + path.string());
+	}
+	_size = static_cast<uint64_t>(file_size.QuadPart);
+
+	if (may_map && _size > 0 && _size <= MAX_MAPPED_SIZE) {
+		_mapping = CreateFileMappingW(_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (_mapping != nullptr) {
+			_mapped = static_cast<const unsigned char*>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+		}
+	}
+	if (_mapped == nullptr) {
+		_buffer.resize(READ_BUFFER_SIZE);
+	}
+}
+
+FileSource::~FileSource() {
+	if (_mapped != nullptr)
+		UnmapViewOfFile(_mapped);
+	if (_mapping != nullptr)
+		CloseHandle(_mapping);
+	CloseHandle(_handle);
+}
+
+size_t FileSource::read_at_offset(unsigned char* dest, size_t length) {
+	OVERLAPPED position = {};
+	position.Offset = static_cast<DWORD>(_offset);
+	position.OffsetHigh = static_cast<DWORD>(_offset >> 32);
+
+	DWORD read = 0;
+	if (!ReadFile(_handle, dest, static_cast<DWORD>(length), &read, &position) && GetLastError() != ERROR_HANDLE_EOF) {
+		throw std::runtime_error("Failed to read file!");
+	}
+	return read;
+}
+
+#else
+
+FileSource::FileSource(const std::filesystem::path& path, bool allow_mapping) {
+	_fd = open(path.c_str(), O_RDONLY);
+	if (_fd < 0) {
+		throw std::runtime_error("Failed to open file! path: " + path.string());
+	}
+
+	struct stat file_stat;
+	if (fstat(_fd, &file_stat) != 0) {
+		close(_fd);
+		throw std::runtime_error("Failed to get file size! path: " + path.string());
+	}
+	_size = static_cast<uint64_t>(file_stat.st_size);
+
+	// nothing keeps writers out of an open file here, and a mapped file that is truncated while it is read faults
+	// (SIGBUS) at the first access past it's new end. The file's size is checked again before each part is returned
+	// (see check_mapped_size), so a truncation is reported like a short read of the buffer is.
+	if (allow_mapping && S_ISREG(file_stat.st_mode) && _size > 0 && _size <= MAX_MAPPED_SIZE) {
+		auto address = mmap(nullptr, static_cast<size_t>(_size), PROT_READ, MAP_SHARED, _fd, 0);
+		if (address != MAP_FAILED) {
+			// the file is read once, front to back: read ahead & drop pages behind.
+			madvise(address, static_cast<size_t>(_size), MADV_SEQUENTIAL);
+			_mapped = static_cast<const unsigned char*>(address);
+			advise_ahead();
+		}
+	}
+	if (_mapped == nullptr) {
+#ifdef POSIX_FADV_SEQUENTIAL
+		posix_fadvise(_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+		_buffer.resize(READ_BUFFER_SIZE);
+	}
+}
+
+FileSource::~FileSource() {
+	if (_mapped != nullptr)
+		munmap(const_cast<unsigned char*>(_mapped), static_cast<size_t>(_size));
+	close(_fd);
+}
+
+size_t FileSource::read_at_offset(unsigned char* dest, size_t length) {
+	ssize_t result;
+	do {
+		result = pread(_fd, dest, length, static_cast<off_t>(_offset));
+	} while (result < 0 && errno == EINTR);
+
+	if (result < 0) {
+		throw std::runtime_error("Failed to read file!");
+	}
+	return static_cast<size_t>(result);
+}
+
+#endif
+
+size_t FileSource::next(const unsigned char*& data, size_t max_length) {
+	auto remaining = _size - _offset;
+	size_t length = remaining < max_length ? static_cast<size_t>(remaining) : max_length;
+
+	if (_mapped != nullptr) {
+		check_mapped_size();
+		data = _mapped + _offset;
+		_offset += length;
+		advise_ahead();
+		return length;
+	}
+
+	if (_buffer.size() < length) {
+		_buffer.resize(length);
+	}
+
+	// fill the whole requested length - the size was already sent, so a file truncated while read can't just end early.
+	size_t filled = 0;
+	while (filled < length) {
+		auto read = read_at_offset(_buffer.data() + filled, length - filled);
+		if (read == 0)
+			throw std::runtime_error("File was truncated while it was read!");
+		filled += read;
+		_offset += read;
+	}
+	data = _buffer.data();
+	return filled;
+}
+
+void FileSource::check_mapped_size() {
+#ifndef _WIN32
+	// a single fstat per part is far cheaper than copying the part - and unlike a read, touching a mapped page past
+	// the file's end doesn't fail, it faults.
+	struct stat file_stat;
+	if (fstat(_fd, &file_stat) != 0 || static_cast<uint64_t>(file_stat.st_size) < _size) {
+		throw std::runtime_error("File was truncated while it was read!");
+	}
+#endif
+}
+
+void FileSource::advise_ahead() {
+#ifndef _WIN32
+	// only a window ahead is asked for, so the pages read ahead stay bounded - not the whole file.
+	if (_advised_until >= _size || _offset + READ_AHEAD_WINDOW / 2 < _advised_until) {
+		return;
+	}
+	static const uint64_t page_size = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+	auto start = (_offset > _advised_until ? _offset : _advised_until) / page_size * page_size;
+	auto end = _offset + READ_AHEAD_WINDOW < _size ? _offset + READ_AHEAD_WINDOW : _size;
+	madvise(const_cast<unsigned char*>(_mapped) + start, static_cast<size_t>(end - start), MADV_WILLNEED);
+	_advised_until = end;
+#endif
+}
+
+void FileSource::seek(uint64_t offset) {
+	_offset = offset < _size ? offset : _size;
+}
+
+uint64_t FileSource::size() const {
+	return _size;
+}
+
+bool FileSource::is_mapped() const {
+	return _mapped != nullptr;
+}
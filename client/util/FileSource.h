@@ -0,0 +1,81 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <filesystem>
+
+/// <summary>
+/// Reads a file sequentially, with as few copies & syscalls as possible.
+/// The file is memory mapped when possible (with sequential access hints), otherwise it is read by offset into an
+/// internal buffer. On Windows, a file that another process has open for writing is read into the buffer.
+/// </summary>
+class FileSource
+{
+public:
+	/// <summary>
+	/// Opens the file for reading. Throws std::runtime_error on failure.
+	/// </summary>
+	/// <param name="allow_mapping">Whether the file may be memory mapped.</param>
+	explicit FileSource(const std::filesystem::path& path, bool allow_mapping = true);
+	~FileSource();
+	FileSource(const FileSource&) = delete;
+	FileSource& operator=(const FileSource&) = delete;
+
+	/// <summary>
+	/// Returns the next part of the file, without copying it when mapped.
+	/// The returned data is valid until the next call - or as long as the source, when the file is mapped.
+	/// </summary>
+	/// <param name="data">Set to the start of the returned data.</param>
+	/// <param name="max_length">Maximal length to return.</param>
+	/// <returns>The returned length: max_length, unless the end of the file is reached. 0 at the end of the file.</returns>
+	/// <exception cref="std::runtime_error">The file ended before the size it had when it was opened.</exception>
+	size_t next(const unsigned char*& data, size_t max_length);
+
+	/// <summary>
+	/// Moves the position of the next read. Offsets past the end of the file are treated as the end of the file.
+	/// </summary>
+	void seek(uint64_t offset);
+
+	/// <summary>
+	/// Returns the total size of the file.
+	/// </summary>
+	uint64_t size() const;
+
+	/// <summary>
+	/// Returns whether the file is read through a memory mapping.
+	/// </summary>
+	bool is_mapped() const;
+
+private:
+	/// <summary>
+	/// Reads up to length bytes from the current offset into dest, returns the number of bytes read.
+	/// </summary>
+	size_t read_at_offset(unsigned char* dest, size_t length);
+
+	/// <summary>
+	/// Throws std::runtime_error if the mapped file was truncated below the mapped size. Windows keeps writers out of a
+	/// mapped file, so it only checks on POSIX systems.
+	/// </summary>
+	void check_mapped_size();
+
+	/// <summary>
+	/// Asks the OS to read the mapping ahead of the current offset - a window of it at a time, as it is consumed.
+	/// </summary>
+	void advise_ahead();
+
+#ifdef _WIN32
+	void* _handle;
+	void* _mapping = nullptr;
+#else
+	int _fd;
+#endif
+	const unsigned char* _mapped = nullptr;
+	std::vector<unsigned char> _buffer;
+	uint64_t _size = 0;
+	uint64_t _offset = 0;
+	/// <summary>
+	/// The end of the mapping's part that the OS was asked to read ahead.
+	/// </summary>
+	uint64_t _advised_until = 0;
+};
+
@@ -0,0 +1,47 @@
+#include "FileStat.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#ifdef _WIN32
+
+bool FileStat::of(const std::filesystem::path& path, FileStat& stat) {
+	// no access is needed for the file's information - it doesn't conflict with writers.
+	auto handle = CreateFileW(path.wstring().c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+		OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, nullptr);
+	if (handle == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	BY_HANDLE_FILE_INFORMATION info;
+	auto result = GetFileInformationByHandle(handle, &info);
+	CloseHandle(handle);
+	if (!result || (info.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+		return false;
+	}
+
+	stat.size = (static_cast<uint64_t>(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+	stat.mtime = static_cast<int64_t>((static_cast<uint64_t>(info.ftLastWriteTime.dwHighDateTime) << 32) | info.ftLastWriteTime.dwLowDateTime);
+	stat.inode = (static_cast<uint64_t>(info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+	return true;
+}
+
+#else
+
+bool FileStat::of(const std::filesystem::path& path, FileStat& stat) {
+	struct stat info;
+	if (::stat(path.c_str(), &info) != 0 || !S_ISREG(info.st_mode)) {
+		return false;
+	}
+
+	stat.size = static_cast<uint64_t>(info.st_size);
+	stat.mtime = static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+	stat.inode = static_cast<uint64_t>(info.st_ino);
+	return true;
+}
+
+#endif
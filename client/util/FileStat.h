@@ -0,0 +1,28 @@
+#pragma once
+#include <stdint.h>
+#include <filesystem>
+
+/// <summary>
+/// The identity of a file's content, as far as the file system tells without reading it:
+/// a file whose size, modification time & inode are unchanged is assumed to have the same content.
+/// </summary>
+struct FileStat
+{
+	uint64_t size = 0;
+	/// <summary>
+	/// The last modification time, in the platform's units (nanoseconds on POSIX, 100 nanoseconds on Windows).
+	/// </summary>
+	int64_t mtime = 0;
+	/// <summary>
+	/// The inode (file index on Windows) - changes when the file is replaced, even with an old modification time.
+	/// </summary>
+	uint64_t inode = 0;
+
+	/// <summary>
+	/// Gets the stat of a file, with a single system call where possible.
+	/// </summary>
+	/// <returns>Whether the file exists & was stat'ed.</returns>
+	static bool of(const std::filesystem::path& path, FileStat& stat);
+
+	bool operator==(const FileStat& other) const = default;
+};
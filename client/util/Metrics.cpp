@@ -0,0 +1,272 @@
+#include "Metrics.h"
+#include "AtomicFile.h"
+#include <bit>
+#include <cmath>
+#include <sstream>
+#include <iomanip>
+
+/// <summary>
+/// The exported duration buckets are the histogram's own, so their counts are exact: the ones that end right below
+/// 1.5 & 2 times each power of 2 nanoseconds, from 2^10 (~1 microsecond) to 2^34 (~17 seconds).
+/// The bounds are the same for every client, so they can be aggregated across clients.
+/// </summary>
+static const int EXPORTED_MIN_POWER = 10;
+static const int EXPORTED_MAX_POWER = 34;
+
+/// <summary>
+/// The percentiles that are exported for each histogram.
+/// </summary>
+static const double EXPORTED_PERCENTILES[] = { 50, 90, 99, 99.9 };
+
+/// <summary>
+/// The prefix of the exported metric names.
+/// </summary>
+static const char* METRIC_PREFIX = "maman15_client_phase";
+static const char* GAUGE_PREFIX = "maman15_client_";
+
+LatencyHistogram::LatencyHistogram() : _count(0), _sum(0), _min(UINT64_MAX), _max(0) {
+	for (auto& bucket : _buckets) {
+		bucket.store(0, std::memory_order_relaxed);
+	}
+}
+
+size_t LatencyHistogram::bucket_of(uint64_t value) {
+	// small values are counted exactly. Larger ones by their highest bit & the next SUB_BUCKET_BITS bits below it.
+	if (value < SUB_BUCKET_COUNT) {
+		return static_cast<size_t>(value);
+	}
+	auto shift = std::bit_width(value) - 1 - SUB_BUCKET_BITS;
+	auto sub_bucket = static_cast<size_t>(value >> shift) - SUB_BUCKET_COUNT;
+	return (shift + 1) * SUB_BUCKET_COUNT + sub_bucket;
+}
+
+uint64_t LatencyHistogram::bucket_high(size_t bucket) {
+	if (bucket < SUB_BUCKET_COUNT) {
+		return bucket;
+	}
+	auto shift = bucket / SUB_BUCKET_COUNT - 1;
+	auto low = static_cast<uint64_t>(SUB_BUCKET_COUNT + bucket % SUB_BUCKET_COUNT) << shift;
+	return low + ((static_cast<uint64_t>(1) << shift) - 1);
+}
+
+void LatencyHistogram::record(uint64_t value) {
+	_buckets[bucket_of(value)].fetch_add(1, std::memory_order_relaxed);
+	_count.fetch_add(1, std::memory_order_relaxed);
+	_sum.fetch_add(value, std::memory_order_relaxed);
+
+	auto current = _min.load(std::memory_order_relaxed);
+	while (value < current && !_min.compare_exchange_weak(current, value, std::memory_order_relaxed)) {}
+	current = _max.load(std::memory_order_relaxed);
+	while (value > current && !_max.compare_exchange_weak(current, value, std::memory_order_relaxed)) {}
+}
+
+uint64_t LatencyHistogram::count() const {
+	return _count.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::sum() const {
+	return _sum.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::min() const {
+	return count() > 0 ? _min.load(std::memory_order_relaxed) : 0;
+}
+
+uint64_t LatencyHistogram::max() const {
+	return _max.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::percentile(double percentile) const {
+	auto total = count();
+	if (total == 0) {
+		return 0;
+	}
+
+	// the rank of the value, rounded up - at least the first value.
+	auto rank = static_cast<uint64_t>(std::ceil(percentile / 100.0 * total));
+	rank = rank == 0 ? 1 : rank;
+	uint64_t seen = 0;
+	for (size_t i = 0; i < BUCKET_COUNT; i++) {
+		seen += _buckets[i].load(std::memory_order_relaxed);
+		if (seen >= rank) {
+			auto high = bucket_high(i);
+			return high < max() ? high : max();
+		}
+	}
+	return max();
+}
+
+uint64_t LatencyHistogram::count_at_most(uint64_t bound) const {
+	uint64_t result = 0;
+	for (size_t i = 0; i < BUCKET_COUNT && bucket_high(i) <= bound; i++) {
+		result += _buckets[i].load(std::memory_order_relaxed);
+	}
+	return result;
+}
+
+/// <summary>
+/// The histograms of a single phase.
+/// </summary>
+struct PhaseHistograms {
+	LatencyHistogram durations;
+	LatencyHistogram bytes;
+};
+
+static PhaseHistograms& histograms_of(Metrics::Phase phase) {
+	static std::array<PhaseHistograms, Metrics::PhaseCount> histograms;
+	return histograms[phase];
+}
+
+Metrics::Timer::Timer(Phase phase, uint64_t bytes) : _phase(phase), _bytes(bytes), _start(std::chrono::steady_clock::now()) {}
+
+Metrics::Timer::~Timer() {
+	record(_phase, std::chrono::steady_clock::now() - _start, _bytes);
+}
+
+void Metrics::Timer::add_bytes(uint64_t bytes) {
+	_bytes += bytes;
+}
+
+void Metrics::record(Phase phase, std::chrono::nanoseconds duration, uint64_t bytes) {
+	auto& histograms = histograms_of(phase);
+	histograms.durations.record(static_cast<uint64_t>(duration.count()));
+	histograms.bytes.record(bytes);
+}
+
+const char* Metrics::name(Phase phase) {
+	switch (phase) {
+	case PhaseResolve: return "resolve";
+	case PhaseConnect: return "connect";
+	case PhaseRegister: return "register";
+	case PhaseKeyExchange: return "key_exchange";
+	case PhaseRsa: return "rsa";
+	case PhaseChecksum: return "checksum";
+	case PhaseCompress: return "compress";
+	case PhaseEncrypt: return "encrypt";
+	case PhaseSend: return "send";
+	case PhaseWaitResponse: return "wait_response";
+	case PhaseUploadFile: return "upload_file";
+	default: return "unknown";
+	}
+}
+
+static std::atomic<uint64_t>& gauge_value(Metrics::Gauge gauge) {
+	static std::array<std::atomic<uint64_t>, Metrics::GaugeCount> gauges{};
+	return gauges[gauge];
+}
+
+void Metrics::set(Gauge gauge, uint64_t value) {
+	gauge_value(gauge).store(value, std::memory_order_relaxed);
+}
+
+uint64_t Metrics::get(Gauge gauge) {
+	return gauge_value(gauge).load(std::memory_order_relaxed);
+}
+
+const char* Metrics::name(Gauge gauge) {
+	switch (gauge) {
+	case GaugeSocketRtt: return "socket_rtt_microseconds";
+	case GaugeSocketCongestionWindow: return "socket_congestion_window_bytes";
+	case GaugeSocketDeliveryRate: return "socket_delivery_rate_bytes_per_second";
+	case GaugeSocketBandwidthDelay: return "socket_bandwidth_delay_bytes";
+	case GaugeSocketSendBuffer: return "socket_send_buffer_bytes";
+	case GaugeSocketReceiveBuffer: return "socket_receive_buffer_bytes";
+	case GaugeSocketWriteSize: return "socket_write_size_bytes";
+	default: return "unknown";
+	}
+}
+
+const LatencyHistogram& Metrics::durations(Phase phase) {
+	return histograms_of(phase).durations;
+}
+
+const LatencyHistogram& Metrics::bytes(Phase phase) {
+	return histograms_of(phase).bytes;
+}
+
+/// <summary>
+/// Writes the summary of a histogram as a JSON object.
+/// </summary>
+static void write_json_summary(std::ostream& out, const LatencyHistogram& histogram) {
+	out << "{\"min\": " << histogram.min() << ", \"max\": " << histogram.max() << ", \"sum\": " << histogram.sum();
+	for (auto percentile : EXPORTED_PERCENTILES) {
+		out << ", \"p" << percentile << "\": " << histogram.percentile(percentile);
+	}
+	out << "}";
+}
+
+void Metrics::write_json(std::ostream& out) {
+	out << "{" << std::endl;
+	out << "  \"phases\": [" << std::endl;
+	for (int i = 0; i < PhaseCount; i++) {
+		auto phase = static_cast<Phase>(i);
+		out << "    {\"phase\": \"" << name(phase) << "\", \"count\": " << durations(phase).count() << ", \"duration_ns\": ";
+		write_json_summary(out, durations(phase));
+		out << ", \"bytes\": ";
+		write_json_summary(out, bytes(phase));
+		out << "}" << (i + 1 < PhaseCount ? "," : "") << std::endl;
+	}
+	out << "  ]," << std::endl;
+	out << "  \"gauges\": {";
+	for (int i = 0; i < GaugeCount; i++) {
+		auto gauge = static_cast<Gauge>(i);
+		out << (i > 0 ? ", " : "") << "\"" << name(gauge) << "\": " << get(gauge);
+	}
+	out << "}" << std::endl;
+	out << "}" << std::endl;
+}
+
+void Metrics::write_prometheus(std::ostream& out) {
+	// durations as histograms with fixed bounds, so they can be aggregated across clients.
+	out << "# HELP " << METRIC_PREFIX << "_duration_seconds Duration of the client's phases." << std::endl;
+	out << "# TYPE " << METRIC_PREFIX << "_duration_seconds histogram" << std::endl;
+	for (int i = 0; i < PhaseCount; i++) {
+		auto phase = static_cast<Phase>(i);
+		const auto& histogram = durations(phase);
+		for (int power = EXPORTED_MIN_POWER; power < EXPORTED_MAX_POWER; power++) {
+			// 1.5 & 2 times a power of 2 start buckets, so the values right below them end buckets.
+			for (auto start : { static_cast<uint64_t>(3) << (power - 1), static_cast<uint64_t>(1) << (power + 1) }) {
+				auto bound = LatencyHistogram::bucket_high(LatencyHistogram::bucket_of(start) - 1);
+				// nanosecond precision, so the printed bound is the bucket's.
+				out << METRIC_PREFIX << "_duration_seconds_bucket{phase=\"" << name(phase) << "\",le=\""
+					<< std::setprecision(12) << bound / 1e9 << std::setprecision(6) << "\"} " << histogram.count_at_most(bound) << std::endl;
+			}
+		}
+		out << METRIC_PREFIX << "_duration_seconds_bucket{phase=\"" << name(phase) << "\",le=\"+Inf\"} " << histogram.count() << std::endl;
+		out << METRIC_PREFIX << "_duration_seconds_sum{phase=\"" << name(phase) << "\"} " << histogram.sum() / 1e9 << std::endl;
+		out << METRIC_PREFIX << "_duration_seconds_count{phase=\"" << name(phase) << "\"} " << histogram.count() << std::endl;
+	}
+
+	// byte counts as summaries - their scale differs too much between phases for shared bounds.
+	out << "# HELP " << METRIC_PREFIX << "_bytes Bytes processed by each run of the client's phases." << std::endl;
+	out << "# TYPE " << METRIC_PREFIX << "_bytes summary" << std::endl;
+	for (int i = 0; i < PhaseCount; i++) {
+		auto phase = static_cast<Phase>(i);
+		const auto& histogram = bytes(phase);
+		for (auto percentile : EXPORTED_PERCENTILES) {
+			out << METRIC_PREFIX << "_bytes{phase=\"" << name(phase) << "\",quantile=\"" << percentile / 100 << "\"} "
+				<< histogram.percentile(percentile) << std::endl;
+		}
+		out << METRIC_PREFIX << "_bytes_sum{phase=\"" << name(phase) << "\"} " << histogram.sum() << std::endl;
+		out << METRIC_PREFIX << "_bytes_count{phase=\"" << name(phase) << "\"} " << histogram.count() << std::endl;
+	}
+
+	for (int i = 0; i < GaugeCount; i++) {
+		auto gauge = static_cast<Gauge>(i);
+		out << "# TYPE " << GAUGE_PREFIX << name(gauge) << " gauge" << std::endl;
+		out << GAUGE_PREFIX << name(gauge) << " " << get(gauge) << std::endl;
+	}
+}
+
+void Metrics::dump(const std::filesystem::path& path) {
+	// the files may be dumped again while the process runs - a collector never reads a half written one.
+	std::ostringstream json;
+	write_json(json);
+	auto json_path = path;
+	AtomicFile::write(json_path.replace_extension(".json"), json.str());
+
+	std::ostringstream prometheus;
+	write_prometheus(prometheus);
+	auto prometheus_path = path;
+	AtomicFile::write(prometheus_path.replace_extension(".prom"), prometheus.str());
+}
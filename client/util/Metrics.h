@@ -0,0 +1,165 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <filesystem>
+
+/// <summary>
+/// A histogram of non-negative values in the style of HdrHistogram: values are counted in log-linear buckets - 16 buckets
+/// per power of 2, so every value is counted within 1/16 (6.25%) of it's actual value, from 1 to 2^64.
+/// Recording is lock-free (a few relaxed atomic operations), so a histogram may be shared by all threads.
+/// </summary>
+class LatencyHistogram
+{
+public:
+	static const int SUB_BUCKET_BITS = 4;
+	static const size_t SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS;
+	static const size_t BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT;
+
+	LatencyHistogram();
+	LatencyHistogram(const LatencyHistogram&) = delete;
+	LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+	void record(uint64_t value);
+
+	uint64_t count() const;
+	uint64_t sum() const;
+	uint64_t min() const;
+	uint64_t max() const;
+
+	/// <summary>
+	/// Returns the value at the percentile (0-100) - the highest value of it's bucket, capped by the maximal value recorded.
+	/// </summary>
+	uint64_t percentile(double percentile) const;
+
+	/// <summary>
+	/// Returns the number of values recorded that are not higher than the bound - exact at bucket bounds.
+	/// </summary>
+	uint64_t count_at_most(uint64_t bound) const;
+
+	/// <summary>
+	/// Returns the index of the bucket that counts the value.
+	/// </summary>
+	static size_t bucket_of(uint64_t value);
+
+	/// <summary>
+	/// Returns the highest value that is counted in the bucket.
+	/// </summary>
+	static uint64_t bucket_high(size_t bucket);
+
+private:
+	std::array<std::atomic<uint64_t>, BUCKET_COUNT> _buckets;
+	std::atomic<uint64_t> _count;
+	std::atomic<uint64_t> _sum;
+	std::atomic<uint64_t> _min;
+	std::atomic<uint64_t> _max;
+};
+
+/// <summary>
+/// Records the duration and byte count of each phase of the client's work, for the whole process.
+/// The overhead is two clock reads and a few relaxed atomic operations per phase, so it is always on.
+/// Gauges hold the last value of settings the client chooses while it runs (e.g. socket tuning).
+/// </summary>
+class Metrics
+{
+public:
+	enum Phase {
+		PhaseResolve,
+		PhaseConnect,
+		PhaseRegister,
+		PhaseKeyExchange,
+		PhaseRsa,
+		PhaseChecksum,
+		PhaseCompress,
+		PhaseEncrypt,
+		PhaseSend,
+		PhaseWaitResponse,
+		PhaseUploadFile,
+		PhaseCount
+	};
+
+	enum Gauge {
+		GaugeSocketRtt,
+		GaugeSocketCongestionWindow,
+		GaugeSocketDeliveryRate,
+		GaugeSocketBandwidthDelay,
+		GaugeSocketSendBuffer,
+		GaugeSocketReceiveBuffer,
+		GaugeSocketWriteSize,
+		GaugeCount
+	};
+
+	/// <summary>
+	/// Measures a single run of a phase, from it's construction to it's destruction.
+	/// </summary>
+	class Timer {
+	public:
+		explicit Timer(Phase phase, uint64_t bytes = 0);
+		~Timer();
+		Timer(const Timer&) = delete;
+		Timer& operator=(const Timer&) = delete;
+
+		/// <summary>
+		/// Adds to the byte count of the run, for phases that learn it while they run.
+		/// </summary>
+		void add_bytes(uint64_t bytes);
+
+	private:
+		Phase _phase;
+		uint64_t _bytes;
+		std::chrono::steady_clock::time_point _start;
+	};
+
+	/// <summary>
+	/// Records a single run of a phase.
+	/// </summary>
+	static void record(Phase phase, std::chrono::nanoseconds duration, uint64_t bytes = 0);
+
+	/// <summary>
+	/// Returns the name of the phase, as it appears in the exported metrics.
+	/// </summary>
+	static const char* name(Phase phase);
+
+	/// <summary>
+	/// Sets the value of a gauge.
+	/// </summary>
+	static void set(Gauge gauge, uint64_t value);
+
+	/// <summary>
+	/// Returns the value of a gauge - 0 if it was never set.
+	/// </summary>
+	static uint64_t get(Gauge gauge);
+
+	/// <summary>
+	/// Returns the name of the gauge (with it's unit), as it appears in the exported metrics.
+	/// </summary>
+	static const char* name(Gauge gauge);
+
+	/// <summary>
+	/// Returns the histogram of the durations of the phase's runs, in nanoseconds.
+	/// </summary>
+	static const LatencyHistogram& durations(Phase phase);
+
+	/// <summary>
+	/// Returns the histogram of the byte counts of the phase's runs.
+	/// </summary>
+	static const LatencyHistogram& bytes(Phase phase);
+
+	/// <summary>
+	/// Writes the metrics of all phases as a JSON document.
+	/// </summary>
+	static void write_json(std::ostream& out);
+
+	/// <summary>
+	/// Writes the metrics of all phases in the Prometheus text exposition format.
+	/// </summary>
+	static void write_prometheus(std::ostream& out);
+
+	/// <summary>
+	/// Writes the metrics to the path with a .json extension and with a .prom extension, replacing each file atomically.
+	/// </summary>
+	static void dump(const std::filesystem::path& path);
+};
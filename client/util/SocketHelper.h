@@ -1,4 +1,9 @@
+#pragma once
+#include <array>
+#include <atomic>
 #include <boost/asio.hpp>
+#include "Metrics.h"
+#include "Trace.h"
 
 /// <summary>
 /// This class provides helper methods to handle socket operations with boost::asio::ip::tcp::socket objects.
@@ -15,13 +20,106 @@ private:
 		T as_original;
 	};
 
+	/// <summary>
+	/// The most bytes handed to the socket by a single write call - asio's own default is 64 KiB.
+	/// It is shared by all connections, since they all take the same path to the server.
+	/// </summary>
+	static std::atomic<size_t>& write_size_limit() {
+		static std::atomic<size_t> limit(DEFAULT_WRITE_SIZE);
+		return limit;
+	}
+
+	/// <summary>
+	/// Writes the whole data, in writes of up to the write size limit each.
+	/// </summary>
+	static size_t write_condition(const boost::system::error_code& error, size_t) {
+		return error ? 0 : write_size_limit().load(std::memory_order_relaxed);
+	}
+
 public:
+	static const size_t DEFAULT_WRITE_SIZE = 64 * 1024;
+
+	/// <summary>
+	/// Sets the most bytes handed to the socket by a single write call, for all connections.
+	/// Larger writes take fewer system calls to fill a large send buffer.
+	/// </summary>
+	static void set_write_size(size_t write_size) {
+		write_size_limit().store(write_size, std::memory_order_relaxed);
+	}
+
+	/// <summary>
+	/// Returns the most bytes handed to the socket by a single write call.
+	/// </summary>
+	static size_t write_size() {
+		return write_size_limit().load(std::memory_order_relaxed);
+	}
+
+	/// <summary>
+	/// Holds back partial TCP segments while it exists (TCP_CORK, where supported),
+	/// so a request sent in several writes leaves the socket in full segments.
+	/// The remaining data is flushed once it is destroyed.
+	/// </summary>
+	class Cork {
+		boost::asio::ip::tcp::socket& _socket;
+	public:
+		explicit Cork(boost::asio::ip::tcp::socket& socket) : _socket(socket) {
+			set_cork(_socket, true);
+		}
+		~Cork() {
+			set_cork(_socket, false);
+		}
+		Cork(const Cork&) = delete;
+		Cork& operator=(const Cork&) = delete;
+	};
+
+	/// <summary>
+	/// Disables Nagle's algorithm on the socket: requests are coalesced by the client itself,
+	/// so small writes should go out right away instead of waiting for delayed ACKs.
+	/// </summary>
+	static void set_no_delay(boost::asio::ip::tcp::socket& socket) {
+		boost::system::error_code ignored;
+		socket.set_option(boost::asio::ip::tcp::no_delay(true), ignored);
+	}
+
+	/// <summary>
+	/// Returns a buffer over a static struct's data, to send it along other buffers.
+	/// </summary>
+	template <typename T>
+	static boost::asio::const_buffer static_buffer(const T* source_data) {
+		return boost::asio::buffer(static_cast<const void*>(source_data), sizeof(T));
+	}
+
+	/// <summary>
+	/// Sends a prefix (e.g. a request struct) and a body part in a single gather write.
+	/// </summary>
+	static void send_gather(boost::asio::const_buffer prefix,
+		boost::asio::const_buffer body,
+		boost::asio::ip::tcp::socket& dest) {
+		Metrics::Timer timer(Metrics::PhaseSend, prefix.size() + body.size());
+		TRACE_SCOPE_BYTES("send", prefix.size() + body.size());
+		std::array<boost::asio::const_buffer, 2> buffers = { prefix, body };
+		boost::asio::write(dest, buffers, write_condition);
+	}
+
+	/// <summary>
+	/// Sends a prefix (e.g. a request struct) and a body part in a single gather write, asynchronously.
+	/// </summary>
+	static boost::asio::awaitable<void> async_send_gather(boost::asio::const_buffer prefix,
+		boost::asio::const_buffer body,
+		boost::asio::ip::tcp::socket& dest) {
+		Metrics::Timer timer(Metrics::PhaseSend, prefix.size() + body.size());
+		TRACE_SCOPE_BYTES("send", prefix.size() + body.size());
+		std::array<boost::asio::const_buffer, 2> buffers = { prefix, body };
+		co_await boost::asio::async_write(dest, buffers, write_condition, boost::asio::use_awaitable);
+	}
+
 	/// <summary>
 	/// Recieved a static struct's data from the socket.
 	/// </summary>
 	template <typename T>
 	static void recieve_static(T* dest_data,
 		boost::asio::ip::tcp::socket& src) {
+		TRACE_SCOPE_BYTES("receive", sizeof(T));
 		auto* dest = (_SocketData<T>*)dest_data;
 		boost::asio::read(src, boost::asio::buffer(dest->as_buffer, sizeof(dest->as_buffer)));
 	}
@@ -33,6 +131,7 @@ public:
 	static void recieve_dynamic(T* dest_data,
 		boost::asio::ip::tcp::socket& src,
 		size_t read_count) {
+		TRACE_SCOPE_BYTES("receive", read_count);
 		unsigned char* temp = (unsigned char*)dest_data;
 		boost::asio::read(src, boost::asio::buffer(temp, read_count));
 	}
@@ -43,8 +142,54 @@ public:
 	template <typename T>
 	static void send_static(T* source_data,
 		boost::asio::ip::tcp::socket& dest) {
+		Metrics::Timer timer(Metrics::PhaseSend, sizeof(T));
+		TRACE_SCOPE_BYTES("send", sizeof(T));
+		auto src = (_SocketData<T>*)source_data;
+		boost::asio::write(dest, boost::asio::buffer(src->as_buffer, sizeof(src->as_buffer)), write_condition);
+	}
+
+	/// <summary>
+	/// Recieves a static struct's data from the socket, asynchronously.
+	/// </summary>
+	template <typename T>
+	static boost::asio::awaitable<void> async_recieve_static(T* dest_data,
+		boost::asio::ip::tcp::socket& src) {
+		TRACE_SCOPE_BYTES("receive", sizeof(T));
+		auto* dest = (_SocketData<T>*)dest_data;
+		co_await boost::asio::async_read(src, boost::asio::buffer(dest->as_buffer, sizeof(dest->as_buffer)), boost::asio::use_awaitable);
+	}
+
+	/// <summary>
+	/// Recieves a dynamic amount of a struct's data from the socket, asynchronously.
+	/// </summary>
+	template <typename T>
+	static boost::asio::awaitable<void> async_recieve_dynamic(T* dest_data,
+		boost::asio::ip::tcp::socket& src,
+		size_t read_count) {
+		TRACE_SCOPE_BYTES("receive", read_count);
+		unsigned char* temp = (unsigned char*)dest_data;
+		co_await boost::asio::async_read(src, boost::asio::buffer(temp, read_count), boost::asio::use_awaitable);
+	}
+
+	/// <summary>
+	/// Sends a static data in struct through the socket, asynchronously.
+	/// </summary>
+	template <typename T>
+	static boost::asio::awaitable<void> async_send_static(T* source_data,
+		boost::asio::ip::tcp::socket& dest) {
+		Metrics::Timer timer(Metrics::PhaseSend, sizeof(T));
+		TRACE_SCOPE_BYTES("send", sizeof(T));
 		auto src = (_SocketData<T>*)source_data;
-		boost::asio::write(dest, boost::asio::buffer(src->as_buffer, sizeof(src->as_buffer)));
+		co_await boost::asio::async_write(dest, boost::asio::buffer(src->as_buffer, sizeof(src->as_buffer)), write_condition, boost::asio::use_awaitable);
+	}
+
+private:
+	static void set_cork(boost::asio::ip::tcp::socket& socket, bool enabled) {
+#ifdef TCP_CORK
+		typedef boost::asio::detail::socket_option::boolean<IPPROTO_TCP, TCP_CORK> tcp_cork;
+		boost::system::error_code ignored;
+		socket.set_option(tcp_cork(enabled), ignored);
+#endif
 	}
 };
 
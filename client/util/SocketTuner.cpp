@@ -0,0 +1,127 @@
+#include "SocketTuner.h"
+#include "SocketHelper.h"
+#include "Metrics.h"
+#include <fstream>
+
+#ifdef _WIN32
+#include <mstcpip.h>
+#else
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
+
+SocketTuner::SocketTuner(boost::asio::ip::tcp::socket& socket) : _socket(socket) {}
+
+#ifdef _WIN32
+
+bool SocketTuner::read_path_info(boost::asio::ip::tcp::socket& socket, PathInfo& info) {
+	DWORD version = 0;
+	TCP_INFO_v0 tcp_info;
+	DWORD returned = 0;
+	if (WSAIoctl(socket.native_handle(), SIO_TCP_INFO, &version, sizeof(version), &tcp_info, sizeof(tcp_info),
+		&returned, nullptr, nullptr) != 0 || tcp_info.RttUs == 0) {
+		return false;
+	}
+	info.rtt_us = tcp_info.RttUs;
+	info.congestion_window = tcp_info.Cwnd;
+	return true;
+}
+
+bool SocketTuner::read_send_buffer_limits(uint64_t& autotuning_max, uint64_t& explicit_max) {
+	// the send buffer is grown by the ideal send backlog, unless it is set - explicit sizes never do better.
+	autotuning_max = 0;
+	explicit_max = 0;
+	return false;
+}
+
+#else
+
+bool SocketTuner::read_send_buffer_limits(uint64_t& autotuning_max, uint64_t& explicit_max) {
+	// the third value of tcp_wmem is the most autotuning grows a send buffer to.
+	uint64_t min_size = 0, default_size = 0;
+	std::ifstream tcp_wmem("/proc/sys/net/ipv4/tcp_wmem");
+	std::ifstream wmem_max("/proc/sys/net/core/wmem_max");
+	if (!(tcp_wmem >> min_size >> default_size >> autotuning_max) || !(wmem_max >> explicit_max)) {
+		return false;
+	}
+	return explicit_max > autotuning_max;
+}
+
+bool SocketTuner::read_path_info(boost::asio::ip::tcp::socket& socket, PathInfo& info) {
+	struct tcp_info tcp_info = {};
+	socklen_t length = sizeof(tcp_info);
+	if (getsockopt(socket.native_handle(), IPPROTO_TCP, TCP_INFO, &tcp_info, &length) != 0 || tcp_info.tcpi_rtt == 0) {
+		return false;
+	}
+	info.rtt_us = tcp_info.tcpi_rtt;
+	// the window is counted in segments.
+	info.congestion_window = static_cast<uint64_t>(tcp_info.tcpi_snd_cwnd) * tcp_info.tcpi_snd_mss;
+	return true;
+}
+
+#endif
+
+bool SocketTuner::tune(uint64_t bytes) {
+	PathInfo path;
+	if (bytes < MIN_MEASURED_BYTES || !read_path_info(_socket, path)) {
+		return false;
+	}
+
+	// the congestion window is the data the path carries in one round trip - it's bandwidth-delay product.
+	// it only grows while the window is the limit, so a stream capped by it's buffer measures about the buffer.
+	auto bandwidth_delay = path.congestion_window;
+	auto delivery_rate = bandwidth_delay * 1000000 / path.rtt_us;
+
+	auto desired = 2 * bandwidth_delay;
+	if (desired > static_cast<uint64_t>(MAX_BUFFER_SIZE)) {
+		desired = MAX_BUFFER_SIZE;
+	}
+
+	// a set buffer is no longer autotuned, so it is set only when autotuning can't reach the desired size but an explicit
+	// size can - and then it only grows. The kernel caps it at wmem_max.
+	boost::system::error_code ignored;
+	boost::asio::socket_base::send_buffer_size send_buffer;
+	_socket.get_option(send_buffer, ignored);
+	uint64_t autotuning_max = 0, explicit_max = 0;
+	if (read_send_buffer_limits(autotuning_max, explicit_max) && desired > autotuning_max &&
+		desired > static_cast<uint64_t>(send_buffer.value())) {
+		if (desired > explicit_max) {
+			desired = explicit_max;
+		}
+		_socket.set_option(boost::asio::socket_base::send_buffer_size(static_cast<int>(desired)), ignored);
+		_socket.get_option(send_buffer, ignored);
+	}
+	boost::asio::socket_base::receive_buffer_size receive_buffer;
+	_socket.get_option(receive_buffer, ignored);
+
+	// a quarter of the bandwidth-delay product per write keeps the send buffer full with few system calls.
+	auto write_size = static_cast<size_t>(bandwidth_delay / 4);
+	if (write_size > MAX_WRITE_SIZE) {
+		write_size = MAX_WRITE_SIZE;
+	}
+	if (write_size > SocketHelper::write_size()) {
+		SocketHelper::set_write_size(write_size);
+	}
+
+	_stats.path = path;
+	_stats.delivery_rate = delivery_rate;
+	_stats.bandwidth_delay = bandwidth_delay;
+	_stats.send_buffer = send_buffer.value();
+	_stats.receive_buffer = receive_buffer.value();
+	_stats.write_size = SocketHelper::write_size();
+	_stats.tunings++;
+
+	Metrics::set(Metrics::GaugeSocketRtt, path.rtt_us);
+	Metrics::set(Metrics::GaugeSocketCongestionWindow, path.congestion_window);
+	Metrics::set(Metrics::GaugeSocketDeliveryRate, delivery_rate);
+	Metrics::set(Metrics::GaugeSocketBandwidthDelay, bandwidth_delay);
+	Metrics::set(Metrics::GaugeSocketSendBuffer, static_cast<uint64_t>(_stats.send_buffer));
+	Metrics::set(Metrics::GaugeSocketReceiveBuffer, static_cast<uint64_t>(_stats.receive_buffer));
+	Metrics::set(Metrics::GaugeSocketWriteSize, _stats.write_size);
+	return true;
+}
+
+const SocketTuner::Stats& SocketTuner::stats() const {
+	return _stats;
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <boost/asio.hpp>
+
+/// <summary>
+/// Sizes a connection's writes (and, where it pays off, it's send buffer) by the path's bandwidth-delay product - it's
+/// congestion window, as measured by the OS (TCP_INFO) after the connection uploads.
+/// The OS autotunes the socket buffers, and setting a size explicitly turns that off for the socket - so the buffers are
+/// left to it. The exception is a Linux host whose autotuning limit (tcp_wmem) is below the desired size while the
+/// explicit limit (wmem_max) is above it: only then is the send buffer set, to twice the bandwidth-delay product.
+/// The receive buffer is never set - it's window scale was fixed when the connection was made.
+/// </summary>
+class SocketTuner
+{
+public:
+	static const int MAX_BUFFER_SIZE = 64 * 1024 * 1024;
+	static const size_t MAX_WRITE_SIZE = 4 * 1024 * 1024;
+	/// <summary>
+	/// Transfers shorter than this don't get out of TCP's slow start, so they are not measured.
+	/// </summary>
+	static const uint64_t MIN_MEASURED_BYTES = 1024 * 1024;
+
+	/// <summary>
+	/// The state of the connection's path, as measured by the OS.
+	/// </summary>
+	struct PathInfo {
+		uint32_t rtt_us = 0;
+		uint64_t congestion_window = 0;
+	};
+
+	/// <summary>
+	/// The last measurement & the values chosen by it.
+	/// </summary>
+	struct Stats {
+		PathInfo path;
+		/// <summary>
+		/// Bytes per second - the rate the congestion window allows.
+		/// </summary>
+		uint64_t delivery_rate = 0;
+		uint64_t bandwidth_delay = 0;
+		/// <summary>
+		/// The buffer sizes, as reported by the OS after the tuning.
+		/// </summary>
+		int send_buffer = 0;
+		int receive_buffer = 0;
+		size_t write_size = 0;
+		unsigned int tunings = 0;
+	};
+
+	explicit SocketTuner(boost::asio::ip::tcp::socket& socket);
+
+	/// <summary>
+	/// Measures the path after a transfer, and grows the write size (and the send buffer, where it pays off) by it.
+	/// Short transfers, or a path the OS doesn't report, leave everything as is.
+	/// </summary>
+	/// <param name="bytes">The bytes the transfer actually sent.</param>
+	/// <returns>Whether the socket was tuned.</returns>
+	bool tune(uint64_t bytes);
+
+	/// <summary>
+	/// Returns the values chosen by the last tuning.
+	/// </summary>
+	const Stats& stats() const;
+
+	/// <summary>
+	/// Reads the path's RTT & congestion window from the OS (TCP_INFO on Linux, SIO_TCP_INFO on Windows).
+	/// </summary>
+	/// <returns>Whether the OS reported them.</returns>
+	static bool read_path_info(boost::asio::ip::tcp::socket& socket, PathInfo& info);
+
+	/// <summary>
+	/// Reads the largest send buffer the OS's autotuning grows to, and the largest one that may be set explicitly.
+	/// </summary>
+	/// <returns>Whether an explicit send buffer may ever be larger than the autotuned one.</returns>
+	static bool read_send_buffer_limits(uint64_t& autotuning_max, uint64_t& explicit_max);
+
+private:
+	boost::asio::ip::tcp::socket& _socket;
+	Stats _stats;
+};
@@ -0,0 +1,142 @@
+#include "TempFile.h"
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <filesystem>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+#ifdef _WIN32
+
+TempFile::TempFile() {
+	wchar_t dir[MAX_PATH + 1];
+	wchar_t name[MAX_PATH + 1];
+	if (!GetTempPathW(MAX_PATH + 1, dir) || !GetTempFileNameW(dir, L"m15", 0, name)) {
+		throw std::runtime_error("Failed to create a temp file name!");
+	}
+
+	// the file is deleted by the system once the handle is closed.
+	_handle = CreateFileW(name, GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+		FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+	if (_handle == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("Failed to create a temp file!");
+	}
+}
+
+TempFile::~TempFile() {
+	if (_mapping != nullptr)
+		CloseHandle(_mapping);
+	CloseHandle(_handle);
+}
+
+void TempFile::write(const void* data, size_t size) {
+	if (_mapping != nullptr) {
+		// the mapping was created for the previous size of the file.
+		CloseHandle(_mapping);
+		_mapping = nullptr;
+	}
+
+	auto source = static_cast<const char*>(data);
+	while (size > 0) {
+		DWORD written = 0;
+		DWORD to_write = size > MAXDWORD ? MAXDWORD : static_cast<DWORD>(size);
+		if (!WriteFile(_handle, source, to_write, &written, nullptr)) {
+			throw std::runtime_error("Failed to write to temp file!");
+		}
+		source += written;
+		size -= written;
+		_size += written;
+	}
+}
+
+TempFile::View TempFile::map(uint64_t offset, size_t length) {
+	if (_mapping == nullptr) {
+		_mapping = CreateFileMappingW(_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (_mapping == nullptr) {
+			throw std::runtime_error("Failed to map temp file!");
+		}
+	}
+
+	View view;
+	view._address = MapViewOfFile(_mapping, FILE_MAP_READ, static_cast<DWORD>(offset >> 32), static_cast<DWORD>(offset), length);
+	if (view._address == nullptr) {
+		throw std::runtime_error("Failed to map temp file view!");
+	}
+	view._length = length;
+	return view;
+}
+
+TempFile::View::~View() {
+	if (_address != nullptr)
+		UnmapViewOfFile(_address);
+}
+
+#else
+
+TempFile::TempFile() {
+	auto path_template = (std::filesystem::temp_directory_path() / "m15-XXXXXX").string();
+	_fd = mkstemp(path_template.data());
+	if (_fd < 0) {
+		throw std::runtime_error("Failed to create a temp file!");
+	}
+	// unlink right away: the data stays reachable through the descriptor only.
+	unlink(path_template.c_str());
+}
+
+TempFile::~TempFile() {
+	close(_fd);
+}
+
+void TempFile::write(const void* data, size_t size) {
+	auto source = static_cast<const char*>(data);
+	while (size > 0) {
+		auto written = ::write(_fd, source, size);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			throw std::runtime_error("Failed to write to temp file!");
+		}
+		source += written;
+		size -= static_cast<size_t>(written);
+		_size += static_cast<uint64_t>(written);
+	}
+}
+
+TempFile::View TempFile::map(uint64_t offset, size_t length) {
+	View view;
+	auto address = mmap(nullptr, length, PROT_READ, MAP_SHARED, _fd, static_cast<off_t>(offset));
+	if (address == MAP_FAILED) {
+		throw std::runtime_error("Failed to map temp file view!");
+	}
+	view._address = address;
+	view._length = length;
+	return view;
+}
+
+TempFile::View::~View() {
+	if (_address != nullptr)
+		munmap(_address, _length);
+}
+
+#endif
+
+uint64_t TempFile::size() const {
+	return _size;
+}
+
+TempFile::View::View(View&& other) noexcept {
+	*this = std::move(other);
+}
+
+TempFile::View& TempFile::View::operator=(View&& other) noexcept {
+	std::swap(_address, other._address);
+	std::swap(_length, other._length);
+	return *this;
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/// <summary>
+/// An anonymous temporary file - it has no name on the disk, and is removed once closed.
+/// Data is appended to it, and read back through memory mapped views.
+/// </summary>
+class TempFile
+{
+public:
+	/// <summary>
+	/// Offsets of mapped views must be a multiple of this value (covers both page size & Windows allocation granularity).
+	/// </summary>
+	static const size_t MAP_ALIGNMENT = 64 * 1024;
+
+	/// <summary>
+	/// A read-only memory mapped view of a part of the file. Unmapped on destruction.
+	/// </summary>
+	class View {
+		void* _address = nullptr;
+		size_t _length = 0;
+		friend class TempFile;
+	public:
+		View() = default;
+		View(View&& other) noexcept;
+		View& operator=(View&& other) noexcept;
+		View(const View&) = delete;
+		View& operator=(const View&) = delete;
+		~View();
+
+		const unsigned char* data() const { return static_cast<const unsigned char*>(_address); }
+		size_t size() const { return _length; }
+	};
+
+	/// <summary>
+	/// Creates a new temporary file in the system's temp directory.
+	/// Throws std::runtime_error on failure.
+	/// </summary>
+	TempFile();
+	~TempFile();
+	TempFile(const TempFile&) = delete;
+	TempFile& operator=(const TempFile&) = delete;
+
+	/// <summary>
+	/// Appends data to the end of the file.
+	/// </summary>
+	void write(const void* data, size_t size);
+
+	/// <summary>
+	/// Returns the number of bytes written to the file.
+	/// </summary>
+	uint64_t size() const;
+
+	/// <summary>
+	/// Maps a read-only view of the file's content.
+	/// </summary>
+	/// <param name="offset">Start of the view, must be a multiple of MAP_ALIGNMENT.</param>
+	/// <param name="length">Length of the view, must not exceed the end of the file.</param>
+	View map(uint64_t offset, size_t length);
+
+private:
+#ifdef _WIN32
+	void* _handle;
+	void* _mapping = nullptr;
+#else
+	int _fd;
+#endif
+	uint64_t _size = 0;
+};
+
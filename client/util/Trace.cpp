@@ -0,0 +1,116 @@
+#include "Trace.h"
+
+#ifdef MAMAN15_TRACE
+
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/// <summary>
+/// The time the events are relative to - the start of the process.
+/// </summary>
+static const std::chrono::steady_clock::time_point trace_origin = std::chrono::steady_clock::now();
+
+/// <summary>
+/// A single complete event, with times in nanoseconds.
+/// </summary>
+struct TraceEvent {
+	const char* name;
+	uint64_t start;
+	uint64_t duration;
+	uint64_t bytes;
+};
+
+/// <summary>
+/// The events of a single thread. The lock is only contended while the events are dumped.
+/// </summary>
+struct ThreadEvents {
+	unsigned int thread_id;
+	std::mutex lock;
+	std::vector<TraceEvent> events;
+};
+
+/// <summary>
+/// The events of all threads - kept after a thread exits, until the process does.
+/// </summary>
+struct TraceRegistry {
+	std::mutex lock;
+	std::vector<std::shared_ptr<ThreadEvents>> threads;
+};
+
+static TraceRegistry& registry() {
+	static TraceRegistry instance;
+	return instance;
+}
+
+/// <summary>
+/// Returns the events of the current thread, and registers them on the thread's first event.
+/// </summary>
+static ThreadEvents& current_thread_events() {
+	thread_local std::shared_ptr<ThreadEvents> current = []() {
+		auto created = std::make_shared<ThreadEvents>();
+		auto& all = registry();
+		std::lock_guard<std::mutex> guard(all.lock);
+		created->thread_id = static_cast<unsigned int>(all.threads.size()) + 1;
+		all.threads.push_back(created);
+		return created;
+	}();
+	return *current;
+}
+
+Trace::Scope::Scope(const char* name, uint64_t bytes) : _name(name), _bytes(bytes), _start(std::chrono::steady_clock::now()) {}
+
+Trace::Scope::~Scope() {
+	record(_name, _start, std::chrono::steady_clock::now(), _bytes);
+}
+
+void Trace::record(const char* name, std::chrono::steady_clock::time_point start,
+	std::chrono::steady_clock::time_point end, uint64_t bytes) {
+	TraceEvent event{ name,
+		static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(start - trace_origin).count()),
+		static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()),
+		bytes };
+
+	auto& events = current_thread_events();
+	std::lock_guard<std::mutex> guard(events.lock);
+	events.events.push_back(event);
+}
+
+/// <summary>
+/// Writes nanoseconds as the microseconds of chrome traces, with the nanoseconds as fractions.
+/// </summary>
+static void write_microseconds(std::ostream& out, uint64_t nanoseconds) {
+	auto fraction = std::to_string(nanoseconds % 1000);
+	out << nanoseconds / 1000 << "." << std::string(3 - fraction.length(), '0') << fraction;
+}
+
+void Trace::dump(const std::filesystem::path& path) {
+	std::ofstream out(path);
+	out << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [" << std::endl;
+
+	auto& all = registry();
+	std::lock_guard<std::mutex> guard(all.lock);
+	bool first = true;
+	for (const auto& thread : all.threads) {
+		std::lock_guard<std::mutex> thread_guard(thread->lock);
+
+		// names the thread's track in the viewer.
+		out << (first ? "" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << thread->thread_id
+			<< ", \"args\": {\"name\": \"thread " << thread->thread_id << "\"}}";
+		first = false;
+
+		for (const auto& event : thread->events) {
+			out << ",\n{\"name\": \"" << event.name << "\", \"cat\": \"client\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << thread->thread_id
+				<< ", \"ts\": ";
+			write_microseconds(out, event.start);
+			out << ", \"dur\": ";
+			write_microseconds(out, event.duration);
+			out << ", \"args\": {\"bytes\": " << event.bytes << "}}";
+		}
+	}
+	out << std::endl << "]}" << std::endl;
+}
+
+#endif
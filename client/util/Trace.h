@@ -0,0 +1,74 @@
+#pragma once
+#include <cstdint>
+#include <chrono>
+#include <filesystem>
+
+// This file includes the trace points of the client, for timelines of it's work.
+// They are compiled in only when MAMAN15_TRACE is defined (e.g. /D MAMAN15_TRACE) - otherwise every TRACE_* macro
+// expands to nothing, and Trace.cpp is empty.
+
+#ifdef MAMAN15_TRACE
+
+/// <summary>
+/// Records trace events - the start & duration of named scopes on each thread - and writes them in the Chrome
+/// trace-event JSON format, to be viewed in Perfetto (ui.perfetto.dev) or chrome://tracing.
+/// Each thread records into it's own buffer, so threads don't contend while they trace.
+/// </summary>
+class Trace
+{
+public:
+	/// <summary>
+	/// Records the scope it lives in, from it's construction to it's destruction, as a single complete event.
+	/// </summary>
+	class Scope {
+	public:
+		/// <param name="name">The name of the event - must be a string literal, since only the pointer is kept.</param>
+		/// <param name="bytes">The bytes processed by the scope, shown in the event's args.</param>
+		explicit Scope(const char* name, uint64_t bytes = 0);
+		~Scope();
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+
+	private:
+		const char* _name;
+		uint64_t _bytes;
+		std::chrono::steady_clock::time_point _start;
+	};
+
+	/// <summary>
+	/// Records a complete event on the current thread.
+	/// </summary>
+	static void record(const char* name, std::chrono::steady_clock::time_point start,
+		std::chrono::steady_clock::time_point end, uint64_t bytes = 0);
+
+	/// <summary>
+	/// Writes the events recorded so far by all threads to a Chrome trace-event JSON file.
+	/// </summary>
+	static void dump(const std::filesystem::path& path);
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+/// <summary>
+/// Traces the rest of the enclosing scope as an event with the name.
+/// </summary>
+#define TRACE_SCOPE(name) Trace::Scope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+
+/// <summary>
+/// Traces the rest of the enclosing scope as an event with the name, and the bytes it processes.
+/// </summary>
+#define TRACE_SCOPE_BYTES(name, bytes) Trace::Scope TRACE_CONCAT(trace_scope_, __LINE__)(name, bytes)
+
+/// <summary>
+/// Writes the recorded events to a Chrome trace-event JSON file.
+/// </summary>
+#define TRACE_DUMP(path) Trace::dump(path)
+
+#else
+
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_SCOPE_BYTES(name, bytes) ((void)0)
+#define TRACE_DUMP(path) ((void)0)
+
+#endif
@@ -0,0 +1,234 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <array>
+#include <tuple>
+#include <stdexcept>
+#include <type_traits>
+
+// This file includes a compile-time serializer for the compact (variable-length) protocol messages.
+
+/// <summary>
+/// Encodes & decodes messages in the compact wire format - with no padding or alignment:
+/// unsigned integers are little-endian, byte arrays are copied as is, strings are prefixed by a 1 byte length,
+/// and byte vectors by a 4 bytes length.
+/// A message lists it's fields in wire order, with a static constexpr fields() function that returns WireFormat::fields(...)
+/// of member pointers. The encode & decode code of each message is generated from that list at compile time, and a message
+/// with a field of an unsupported type doesn't compile.
+/// </summary>
+namespace WireFormat {
+
+	/// <summary>
+	/// Lists the fields of a message, in wire order.
+	/// </summary>
+	template <class... Members>
+	constexpr auto fields(Members... members) {
+		return std::make_tuple(members...);
+	}
+
+	/// <summary>
+	/// Stores an unsigned integer as little-endian bytes, regardless of the host's byte order.
+	/// </summary>
+	template <class T>
+	constexpr void store_le(T value, unsigned char* dest) {
+		static_assert(std::is_unsigned_v<T>, "Only unsigned integers are encoded!");
+		for (size_t i = 0; i < sizeof(T); i++) {
+			dest[i] = static_cast<unsigned char>(value >> (8 * i));
+		}
+	}
+
+	/// <summary>
+	/// Loads an unsigned integer from little-endian bytes, regardless of the host's byte order.
+	/// </summary>
+	template <class T>
+	constexpr T load_le(const unsigned char* source) {
+		static_assert(std::is_unsigned_v<T>, "Only unsigned integers are decoded!");
+		T value = 0;
+		for (size_t i = 0; i < sizeof(T); i++) {
+			value |= static_cast<T>(static_cast<T>(source[i]) << (8 * i));
+		}
+		return value;
+	}
+
+	/// <summary>
+	/// Reads the fields of a message being decoded.
+	/// </summary>
+	class Reader {
+	public:
+		Reader(const unsigned char* data, size_t length) : _data(data), _left(length) {}
+
+		/// <summary>
+		/// Returns the next bytes of the message, and skips them. Throws if the message is too short.
+		/// </summary>
+		const unsigned char* take(size_t length) {
+			if (length > _left) {
+				throw std::runtime_error("Compact message is truncated!");
+			}
+			auto taken = _data;
+			_data += length;
+			_left -= length;
+			return taken;
+		}
+
+		size_t left() const {
+			return _left;
+		}
+
+	private:
+		const unsigned char* _data;
+		size_t _left;
+	};
+
+	/// <summary>
+	/// Encodes & decodes a single field type. fixed_size is the size of the field, or of it's length prefix if it's variable.
+	/// </summary>
+	template <class T, class = void>
+	struct Codec {
+		static_assert(sizeof(T) == 0, "Unsupported field type in compact message!");
+	};
+
+	template <class T>
+	struct Codec<T, std::enable_if_t<std::is_unsigned_v<T>>> {
+		static constexpr bool is_fixed = true;
+		static constexpr size_t fixed_size = sizeof(T);
+
+		static size_t size(const T&) {
+			return sizeof(T);
+		}
+		static void encode(const T& value, std::vector<unsigned char>& dest) {
+			auto at = dest.size();
+			dest.resize(at + sizeof(T));
+			store_le(value, dest.data() + at);
+		}
+		static void decode(T& value, Reader& source) {
+			value = load_le<T>(source.take(sizeof(T)));
+		}
+	};
+
+	template <size_t N>
+	struct Codec<std::array<unsigned char, N>> {
+		static constexpr bool is_fixed = true;
+		static constexpr size_t fixed_size = N;
+
+		static size_t size(const std::array<unsigned char, N>&) {
+			return N;
+		}
+		static void encode(const std::array<unsigned char, N>& value, std::vector<unsigned char>& dest) {
+			dest.insert(dest.end(), value.begin(), value.end());
+		}
+		static void decode(std::array<unsigned char, N>& value, Reader& source) {
+			auto data = source.take(N);
+			std::copy(data, data + N, value.begin());
+		}
+	};
+
+	template <>
+	struct Codec<std::string> {
+		static constexpr bool is_fixed = false;
+		static constexpr size_t fixed_size = sizeof(uint8_t);
+
+		static size_t size(const std::string& value) {
+			return sizeof(uint8_t) + value.length();
+		}
+		static void encode(const std::string& value, std::vector<unsigned char>& dest) {
+			if (value.length() > UINT8_MAX) {
+				throw std::invalid_argument("String is too long for a compact message!");
+			}
+			dest.push_back(static_cast<unsigned char>(value.length()));
+			dest.insert(dest.end(), value.begin(), value.end());
+		}
+		static void decode(std::string& value, Reader& source) {
+			auto length = *source.take(sizeof(uint8_t));
+			auto data = source.take(length);
+			value.assign(reinterpret_cast<const char*>(data), length);
+		}
+	};
+
+	template <>
+	struct Codec<std::vector<unsigned char>> {
+		static constexpr bool is_fixed = false;
+		static constexpr size_t fixed_size = sizeof(uint32_t);
+
+		static size_t size(const std::vector<unsigned char>& value) {
+			return sizeof(uint32_t) + value.size();
+		}
+		static void encode(const std::vector<unsigned char>& value, std::vector<unsigned char>& dest) {
+			if (value.size() > UINT32_MAX) {
+				throw std::invalid_argument("Vector is too long for a compact message!");
+			}
+			Codec<uint32_t>::encode(static_cast<uint32_t>(value.size()), dest);
+			dest.insert(dest.end(), value.begin(), value.end());
+		}
+		static void decode(std::vector<unsigned char>& value, Reader& source) {
+			uint32_t length;
+			Codec<uint32_t>::decode(length, source);
+			auto data = source.take(length);
+			value.assign(data, data + length);
+		}
+	};
+
+	/// <summary>
+	/// The type of a message field, from it's member pointer.
+	/// </summary>
+	template <class Member>
+	struct FieldType;
+
+	template <class Message, class T>
+	struct FieldType<T Message::*> {
+		using type = T;
+	};
+
+	template <class Member>
+	using CodecOf = Codec<typename FieldType<Member>::type>;
+
+	/// <summary>
+	/// Returns the encoded size of a message without it's variable parts - the whole size, if it has no strings or vectors.
+	/// </summary>
+	template <class Message>
+	constexpr size_t fixed_size() {
+		return std::apply([](auto... members) { return (CodecOf<decltype(members)>::fixed_size + ... + 0); }, Message::fields());
+	}
+
+	/// <summary>
+	/// Returns whether the encoded size of a message is always the same.
+	/// </summary>
+	template <class Message>
+	constexpr bool is_fixed_size() {
+		return std::apply([](auto... members) { return (CodecOf<decltype(members)>::is_fixed && ... && true); }, Message::fields());
+	}
+
+	/// <summary>
+	/// Returns the encoded size of a message.
+	/// </summary>
+	template <class Message>
+	size_t encoded_size(const Message& message) {
+		return std::apply([&](auto... members) { return (CodecOf<decltype(members)>::size(message.*members) + ... + 0); },
+			Message::fields());
+	}
+
+	/// <summary>
+	/// Encodes a message, and appends it to the destination.
+	/// </summary>
+	template <class Message>
+	void encode(const Message& message, std::vector<unsigned char>& dest) {
+		dest.reserve(dest.size() + encoded_size(message));
+		std::apply([&](auto... members) { (CodecOf<decltype(members)>::encode(message.*members, dest), ...); }, Message::fields());
+	}
+
+	/// <summary>
+	/// Decodes a message. Throws std::runtime_error if the data is not exactly a single message.
+	/// </summary>
+	template <class Message>
+	Message decode(const unsigned char* data, size_t length) {
+		Message message{};
+		Reader source(data, length);
+		std::apply([&](auto... members) { (CodecOf<decltype(members)>::decode(message.*members, source), ...); }, Message::fields());
+		if (source.left() != 0) {
+			throw std::runtime_error("Compact message has unexpected trailing data!");
+		}
+		return message;
+	}
+}
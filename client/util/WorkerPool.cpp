@@ -0,0 +1,63 @@
+#include "WorkerPool.h"
+#include <algorithm>
+
+WorkerPool::WorkerPool(size_t threads) {
+	threads = std::max<size_t>(threads, 1);
+	for (size_t i = 0; i < threads; i++) {
+		_threads.emplace_back(&WorkerPool::work, this);
+	}
+}
+
+WorkerPool::~WorkerPool() {
+	{
+		std::lock_guard<std::mutex> lock(_lock);
+		_stopping = true;
+	}
+	_task_added.notify_all();
+
+	for (auto& t : _threads) {
+		t.join();
+	}
+}
+
+std::future<void> WorkerPool::submit(std::function<void()> task, std::function<void()> on_done) {
+	Task queued{ std::packaged_task<void()>(std::move(task)), std::move(on_done) };
+	auto result = queued.run.get_future();
+	{
+		std::lock_guard<std::mutex> lock(_lock);
+		_tasks.push(std::move(queued));
+	}
+	_task_added.notify_one();
+	return result;
+}
+
+size_t WorkerPool::size() const {
+	return _threads.size();
+}
+
+WorkerPool& WorkerPool::shared() {
+	static WorkerPool pool(std::thread::hardware_concurrency());
+	return pool;
+}
+
+void WorkerPool::work() {
+	while (true) {
+		Task task;
+		{
+			std::unique_lock<std::mutex> lock(_lock);
+			_task_added.wait(lock, [this]() { return _stopping || !_tasks.empty(); });
+
+			// pending tasks are done before stopping, so no future is left unsatisfied.
+			if (_tasks.empty()) {
+				return;
+			}
+			task = std::move(_tasks.front());
+			_tasks.pop();
+		}
+		// exceptions are stored in the task's future.
+		task.run();
+		if (task.on_done) {
+			task.on_done();
+		}
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <stddef.h>
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <functional>
+
+/// <summary>
+/// A fixed-size pool of worker threads, that run submitted tasks in the order they were submitted.
+/// </summary>
+class WorkerPool
+{
+public:
+	/// <summary>
+	/// Starts the worker threads.
+	/// </summary>
+	/// <param name="threads">The number of worker threads. At least one thread is started.</param>
+	explicit WorkerPool(size_t threads);
+
+	/// <summary>
+	/// Runs the pending tasks, and joins the worker threads.
+	/// </summary>
+	~WorkerPool();
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+
+	/// <summary>
+	/// Queues a task to run on one of the workers.
+	/// </summary>
+	/// <param name="on_done">If set, runs on the worker once the task is done and it's future is ready - e.g. to wake
+	/// a coroutine that awaits it, instead of blocking on the future.</param>
+	/// <returns>A future that becomes ready once the task is done, and re-throws it's exception, if any.</returns>
+	std::future<void> submit(std::function<void()> task, std::function<void()> on_done = nullptr);
+
+	/// <summary>
+	/// Returns the number of worker threads.
+	/// </summary>
+	size_t size() const;
+
+	/// <summary>
+	/// Returns a pool shared by the whole process, with a worker per CPU core.
+	/// </summary>
+	static WorkerPool& shared();
+
+private:
+	/// <summary>
+	/// The loop of each worker thread - runs tasks until the pool is destroyed.
+	/// </summary>
+	void work();
+
+	struct Task {
+		std::packaged_task<void()> run;
+		std::function<void()> on_done;
+	};
+
+	std::vector<std::thread> _threads;
+	std::queue<Task> _tasks;
+	std::mutex _lock;
+	std::condition_variable _task_added;
+	bool _stopping = false;
+};
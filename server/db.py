@@ -18,6 +18,44 @@ class User:
     aes_key: Optional[bytes] = None
 
 
+@dataclass
+class SessionTicket:
+    """ Represents a session resumption ticket. Tickets are kept in memory only. """
+    id: UUID
+    user_id: UUID
+    aes_key: bytes
+    expiry: float
+
+
+@dataclass
+class ChunkedUpload:
+    """ Represents an upload in progress, that is sent chunk by chunk. Kept in memory only. """
+    id: UUID
+    user_id: UUID
+    file_name: str
+    file_size: int
+    chunk_size: int
+    partial_path: str
+    # bit i (LSB first) is set once chunk i was received & verified.
+    held: bytearray
+
+    @property
+    def chunk_count(self) -> int:
+        return max(1, -(-self.file_size // self.chunk_size))
+
+    def is_held(self, index: int) -> bool:
+        return bool(self.held[index // 8] & (1 << (index % 8)))
+
+    def set_held(self, index: int):
+        self.held[index // 8] |= 1 << (index % 8)
+
+    def held_count(self) -> int:
+        return sum(bin(b).count('1') for b in self.held)
+
+    def chunk_length(self, index: int) -> int:
+        return min(self.chunk_size, self.file_size - index * self.chunk_size)
+
+
 @dataclass
 class File:
     """ Represents a file in the database. """
@@ -60,6 +98,8 @@ CREATE TABLE IF NOT EXISTS files (
 
         self.users: Dict[UUID, User] = {}
         self.files: Dict[UUID, File] = {}
+        self.tickets: Dict[UUID, SessionTicket] = {}
+        self.uploads: Dict[UUID, ChunkedUpload] = {}
 
         # Thread saftey is important - This is a shared object!
         self.lock = Lock()
@@ -190,5 +230,55 @@ CREATE TABLE IF NOT EXISTS files (
         with self.lock:
             return self.files[user_id].path_name
     
+    def issue_ticket(self, user_id: UUID, aes_key: bytes, lifetime_seconds: int) -> UUID:
+        """ Issues a new session ticket for the user's AES key, and returns it's ID. """
+        ticket = SessionTicket(uuid4(), user_id, aes_key, time.time() + lifetime_seconds)
+        self.logger.debug(f"Issuing session ticket for user #{user_id}.")
+        with self.lock:
+            # drop expired tickets while here, to keep the store bounded.
+            now = time.time()
+            for expired_id in [t.id for t in self.tickets.values() if t.expiry <= now]:
+                self.tickets.pop(expired_id)
+            self.tickets[ticket.id] = ticket
+        return ticket.id
+
+    def redeem_ticket(self, user_id: UUID, ticket_id: UUID) -> Optional[bytes]:
+        """ Returns the AES key of a valid ticket of the user, or None if there is no such ticket. """
+        with self.lock:
+            ticket = self.tickets.get(ticket_id)
+            if ticket is None or ticket.user_id != user_id or ticket.expiry <= time.time():
+                return None
+            return ticket.aes_key
+
+    def get_or_create_upload(self, user_id: UUID, upload_id: UUID, file_name: str, file_size: int, chunk_size: int,
+                             partial_path: str) -> ChunkedUpload:
+        """
+        Returns the user's upload with the specified ID, to resume it.
+        A new upload is created if there is none, or if the existing one is of a different file.
+        """
+        with self.lock:
+            upload = self.uploads.get(upload_id)
+            if upload is not None and upload.user_id == user_id and upload.file_name == file_name \
+                    and upload.file_size == file_size and upload.chunk_size == chunk_size:
+                return upload
+
+            self.logger.debug(f"Starting chunked upload #{upload_id} for user #{user_id}.")
+            upload = ChunkedUpload(upload_id, user_id, file_name, file_size, chunk_size, partial_path, bytearray())
+            upload.held = bytearray((upload.chunk_count + 7) // 8)
+            self.uploads[upload_id] = upload
+            return upload
+
+    def get_upload(self, user_id: UUID, upload_id: UUID) -> Optional[ChunkedUpload]:
+        """ Returns the user's upload with the specified ID, or None if there is no such upload. """
+        with self.lock:
+            upload = self.uploads.get(upload_id)
+            if upload is None or upload.user_id != user_id:
+                return None
+            return upload
+
+    def remove_upload(self, upload_id: UUID):
+        with self.lock:
+            self.uploads.pop(upload_id, None)
+
     def close(self):
         self.sqlite_conn.close()
\ No newline at end of file
@@ -1,11 +1,12 @@
 from dataclasses import dataclass, fields
 from enum import Enum
 from socket import socket
+import re
 import struct
-from typing import Any, Dict, Type
+from typing import Any, Dict, Optional, Type
 from uuid import UUID
 
-from utils import ClientDisconnectedException
+from utils import ClientDisconnectedException, receive_exact
 
 # ASCII with range(256) to support encoding of other chars.
 TEXT_ENCODING = 'charmap'
@@ -17,7 +18,30 @@ MAX_USERNAME_SIZE = 255
 MAX_FILENAME_SIZE = 255
 PUBLIC_KEY_SIZE_BYTES = 160
 CHECKSUM_SIZE_BYTES = 16
-CURRENT_VERSION_NUMBER = 3
+TICKET_ID_SIZE_BYTES = 16
+CTR_COUNTER_SIZE_BYTES = 16
+UPLOAD_ID_SIZE_BYTES = 16
+CHUNK_HASH_SIZE_BYTES = 32
+CURRENT_VERSION_NUMBER = 10
+
+# Minimal version that supports each optional feature
+MIN_VERSION_SESSION_TICKETS = 4
+MIN_VERSION_PARALLEL_ENCRYPTION = 5
+MIN_VERSION_RESUMABLE_UPLOADS = 6
+MIN_VERSION_COMPRESSION = 7
+MIN_VERSION_DEDUPLICATION = 8
+MIN_VERSION_COMPACT_FRAMING = 9
+MIN_VERSION_LARGE_FILES = 10
+
+# Limits of the chunk size of chunked uploads
+MAX_UPLOAD_CHUNK_SIZE = 64 * 1024 * 1024
+
+# Limit of the size of a deduplicated chunk (content-defined chunks are far smaller)
+MAX_STORED_CHUNK_SIZE = 4 * 1024 * 1024
+MAX_CHUNKS_PER_FILE = 1024 * 1024
+
+# Limit of the size of a file sent in a single small file request
+MAX_SMALL_FILE_SIZE = 16 * 1024
 
 
 ################################## Request parsing ##################################
@@ -29,6 +53,17 @@ class ClientRequestCodes(Enum):
     ValidChecksum = 1104
     InvalidChecksumRetry = 1105
     InvalidChecksumAbort = 1106
+    ResumeSession = 1107
+    IssueTicket = 1108
+    UploadFileCtr = 1109
+    BeginChunkedUpload = 1110
+    UploadChunk = 1111
+    FinishChunkedUpload = 1112
+    UploadCompressedChunk = 1113
+    QueryChunks = 1114
+    StoreChunk = 1115
+    AssembleFile = 1116
+    UploadSmallFile = 1117
 
 
 class RequestPartBase:
@@ -89,12 +124,109 @@ class FileUploadContent(RequestPartBase):
     file_name: str
 
 
+@dataclass
+class FileUploadCtrContent(RequestPartBase):
+    user_id: UUID
+    file_size: int
+    file_name: str
+    initial_counter: bytes
+
+
+@dataclass
+class BeginChunkedUploadContent(RequestPartBase):
+    user_id: UUID
+    upload_id: UUID
+    file_size: int
+    chunk_size: int
+    file_name: str
+
+
+@dataclass
+class UploadChunkContent(RequestPartBase):
+    """ Followed by content_size bytes of the chunk, encrypted with AES-CTR at the chunk's offset. """
+    user_id: UUID
+    upload_id: UUID
+    chunk_index: int
+    chunk_checksum: int
+    initial_counter: bytes
+    content_size: int
+
+
+@dataclass
+class UploadCompressedChunkContent(RequestPartBase):
+    """ Followed by content_size bytes of the chunk, compressed and then encrypted with AES-CTR at the chunk's offset. """
+    user_id: UUID
+    upload_id: UUID
+    chunk_index: int
+    chunk_checksum: int
+    initial_counter: bytes
+    content_size: int
+    compression: int
+    plain_size: int
+
+
+@dataclass
+class QueryChunksContent(RequestPartBase):
+    """ Followed by chunk_count chunk hashes (SHA-256 of the plain chunk). """
+    user_id: UUID
+    chunk_count: int
+
+
+@dataclass
+class StoreChunkContent(RequestPartBase):
+    """ Followed by content_size bytes of the chunk, compressed and then encrypted with AES-CTR at the chunk's file offset. """
+    user_id: UUID
+    chunk_hash: bytes
+    offset: int
+    initial_counter: bytes
+    compression: int
+    plain_size: int
+    content_size: int
+
+
+@dataclass
+class AssembleFileContent(RequestPartBase):
+    """ Followed by chunk_count chunk hashes, in the file's order. """
+    user_id: UUID
+    file_size: int
+    chunk_count: int
+    file_name: str
+
+
+@dataclass
+class UploadSmallFileContent(RequestPartBase):
+    """ Followed by content_size bytes of the whole file, compressed and then encrypted with AES-CTR. Compact only. """
+    user_id: UUID
+    plain_size: int
+    compression: int
+    initial_counter: bytes
+    content_size: int
+    file_name: str
+
+
+@dataclass
+class FinishChunkedUploadContent(RequestPartBase):
+    user_id: UUID
+    upload_id: UUID
+
+
 @dataclass
 class ChecksumStatusContent(RequestPartBase):
     user_id: UUID
     file_name: str
 
 
+@dataclass
+class IssueTicketContent(RequestPartBase):
+    user_id: UUID
+
+
+@dataclass
+class ResumeSessionContent(RequestPartBase):
+    user_id: UUID
+    ticket_id: UUID
+
+
 # This maps request codes to their data types.
 RequestCodeToDataTypeMap = {
     ClientRequestCodes.Register: RegisterRequestContent,
@@ -103,6 +235,17 @@ RequestCodeToDataTypeMap = {
     ClientRequestCodes.ValidChecksum: ChecksumStatusContent,
     ClientRequestCodes.InvalidChecksumRetry: ChecksumStatusContent,
     ClientRequestCodes.InvalidChecksumAbort: ChecksumStatusContent,
+    ClientRequestCodes.ResumeSession: ResumeSessionContent,
+    ClientRequestCodes.IssueTicket: IssueTicketContent,
+    ClientRequestCodes.UploadFileCtr: FileUploadCtrContent,
+    ClientRequestCodes.BeginChunkedUpload: BeginChunkedUploadContent,
+    ClientRequestCodes.UploadChunk: UploadChunkContent,
+    ClientRequestCodes.FinishChunkedUpload: FinishChunkedUploadContent,
+    ClientRequestCodes.UploadCompressedChunk: UploadCompressedChunkContent,
+    ClientRequestCodes.QueryChunks: QueryChunksContent,
+    ClientRequestCodes.StoreChunk: StoreChunkContent,
+    ClientRequestCodes.AssembleFile: AssembleFileContent,
+    ClientRequestCodes.UploadSmallFile: UploadSmallFileContent,
 }
 
 # This maps data type to it's structual format.
@@ -112,18 +255,58 @@ RequestParseInfoMap: Dict[Type, str] = {
     KeyExchangeContent: f"<{MAX_USERNAME_SIZE}s{PUBLIC_KEY_SIZE_BYTES}s",
     FileUploadContent: f"<{USER_ID_LENGTH_BYTES}sL{MAX_FILENAME_SIZE}s",
     ChecksumStatusContent: f"<{USER_ID_LENGTH_BYTES}s{MAX_FILENAME_SIZE}s",
+    IssueTicketContent: f"<{USER_ID_LENGTH_BYTES}s",
+    ResumeSessionContent: f"<{USER_ID_LENGTH_BYTES}s{TICKET_ID_SIZE_BYTES}s",
+    FileUploadCtrContent: f"<{USER_ID_LENGTH_BYTES}sL{MAX_FILENAME_SIZE}s{CTR_COUNTER_SIZE_BYTES}s",
+    BeginChunkedUploadContent: f"<{USER_ID_LENGTH_BYTES}s{UPLOAD_ID_SIZE_BYTES}sQL{MAX_FILENAME_SIZE}s",
+    UploadChunkContent: f"<{USER_ID_LENGTH_BYTES}s{UPLOAD_ID_SIZE_BYTES}sLL{CTR_COUNTER_SIZE_BYTES}sL",
+    FinishChunkedUploadContent: f"<{USER_ID_LENGTH_BYTES}s{UPLOAD_ID_SIZE_BYTES}s",
+    UploadCompressedChunkContent: f"<{USER_ID_LENGTH_BYTES}s{UPLOAD_ID_SIZE_BYTES}sLL{CTR_COUNTER_SIZE_BYTES}sLBL",
+    QueryChunksContent: f"<{USER_ID_LENGTH_BYTES}sL",
+    StoreChunkContent: f"<{USER_ID_LENGTH_BYTES}s{CHUNK_HASH_SIZE_BYTES}sQ{CTR_COUNTER_SIZE_BYTES}sBLL",
+    AssembleFileContent: f"<{USER_ID_LENGTH_BYTES}sQL{MAX_FILENAME_SIZE}s",
 }
 
 
-def receive_request_part(client: socket, req_type: Type) -> Any:
-    """ Recieves and parses a request from the socket into a dataclass, and returns it. """
+# This maps data type to it's compact format, used from MIN_VERSION_COMPACT_FRAMING on (see below).
+# The user ID is not sent - it is taken from the request header.
+CompactRequestParseInfoMap: Dict[Type, str] = {
+    ChecksumStatusContent: "S",
+    QueryChunksContent: "L",
+    StoreChunkContent: f"{CHUNK_HASH_SIZE_BYTES}sQ{CTR_COUNTER_SIZE_BYTES}sBLL",
+    AssembleFileContent: "QLS",
+    UploadSmallFileContent: f"LB{CTR_COUNTER_SIZE_BYTES}sLS",
+    FileUploadCtrContent: f"QS{CTR_COUNTER_SIZE_BYTES}s",
+}
+
+# Compact formats that were added after MIN_VERSION_COMPACT_FRAMING, by the version that added them.
+CompactRequestMinVersion: Dict[Type, int] = {
+    FileUploadCtrContent: MIN_VERSION_LARGE_FILES,
+}
+
+
+def is_compact(header: RequestHeader) -> bool:
+    """ Returns whether the request's parts (and the responses to it) use the compact formats. """
+    return header.version >= MIN_VERSION_COMPACT_FRAMING
+
+
+def receive_request_part(client: socket, req_type: Type, header: Optional[RequestHeader] = None) -> Any:
+    """
+    Recieves and parses a request from the socket into a dataclass, and returns it.
+    If the header of a compact request is specified, the part is parsed with it's compact format, when it has one.
+    """
+    if header is not None and is_compact(header) and req_type in CompactRequestParseInfoMap \
+            and header.version >= CompactRequestMinVersion.get(req_type, MIN_VERSION_COMPACT_FRAMING):
+        parsed_args = receive_compact(client, CompactRequestParseInfoMap[req_type])
+        if fields(req_type)[0].name == 'user_id':
+            parsed_args.insert(0, header.user_id.bytes)
+        return req_type(*parsed_args)
+
     # get format & bytes to read
     fmt = RequestParseInfoMap[req_type]
     recv_size = struct.calcsize(fmt)
-    read_bytes = client.recv(recv_size)
-
-    if not read_bytes:
-        raise ClientDisconnectedException()
+    # a request may be split between segments, especially when it follows a large chunk of data.
+    read_bytes = receive_exact(client, recv_size)
 
     # unpack & construct dataclass
     parsed_args = struct.unpack(fmt, read_bytes)
@@ -131,6 +314,46 @@ def receive_request_part(client: socket, req_type: Type) -> Any:
     return result
 
 
+################################## Compact formats ##################################
+# A compact format is a little-endian struct format with no padding, where S is a string prefixed by a 1 byte length,
+# and V is a bytes object prefixed by a 4 bytes length (see WireFormat.h in the client).
+
+COMPACT_VARIABLE_FIELDS = {'S': '<B', 'V': '<L'}
+
+
+def split_compact_format(fmt: str) -> list:
+    """ Splits a compact format to it's struct formats & variable-length fields. """
+    return [part for part in re.split('([SV])', fmt) if part]
+
+
+def receive_compact(client: socket, fmt: str) -> list:
+    """ Receives the values of a compact format from the socket. """
+    values = []
+    for part in split_compact_format(fmt):
+        if part in COMPACT_VARIABLE_FIELDS:
+            prefix = COMPACT_VARIABLE_FIELDS[part]
+            length, = struct.unpack(prefix, receive_exact(client, struct.calcsize(prefix)))
+            values.append(receive_exact(client, length))
+        else:
+            values += struct.unpack('<' + part, receive_exact(client, struct.calcsize('<' + part)))
+    return values
+
+
+def encode_compact(fmt: str, values: list) -> bytes:
+    """ Encodes values to a compact format. """
+    encoded = bytearray()
+    values = iter(values)
+    for part in split_compact_format(fmt):
+        if part in COMPACT_VARIABLE_FIELDS:
+            value = next(values)
+            encoded += struct.pack(COMPACT_VARIABLE_FIELDS[part], len(value)) + value
+        else:
+            # the number of values the struct part takes.
+            count = len(struct.unpack('<' + part, bytes(struct.calcsize('<' + part))))
+            encoded += struct.pack('<' + part, *[next(values) for _ in range(count)])
+    return bytes(encoded)
+
+
 ################################## Response builders ##################################
 
 class ServerResponseCodes(Enum):
@@ -139,6 +362,11 @@ class ServerResponseCodes(Enum):
     ExchangeAes = 2102
     FileUploaded = 2103
     MessageOk = 2104
+    SessionResumed = 2105
+    ResumeRejected = 2106
+    TicketIssued = 2107
+    UploadStatus = 2108
+    ChunksHeld = 2109
 
 
 # These data classes hold the response information
@@ -160,6 +388,50 @@ class KeyExchangeResponse:
     aes_key: bytes
 
 
+@dataclass
+class TicketIssuedResponse:
+    client_id: bytes
+    ticket_id: bytes
+    lifetime_seconds: int
+
+
+@dataclass
+class SessionResumedResponse:
+    client_id: bytes
+
+
+@dataclass
+class UploadStatusResponse:
+    client_id: bytes
+    upload_id: bytes
+    chunk_count: int
+    held_count: int
+    # bit i (LSB first) is set if chunk i is held by the server.
+    held: bytes
+
+
+@dataclass
+class ChunksHeldResponse:
+    client_id: bytes
+    chunk_count: int
+    held_count: int
+    # bit i (LSB first) is set if the i-th queried chunk is held by the server.
+    held: bytes
+
+
+@dataclass
+class ChunksHeldCompactResponse:
+    chunk_count: int
+    held_count: int
+    held: bytes
+
+
+@dataclass
+class FileUploadCompactResponse:
+    """ The client knows the file it sent, so only the CRC is returned. """
+    cksum: int
+
+
 @dataclass
 class FileUploadResponse:
     client_id: bytes
@@ -174,6 +446,17 @@ ResponseEncodeMap = {
     RegisterSuccessResponse: f"<{USER_ID_LENGTH_BYTES}s",
     KeyExchangeResponse: f"<{USER_ID_LENGTH_BYTES}s{{0}}s",
     FileUploadResponse: f"<{USER_ID_LENGTH_BYTES}sL{MAX_FILENAME_SIZE}sL",
+    TicketIssuedResponse: f"<{USER_ID_LENGTH_BYTES}s{TICKET_ID_SIZE_BYTES}sL",
+    SessionResumedResponse: f"<{USER_ID_LENGTH_BYTES}s",
+    UploadStatusResponse: f"<{USER_ID_LENGTH_BYTES}s{UPLOAD_ID_SIZE_BYTES}sLL{{0}}s",
+    ChunksHeldResponse: f"<{USER_ID_LENGTH_BYTES}sLL{{0}}s",
+}
+
+
+# This maps compact data types to their compact formats.
+CompactResponseEncodeMap = {
+    ChunksHeldCompactResponse: "LLV",
+    FileUploadCompactResponse: "L",
 }
 
 
@@ -212,7 +495,10 @@ def build_response(code: ServerResponseCodes, payload=None, *format_lengths) ->
     :param format_lengths: A collection of integers, specifying variable-lengths for packing the payload data.
     """
     # encode content if such one exist
-    if payload is not None:
+    if type(payload) in CompactResponseEncodeMap:
+        vals = [getattr_and_cast(payload, f.name) for f in fields(payload)]
+        payload_bytes = encode_compact(CompactResponseEncodeMap[type(payload)], vals)
+    elif payload is not None:
         payload_bytes = encode_response_part(payload, *format_lengths)
     else:
         payload_bytes = bytes(0)
@@ -1,6 +1,9 @@
+import hashlib
 import logging
 import os
 import threading
+import zlib
+from typing import Optional
 
 import utils
 from db import Database
@@ -10,11 +13,16 @@ from protocol import *
 class ClientSession(threading.Thread):
     """ Represents a session of the server with the client - Runs in the background as a thread. """
 
+    TICKET_LIFETIME_SECONDS = 60 * 60
+
     def __init__(self, client_socket: socket, database: Database):
         super().__init__(daemon=True)  # Daemonize to prevent quit blocks
         self.__client = client_socket
         self.__db = database
         self.__logger = logging.getLogger("ClientSession")
+        # Keys & files are kept per session too, since a user may run several sessions in parallel.
+        self.__aes_key: Optional[bytes] = None
+        self.__uploaded_file_path: Optional[str] = None
 
     def run(self):
         try:
@@ -46,7 +54,7 @@ class ClientSession(threading.Thread):
         header_request = ClientRequestCodes(header.code)
 
         request_content_type = RequestCodeToDataTypeMap[header.code]
-        content = receive_request_part(self.__client, request_content_type)
+        content = receive_request_part(self.__client, request_content_type, header)
 
         if header.code != ClientRequestCodes.Register:
             if self.__db.user_exists(header.user_id):
@@ -81,6 +89,7 @@ class ClientSession(threading.Thread):
 
         # Save AES Key to database, along with public key
         self.__db.save_keys(header.user_id, content.public_key, aes_key)
+        self.__aes_key = aes_key
 
         # Encrypt AES Key, and return it.
         encrypted_aes = utils.encrypt_with_rsa(content.public_key, aes_key)
@@ -89,9 +98,39 @@ class ClientSession(threading.Thread):
 
         self.__client.send(response)
 
+    def issue_ticket(self, header: RequestHeader, content: IssueTicketContent):
+        """ Handles session ticket requests - a ticket resumes the current AES key on later connections. """
+        if self.__aes_key is None:
+            raise ValueError("No key was exchanged in this session.")
+
+        ticket_id = self.__db.issue_ticket(header.user_id, self.__aes_key, self.TICKET_LIFETIME_SECONDS)
+        payload = TicketIssuedResponse(header.user_id.bytes, ticket_id.bytes, self.TICKET_LIFETIME_SECONDS)
+        self.__client.send(build_response(ServerResponseCodes.TicketIssued, payload))
+
+    def resume_session(self, header: RequestHeader, content: ResumeSessionContent):
+        """ Handles session resumption requests - restores the AES key of a valid ticket. """
+        aes_key = self.__db.redeem_ticket(header.user_id, content.ticket_id)
+        if aes_key is None:
+            self.__logger.debug(f"Rejected session ticket of user #{header.user_id}.")
+            self.__client.send(build_response(ServerResponseCodes.ResumeRejected))
+            return
+
+        self.__logger.debug(f"Resumed session of user #{header.user_id}.")
+        self.__aes_key = aes_key
+        payload = SessionResumedResponse(header.user_id.bytes)
+        self.__client.send(build_response(ServerResponseCodes.SessionResumed, payload))
+
     def upload_file(self, header: RequestHeader, content: FileUploadContent):
         """ Handels upload file requests. """
-        aes_key = self.__db.get_aes_for_user(header.user_id)
+        self.__receive_file(header, content)
+
+    def upload_file_ctr(self, header: RequestHeader, content: FileUploadCtrContent):
+        """ Handles upload file requests of files encrypted with AES-CTR, that clients may encrypt in parallel. """
+        self.__receive_file(header, content, content.initial_counter)
+
+    def __receive_file(self, header: RequestHeader, content, initial_counter: Optional[bytes] = None):
+        """ Receives & decrypts an uploaded file, and responds with it's CRC. """
+        aes_key = self.__aes_key or self.__db.get_aes_for_user(header.user_id)
         if aes_key is None:
             raise ValueError("AES Key not found for specified user.")
         
@@ -104,17 +143,243 @@ class ClientSession(threading.Thread):
             pass
 
         dest_file_name = os.path.join(u.name, content.file_name)
-        utils.socket_to_local_file(self.__client, dest_file_name, content.file_size, aes_key)
+        # the CRC is calculated while the file is written, so it's not read again.
+        file_crc = utils.socket_to_local_file(self.__client, dest_file_name, content.file_size, aes_key, initial_counter)
         self.__db.add_file(header.user_id, content.file_name, dest_file_name)
+        self.__uploaded_file_path = dest_file_name
         
         # Return CRC
-        file_crc = utils.crc32().calculate(dest_file_name)
         self.__logger.debug(f"File uploaded to {dest_file_name}, CRC is 0x{file_crc:02x}")
         
-        payload = FileUploadResponse(header.user_id.bytes, content.file_size, content.file_name, file_crc)
-        response = build_response(ServerResponseCodes.FileUploaded, payload)
+        self.__send_file_uploaded(header, content.file_size, content.file_name, file_crc)
 
-        self.__client.send(response)
+    def upload_small_file(self, header: RequestHeader, content: UploadSmallFileContent):
+        """ Handles uploads of small files, that are sent whole in a single compact request. Responds with the CRC. """
+        # the sizes are checked before the file is read, so a bogus size isn't buffered in memory.
+        if content.plain_size > MAX_SMALL_FILE_SIZE or content.content_size > content.plain_size:
+            raise ValueError(f"Invalid small file size {content.plain_size}.")
+        data = utils.receive_exact(self.__client, content.content_size)
+
+        aes_key = self.__aes_key or self.__db.get_aes_for_user(header.user_id)
+        if aes_key is None:
+            raise ValueError("AES Key not found for specified user.")
+        plain = utils.decompress_chunk(content.compression, utils.decrypt_ctr_at(aes_key, content.initial_counter, 0, data),
+                                       content.plain_size)
+
+        u = self.__db.users[header.user_id]
+        os.makedirs(u.name, exist_ok=True)
+        dest_file_name = os.path.join(u.name, content.file_name)
+        with open(dest_file_name, 'wb') as f:
+            f.write(plain)
+        self.__db.add_file(header.user_id, content.file_name, dest_file_name)
+        self.__uploaded_file_path = dest_file_name
+
+        crc = utils.crc32()
+        crc.update(plain)
+        file_crc = crc.digest()
+        self.__logger.debug(f"Small file uploaded to {dest_file_name}, CRC is 0x{file_crc:02x}")
+
+        self.__send_file_uploaded(header, content.plain_size, content.file_name, file_crc)
+
+    def begin_chunked_upload(self, header: RequestHeader, content: BeginChunkedUploadContent):
+        """
+        Handles chunked upload requests - starts a new upload, or resumes an existing one of the same file.
+        Responds with the chunks already held, so the client sends only the missing ones.
+        """
+        if content.chunk_size <= 0 or content.chunk_size > MAX_UPLOAD_CHUNK_SIZE or content.chunk_size % 16 != 0:
+            raise ValueError(f"Invalid upload chunk size {content.chunk_size}.")
+
+        u = self.__db.users[header.user_id]
+        try:
+            os.mkdir(u.name)
+        except FileExistsError:
+            pass
+
+        partial_path = os.path.join(u.name, content.file_name + ".part")
+        upload = self.__db.get_or_create_upload(header.user_id, content.upload_id, content.file_name,
+                                                content.file_size, content.chunk_size, partial_path)
+        # a new upload (or a missing partial file) starts from an empty file of the full size.
+        if upload.held_count() == 0 or not os.path.exists(upload.partial_path):
+            upload.held = bytearray(len(upload.held))
+            with open(upload.partial_path, 'wb') as f:
+                f.truncate(upload.file_size)
+
+        self.__send_upload_status(header, upload)
+
+    def upload_chunk(self, header: RequestHeader, content: UploadChunkContent):
+        """
+        Handles a single chunk of a chunked upload. Chunks get no response - the client asks for the upload status
+        after sending them, and chunks that failed their checksum are reported as missing.
+        """
+        self.__receive_chunk(header, content, utils.COMPRESSION_NONE, content.content_size)
+
+    def upload_compressed_chunk(self, header: RequestHeader, content: UploadCompressedChunkContent):
+        """ Handles a single chunk of a chunked upload, that may be compressed. """
+        self.__receive_chunk(header, content, content.compression, content.plain_size)
+
+    def __receive_chunk(self, header: RequestHeader, content, compression: int, plain_size: int):
+        """ Receives, decrypts & decompresses a chunk, and stores it if it matches it's checksum. """
+        # a chunk over the limits can't be skipped without reading it, so the connection is closed instead.
+        if plain_size > MAX_UPLOAD_CHUNK_SIZE or content.content_size > plain_size:
+            raise ValueError(f"Invalid size of chunk #{content.chunk_index}: {content.content_size} bytes.")
+        # any other chunk's data is read anyway, to keep the stream in sync.
+        data = utils.receive_exact(self.__client, content.content_size)
+
+        upload = self.__db.get_upload(header.user_id, content.upload_id)
+        if upload is None or content.chunk_index >= upload.chunk_count \
+                or plain_size != upload.chunk_length(content.chunk_index):
+            self.__logger.debug(f"Dropped unexpected chunk #{content.chunk_index} of upload #{content.upload_id}.")
+            return
+
+        aes_key = self.__aes_key or self.__db.get_aes_for_user(header.user_id)
+        offset = content.chunk_index * upload.chunk_size
+        try:
+            plain = utils.decompress_chunk(compression, utils.decrypt_ctr_at(aes_key, content.initial_counter, offset, data),
+                                           plain_size)
+        except (ValueError, zlib.error) as e:
+            self.__logger.debug(f"Chunk #{content.chunk_index} of upload #{content.upload_id} is corrupted: {e}")
+            return
+
+        crc = utils.crc32()
+        crc.update(plain)
+        if crc.digest() != content.chunk_checksum:
+            self.__logger.debug(f"Chunk #{content.chunk_index} of upload #{content.upload_id} failed it's checksum.")
+            return
+
+        with open(upload.partial_path, 'r+b') as f:
+            f.seek(offset)
+            f.write(plain)
+        upload.set_held(content.chunk_index)
+
+    def finish_chunked_upload(self, header: RequestHeader, content: FinishChunkedUploadContent):
+        """ Handles the end of a chunked upload - once all chunks are held, the file is stored & it's CRC returned. """
+        upload = self.__db.get_upload(header.user_id, content.upload_id)
+        if upload is None:
+            raise ValueError(f"Upload #{content.upload_id} does not exist.")
+        if upload.held_count() != upload.chunk_count:
+            # the client should ask for the status again, and send the missing chunks.
+            self.__send_upload_status(header, upload)
+            return
+
+        dest_file_name = os.path.join(os.path.dirname(upload.partial_path), upload.file_name)
+        os.replace(upload.partial_path, dest_file_name)
+        self.__db.remove_upload(upload.id)
+        self.__db.add_file(header.user_id, upload.file_name, dest_file_name)
+        self.__uploaded_file_path = dest_file_name
+
+        file_crc = utils.crc32().calculate(dest_file_name)
+        self.__logger.debug(f"Chunked upload stored to {dest_file_name}, CRC is 0x{file_crc:02x}")
+
+        self.__send_file_uploaded(header, upload.file_size, upload.file_name, file_crc)
+
+    def __send_upload_status(self, header: RequestHeader, upload):
+        """ Responds with the chunks of the upload that are held. """
+        held = bytes(upload.held)
+        payload = UploadStatusResponse(header.user_id.bytes, upload.id.bytes, upload.chunk_count,
+                                       upload.held_count(), held)
+        self.__client.send(build_response(ServerResponseCodes.UploadStatus, payload, len(held)))
+
+    def query_chunks(self, header: RequestHeader, content: QueryChunksContent):
+        """ Handles chunk queries of deduplicated uploads - responds with the queried chunks that are in the user's store. """
+        hashes = self.__receive_chunk_hashes(content.chunk_count)
+        u = self.__db.users[header.user_id]
+        self.__send_chunks_held(header, u.name, hashes)
+
+    def store_chunk(self, header: RequestHeader, content: StoreChunkContent):
+        """
+        Handles a single chunk of a deduplicated upload. Chunks get no response - chunks that are corrupted or don't
+        match their hash are not stored, and reported as missing when the file is assembled.
+        """
+        # a chunk over the limits can't be skipped without reading it, so the connection is closed instead.
+        if content.plain_size > MAX_STORED_CHUNK_SIZE or content.content_size > content.plain_size:
+            raise ValueError(f"Invalid size of chunk {content.chunk_hash.hex()}: {content.content_size} bytes.")
+        data = utils.receive_exact(self.__client, content.content_size)
+
+        aes_key = self.__aes_key or self.__db.get_aes_for_user(header.user_id)
+        try:
+            plain = utils.decompress_chunk(content.compression,
+                                           utils.decrypt_ctr_at(aes_key, content.initial_counter, content.offset, data),
+                                           content.plain_size)
+        except (ValueError, zlib.error) as e:
+            self.__logger.debug(f"Chunk {content.chunk_hash.hex()} is corrupted: {e}")
+            return
+
+        if hashlib.sha256(plain).digest() != content.chunk_hash:
+            self.__logger.debug(f"Chunk {content.chunk_hash.hex()} doesn't match it's hash.")
+            return
+
+        # the store is per user - a hash alone never grants access to another user's data.
+        u = self.__db.users[header.user_id]
+        chunk_path = utils.chunk_store_path(u.name, content.chunk_hash)
+        os.makedirs(os.path.dirname(chunk_path), exist_ok=True)
+        # written aside & renamed, so a parallel session never reads a partial chunk.
+        temp_path = f"{chunk_path}.{threading.get_ident()}.tmp"
+        with open(temp_path, 'wb') as f:
+            f.write(plain)
+        os.replace(temp_path, chunk_path)
+
+    def assemble_file(self, header: RequestHeader, content: AssembleFileContent):
+        """
+        Handles the end of a deduplicated upload - once all chunks are in the user's store, the file is assembled from
+        them & it's CRC returned. Otherwise, responds with the chunks held, so the client sends the missing ones.
+        """
+        hashes = self.__receive_chunk_hashes(content.chunk_count)
+        u = self.__db.users[header.user_id]
+        chunk_paths = [utils.chunk_store_path(u.name, chunk_hash) for chunk_hash in hashes]
+        if not all(os.path.isfile(path) for path in chunk_paths):
+            self.__send_chunks_held(header, u.name, hashes)
+            return
+
+        # assembled aside & renamed, so a failed assembly never replaces a previous upload of the file.
+        os.makedirs(u.name, exist_ok=True)
+        dest_file_name = os.path.join(u.name, content.file_name)
+        partial_path = dest_file_name + ".part"
+        with open(partial_path, 'wb') as dest:
+            for path in chunk_paths:
+                with open(path, 'rb') as chunk:
+                    dest.write(chunk.read())
+            file_size = dest.tell()
+        if file_size != content.file_size:
+            os.unlink(partial_path)
+            raise ValueError(f"Assembled file is {file_size} bytes instead of {content.file_size}.")
+
+        os.replace(partial_path, dest_file_name)
+        self.__db.add_file(header.user_id, content.file_name, dest_file_name)
+        self.__uploaded_file_path = dest_file_name
+
+        file_crc = utils.crc32().calculate(dest_file_name)
+        self.__logger.debug(f"File assembled from {len(hashes)} chunks to {dest_file_name}, CRC is 0x{file_crc:02x}")
+
+        self.__send_file_uploaded(header, content.file_size, content.file_name, file_crc)
+
+    def __receive_chunk_hashes(self, chunk_count: int) -> list:
+        """ Receives the chunk hashes that follow a query or assemble request. """
+        if chunk_count > MAX_CHUNKS_PER_FILE:
+            raise ValueError(f"Too many chunks ({chunk_count}) in a single file.")
+        data = utils.receive_exact(self.__client, chunk_count * CHUNK_HASH_SIZE_BYTES)
+        return [data[i:i + CHUNK_HASH_SIZE_BYTES] for i in range(0, len(data), CHUNK_HASH_SIZE_BYTES)]
+
+    def __send_chunks_held(self, header: RequestHeader, user_dir: str, hashes: list):
+        """ Responds with the chunks of the list that are in the user's store. """
+        held = bytearray((len(hashes) + 7) // 8)
+        held_count = 0
+        for i, chunk_hash in enumerate(hashes):
+            if os.path.isfile(utils.chunk_store_path(user_dir, chunk_hash)):
+                held[i // 8] |= 1 << (i % 8)
+                held_count += 1
+        if is_compact(header):
+            payload = ChunksHeldCompactResponse(len(hashes), held_count, bytes(held))
+        else:
+            payload = ChunksHeldResponse(header.user_id.bytes, len(hashes), held_count, bytes(held))
+        self.__client.send(build_response(ServerResponseCodes.ChunksHeld, payload, len(held)))
+
+    def __send_file_uploaded(self, header: RequestHeader, file_size: int, file_name: str, file_crc: int):
+        """ Responds with the CRC of an uploaded file. """
+        if is_compact(header):
+            payload = FileUploadCompactResponse(file_crc)
+        else:
+            payload = FileUploadResponse(header.user_id.bytes, file_size & 0xFFFFFFFF, file_name, file_crc)
+        self.__client.send(build_response(ServerResponseCodes.FileUploaded, payload))
 
     def checksum_verified(self, header: RequestHeader, content: ChecksumStatusContent):
         """ Handels checksum status requests. """
@@ -125,7 +390,7 @@ class ClientSession(threading.Thread):
     def invalid_checkum_abort(self, header: RequestHeader, content: ChecksumStatusContent):
         """ Handles file upload abortion - removes the file from local disk and from db. """
         self.__logger.debug(f"File ''{content.file_name}'' upload aborted for user #{content.user_id}! Cleaning up!")
-        os.unlink(self.__db.get_file_path(content.user_id))
+        os.unlink(self.__uploaded_file_path or self.__db.get_file_path(content.user_id))
         self.__db.remove_file(header.user_id)
         self.default_response()
     
@@ -145,5 +410,16 @@ class ClientSession(threading.Thread):
         ClientRequestCodes.UploadFile: upload_file,
         ClientRequestCodes.ValidChecksum: checksum_verified,
         ClientRequestCodes.InvalidChecksumRetry: invalid_checksum_retry,
-        ClientRequestCodes.InvalidChecksumAbort: invalid_checkum_abort
+        ClientRequestCodes.InvalidChecksumAbort: invalid_checkum_abort,
+        ClientRequestCodes.ResumeSession: resume_session,
+        ClientRequestCodes.IssueTicket: issue_ticket,
+        ClientRequestCodes.UploadFileCtr: upload_file_ctr,
+        ClientRequestCodes.BeginChunkedUpload: begin_chunked_upload,
+        ClientRequestCodes.UploadChunk: upload_chunk,
+        ClientRequestCodes.FinishChunkedUpload: finish_chunked_upload,
+        ClientRequestCodes.UploadCompressedChunk: upload_compressed_chunk,
+        ClientRequestCodes.QueryChunks: query_chunks,
+        ClientRequestCodes.StoreChunk: store_chunk,
+        ClientRequestCodes.AssembleFile: assemble_file,
+        ClientRequestCodes.UploadSmallFile: upload_small_file,
     }
\ No newline at end of file
@@ -1,10 +1,14 @@
+import os
 import zlib
 from socket import socket
+from typing import Optional
 from Crypto.Cipher import AES, PKCS1_OAEP
 from Crypto.PublicKey import RSA
 from Crypto.Util.Padding import unpad
 
 CHUNK_SIZE = 1024
+# Size of the blocks an uploaded file is received, decrypted & written in (a multiple of the AES block size).
+FILE_BLOCK_SIZE = 1024 * 1024
 
 
 
@@ -301,26 +305,96 @@ class crc32:
         return self.digest()
 
 
-def socket_to_local_file(src: socket, file_name: str, filesize: int, aes_key: bytes):
-    """ Saves a file from socket to a local file, decrypting it's contents using AES. """
+def socket_to_local_file(src: socket, file_name: str, filesize: int, aes_key: bytes, initial_counter: Optional[bytes] = None) -> int:
+    """
+    Saves a file from socket to a local file, decrypting it's contents using AES, and returns the file's CRC.
+    The file is encrypted with AES-CBC and a zero IV, or with AES-CTR if an initial counter block is specified.
+    It is received, decrypted & written in blocks, so a file of any size takes the same memory.
+    """
+    if initial_counter is not None:
+        # the whole counter block is incremented as a single big-endian 128 bit number, with no padding.
+        cipher = AES.new(key=aes_key, mode=AES.MODE_CTR, nonce=b'', initial_value=initial_counter)
+    else:
+        if filesize == 0 or filesize % AES.block_size != 0:
+            raise ValueError(f"Invalid AES-CBC file size {filesize}.")
+        cipher = AES.new(key=aes_key, mode=AES.MODE_CBC, iv=(b'\0' * 16))
+
+    crc = crc32()
+    buffer = bytearray(min(filesize, FILE_BLOCK_SIZE))
+    view = memoryview(buffer)
     size_left = filesize
+    with open(file_name, 'wb+') as f:
+        while size_left > 0:
+            length = min(size_left, len(buffer))
+            receive_into(src, view[:length])
+            size_left -= length
+
+            # both modes keep their state between blocks - the CBC padding is in the last one.
+            plain = cipher.decrypt(view[:length])
+            if initial_counter is None and size_left == 0:
+                plain = unpad(plain, AES.block_size)
+            f.write(plain)
+            crc.update(plain)
+    return crc.digest()
+
+
+def receive_exact(src: socket, size: int) -> bytes:
+    """ Receives exactly size bytes from the socket. """
+    buffer = bytearray(size)
+    receive_into(src, memoryview(buffer))
+    return bytes(buffer)
 
-    # Read the file to memory
-    buffer = bytes()
-    while size_left > 0:
-        # fetch from socket
-        rcvd_bytes = src.recv(min(size_left, 1024))
-        if not rcvd_bytes:
+
+def receive_into(src: socket, view: memoryview):
+    """ Receives exactly the view's size of bytes from the socket, into the view. """
+    size = len(view)
+    received = 0
+    while received < size:
+        count = src.recv_into(view[received:], size - received)
+        if not count:
             raise ClientDisconnectedException()
-        buffer += rcvd_bytes
-        size_left -= len(rcvd_bytes)
+        received += count
 
-    # Decrypt and save the file
-    cipher = AES.new(key=aes_key, mode=AES.MODE_CBC, iv=(b'\0' * 16))
-    with open(file_name, 'wb+') as f:
-        decrypted = cipher.decrypt(buffer)
-        unpadded = unpad(decrypted, AES.block_size)
-        f.write(unpadded)
+
+def decrypt_ctr_at(aes_key: bytes, initial_counter: bytes, offset: int, data: bytes) -> bytes:
+    """ Decrypts data that was encrypted with AES-CTR, starting at the specified (byte) offset of the key stream. """
+    counter = (int.from_bytes(initial_counter, 'big') + offset // AES.block_size) % (1 << 128)
+    cipher = AES.new(key=aes_key, mode=AES.MODE_CTR, nonce=b'', initial_value=counter.to_bytes(16, 'big'))
+    # an offset within a block skips the start of the block's key stream.
+    skip = offset % AES.block_size
+    if skip:
+        cipher.decrypt(bytes(skip))
+    return cipher.decrypt(data)
+
+
+# Chunk compression methods
+COMPRESSION_NONE = 0
+COMPRESSION_DEFLATE = 1
+
+
+def decompress_chunk(compression: int, data: bytes, plain_size: int) -> bytes:
+    """ Decompresses an uploaded chunk. Raises ValueError if it doesn't decompress into exactly plain_size bytes. """
+    if compression == COMPRESSION_NONE:
+        plain = data
+    elif compression == COMPRESSION_DEFLATE:
+        # raw Deflate stream, with no zlib header. Output is bounded, so a malicious chunk can't blow up the memory.
+        decompressor = zlib.decompressobj(-zlib.MAX_WBITS)
+        plain = decompressor.decompress(data, plain_size + 1)
+    else:
+        raise ValueError(f"Unknown compression method {compression}.")
+
+    if len(plain) != plain_size:
+        raise ValueError(f"Chunk decompressed to {len(plain)} bytes instead of {plain_size}.")
+    return plain
+
+
+# Directory (in the user's directory) of the chunks of deduplicated uploads
+CHUNK_STORE_DIR_NAME = ".chunks"
+
+
+def chunk_store_path(user_dir: str, chunk_hash: bytes) -> str:
+    """ Returns the path of a chunk in the user's chunk store - chunks are named by their SHA-256 hash. """
+    return os.path.join(user_dir, CHUNK_STORE_DIR_NAME, chunk_hash.hex())
 
 
 def encrypt_with_rsa(publickey: bytes, short_data: bytes) -> bytes: